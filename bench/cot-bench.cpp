@@ -0,0 +1,496 @@
+// Curious Orbital Toy
+// Malhar Palkar
+// Headless benchmark suite of the engine, trails, rendering and I/O, written as JSON
+#include <curious-orbital-toy.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+
+// Least time spent repeating each measurement (sec)
+static const double param_minTime = 0.25;
+
+// Untimed calls before each measurement, enough for every frame slot of an engine to be filled once
+static const std::size_t param_warmupCalls = 3;
+
+// Body counts of every scenario, and the largest direct summation is run at
+static const std::size_t param_counts[] = { 10, 100, 1000, 10000, 100000 };
+static const std::size_t param_directMax = 10000;
+static const std::size_t param_quickMax = 1000;
+
+// Size of the offscreen target, and the disk that every scenario fits in (pixels)
+static const unsigned int param_drawWidth = 1280, param_drawHeight = 720;
+static const cot::math_t param_radius = 300.0f;
+
+// Mass of the whole of every scenario
+static const cot::math_t param_totalMass = 1000.0f;
+
+// Bodies in the generated catalog
+static const std::size_t param_catalogBodies = 200000;
+
+// Bodies of the steady state scenario, frames run before counting its allocations and frames counted
+static const std::size_t param_steadyBodies = 500;
+static const std::size_t param_steadyWarmup = 2 * COT_PERSIST;
+static const std::size_t param_steadyFrames = 200;
+
+// Generated systems
+typedef enum _scenario
+{
+    SCENARIO_DISK,          // Uniform disk on circular orbits about its centre
+    SCENARIO_PLUMMER,       // Plummer sphere seen face on, on circular orbits
+    SCENARIO_BINARY         // Heavy binary with a ring of light debris
+} scenario_t;
+
+static const scenario_t param_scenarios[] = { SCENARIO_DISK, SCENARIO_PLUMMER, SCENARIO_BINARY };
+
+/**
+ * @brief Name of a scenario
+*/
+static const char* scenarioName(const scenario_t scenario)
+{
+    switch (scenario)
+    {
+    case SCENARIO_PLUMMER:
+        return "plummer";
+    case SCENARIO_BINARY:
+        return "binary";
+    default:
+        return "disk";
+    }
+}
+
+/**
+ * @brief Appends a body on a circular orbit of an enclosed mass about the centre of the target
+*/
+static void addOrbiting(cot::catalog_t& out_catalog, const cot::math_t mass, const cot::math_t r, const cot::math_t angle,
+    const cot::math_t enclosed)
+{
+    const cot::math_t v = (r > 0.0f ? std::sqrt(cot::force::gravity * enclosed / r) : 0.0f);
+    out_catalog.name.push_back("body");
+    out_catalog.mass.push_back(mass);
+    out_catalog.x.push_back(param_drawWidth * 0.5f + r * std::cos(angle));
+    out_catalog.y.push_back(param_drawHeight * 0.5f + r * std::sin(angle));
+    out_catalog.vx.push_back(-v * std::sin(angle));
+    out_catalog.vy.push_back(v * std::cos(angle));
+}
+
+/**
+ * @brief Generates a scenario of n bodies, the same for every run
+*/
+static void buildScenario(const scenario_t scenario, const std::size_t n, cot::catalog_t& out_catalog)
+{
+    std::mt19937 rng(static_cast<std::uint32_t>(n * 3 + scenario));
+    std::uniform_real_distribution<cot::math_t> uniform(0.0f, 1.0f);
+    const cot::math_t twoPi = 2.0f * static_cast<cot::math_t>(M_PI);
+    const cot::math_t mass = param_totalMass / n;
+
+    switch (scenario)
+    {
+    case SCENARIO_DISK:
+        for (std::size_t i = 0; i < n; i++)
+        {
+            // Uniform in area, the enclosed mass grows with the square of the radius
+            const cot::math_t r = param_radius * std::sqrt(uniform(rng));
+            addOrbiting(out_catalog, mass, r, twoPi * uniform(rng), param_totalMass * r * r / (param_radius * param_radius));
+        }
+        break;
+
+    case SCENARIO_PLUMMER:
+    {
+        const cot::math_t a = param_radius * 0.2f;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            // Inverse of the Plummer cumulative mass, cut off at the disk
+            const cot::math_t u = std::max(uniform(rng), static_cast<cot::math_t>(1e-6f));
+            const cot::math_t r = std::min(a / std::sqrt(std::pow(u, -2.0f / 3.0f) - 1.0f), param_radius);
+            const cot::math_t enclosed = param_totalMass * r * r * r / std::pow(r * r + a * a, 1.5f);
+            addOrbiting(out_catalog, mass, r, twoPi * uniform(rng), enclosed);
+        }
+        break;
+    }
+
+    case SCENARIO_BINARY:
+    {
+        // Equal pair holding almost all the mass, orbiting their common centre
+        const cot::math_t heavy = param_totalMass * 0.49f;
+        const cot::math_t separation = param_radius * 0.2f;
+        const cot::math_t vPair = std::sqrt(cot::force::gravity * heavy / (2.0f * separation));
+        for (int k = 0; k < 2; k++)
+        {
+            const cot::math_t side = (k == 0 ? 1.0f : -1.0f);
+            out_catalog.name.push_back("star");
+            out_catalog.mass.push_back(heavy);
+            out_catalog.x.push_back(param_drawWidth * 0.5f + side * separation * 0.5f);
+            out_catalog.y.push_back(param_drawHeight * 0.5f);
+            out_catalog.vx.push_back(0.0f);
+            out_catalog.vy.push_back(side * vPair);
+        }
+
+        // Debris ring well outside the pair
+        const cot::math_t debris = param_totalMass * 0.02f / std::max<std::size_t>(n - 2, 1);
+        for (std::size_t i = 2; i < n; i++)
+        {
+            const cot::math_t r = param_radius * (0.5f + 0.5f * uniform(rng));
+            addOrbiting(out_catalog, debris, r, twoPi * uniform(rng), 2.0f * heavy);
+        }
+        break;
+    }
+    }
+}
+
+// Flat JSON object of named fields
+class JsonRecord
+{
+private:
+
+    std::ostringstream ss;
+    bool bFirst = true;
+
+    void key(const char* name)
+    {
+        this->ss << (this->bFirst ? "{" : ", ") << "\"" << name << "\": ";
+        this->bFirst = false;
+    }
+
+public:
+
+    JsonRecord& field(const char* name, const double value)
+    {
+        this->key(name);
+        if (std::isfinite(value))
+            this->ss << value;
+        else
+            this->ss << "null";
+        return *this;
+    }
+
+    JsonRecord& field(const char* name, const char* value)
+    {
+        this->key(name);
+        this->ss << "\"" << value << "\"";
+        return *this;
+    }
+
+    std::string str() const
+    {
+        return this->ss.str() + "}";
+    }
+};
+
+// Result of a repeated measurement
+typedef struct _timing
+{
+    double seconds;         // Time per repetition (sec)
+    double allocations;     // Allocations per repetition
+} timing_t;
+
+/**
+ * @brief Repeats a function until enough time has passed, after a few untimed calls
+*/
+template <class TFunc>
+static timing_t measure(TFunc fn)
+{
+    for (std::size_t i = 0; i < param_warmupCalls; i++)
+        fn();
+
+    std::uint64_t nReps = 0;
+    const std::uint64_t nAllocBegin = cot::metrics::allocations();
+    auto tBegin = std::chrono::steady_clock::now();
+    std::chrono::duration<double> tElapsed(0.0);
+    while ((nReps == 0) || (tElapsed.count() < param_minTime))
+    {
+        fn();
+        nReps++;
+        tElapsed = std::chrono::steady_clock::now() - tBegin;
+    }
+    return timing_t{ tElapsed.count() / nReps, static_cast<double>(cot::metrics::allocations() - nAllocBegin) / nReps };
+}
+
+/**
+ * @brief Measures updates of a small disk on the general engine, which hands it to a fixed size engine, and on FixedEngine<N> itself
+*/
+template <std::size_t N>
+static std::string measureSmall(const std::size_t nThreads)
+{
+    cot::catalog_t cat;
+    buildScenario(SCENARIO_DISK, N, cat);
+    cot::Engine eng;
+    eng.setThreads(nThreads);
+    eng.setIntegrator(cot::INTEGRATOR_LEAPFROG);
+    eng.addBodies(cat);
+    timing_t tEngine = measure([&]() { eng.update(1.0f / 120.0f); });
+
+    cot::FixedEngine<N> fixed;
+    fixed.setIntegrator(cot::INTEGRATOR_LEAPFROG);
+    fixed.addBodies(cat);
+    timing_t tFixed = measure([&]() { fixed.update(1.0f / 120.0f); });
+
+    std::cout << "small n=" << N << ": engine " << 1.0 / tEngine.seconds << " steps/sec, fixed " << 1.0 / tFixed.seconds 
+        << " steps/sec" << std::endl;
+    return JsonRecord().field("n", N).field("engine_steps_per_sec", 1.0 / tEngine.seconds)
+        .field("fixed_steps_per_sec", 1.0 / tFixed.seconds).field("allocations_per_step", tEngine.allocations).str();
+}
+
+/**
+ * @brief Writes a named array of records
+*/
+static void writeSection(std::ostream& os, const char* name, const std::vector<std::string>& vRecords, const bool last = false)
+{
+    os << "  \"" << name << "\": [";
+    for (std::size_t i = 0; i < vRecords.size(); i++)
+        os << (i ? ",\n    " : "\n    ") << vRecords[i];
+    os << (vRecords.empty() ? "]" : "\n  ]") << (last ? "\n" : ",\n");
+}
+
+int main(int argc, char **argv)
+{
+    // Parse command line options
+    std::string sOut = "bench.json";
+    bool bQuick = false;
+    std::size_t nThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            bQuick = true;
+        else if ((std::strcmp(argv[i], "--out") == 0) && (i + 1 < argc))
+            sOut = argv[++i];
+        else if ((std::strcmp(argv[i], "--threads") == 0) && (i + 1 < argc))
+            nThreads = std::max(1, std::stoi(argv[++i]));
+        else
+        {
+            std::cerr << "Usage: cot-bench [--quick] [--threads N] [--out bench.json]" << std::endl;
+            return 1;
+        }
+    }
+    auto logger = spdlog::basic_logger_mt("logger", "cot-bench.log");
+    const cot::force::isa_t isaBest = cot::force::detect();
+    std::vector<std::string> vKernel, vUpdate, vSmall, vTrails, vSnapshot, vCatalog, vDraw, vSteady;
+
+    // Force kernel on every supported instruction set
+    for (cot::force::isa_t isa : { cot::force::ISA_SCALAR, cot::force::ISA_SSE, cot::force::ISA_AVX2 })
+    {
+        if (isa > isaBest)
+            break;
+        for (std::size_t n : { 256, 4096 })
+        {
+            cot::catalog_t cat;
+            buildScenario(SCENARIO_DISK, n, cat);
+            std::vector<cot::math_t> ax(n), ay(n);
+            timing_t t = measure([&]() { cot::force::accumulate(cat.x.data(), cat.y.data(), cat.mass.data(), 0, n, 0.0f, ax.data(), ay.data(), isa); });
+            cot::force::potential_t pot;
+            timing_t tPotential = measure([&]() 
+            {
+                cot::force::accumulate(cat.x.data(), cat.y.data(), cat.mass.data(), 0, n, 0.0f, ax.data(), ay.data(), pot, isa); 
+            });
+            const double pairs = n * (n - 1) / 2.0;
+            vKernel.push_back(JsonRecord().field("isa", cot::force::isaName(isa)).field("n", n)
+                .field("ns_per_interaction", t.seconds * 1e9 / pairs).field("ns_per_interaction_potential", tPotential.seconds * 1e9 / pairs).str());
+            std::cout << "kernel " << cot::force::isaName(isa) << " n=" << n << ": " << t.seconds * 1e9 / pairs << " ns/interaction, " 
+                << tPotential.seconds * 1e9 / pairs << " with potential" << std::endl;
+        }
+    }
+
+    // Full updates of every scenario with every solver that is practical at its size
+    for (std::size_t n : param_counts)
+    {
+        if (bQuick && (n > param_quickMax))
+            break;
+        for (scenario_t scenario : param_scenarios)
+        {
+            for (cot::solver_t solver : { cot::SOLVER_DIRECT, cot::SOLVER_BARNES_HUT })
+            {
+                if ((solver == cot::SOLVER_DIRECT) && (n > param_directMax))
+                    continue;
+                if ((solver == cot::SOLVER_BARNES_HUT) && (n < param_quickMax))
+                    continue;
+
+                cot::catalog_t cat;
+                buildScenario(scenario, n, cat);
+                cot::Engine eng;
+                eng.setThreads(nThreads);
+                eng.setSolver(solver);
+                eng.addBodies(cat);
+                timing_t t = measure([&]() { eng.update(1.0f / 120.0f); });
+                const double pairs = n * (n - 1) / 2.0;
+                vUpdate.push_back(JsonRecord().field("scenario", scenarioName(scenario))
+                    .field("solver", (solver == cot::SOLVER_DIRECT ? "direct" : "barnes-hut")).field("n", n)
+                    .field("steps_per_sec", 1.0 / t.seconds).field("ns_per_interaction", t.seconds * 1e9 / pairs)
+                    .field("allocations_per_step", t.allocations).str());
+                std::cout << "update " << scenarioName(scenario) << " " << (solver == cot::SOLVER_DIRECT ? "direct" : "barnes-hut")
+                    << " n=" << n << ": " << 1.0 / t.seconds << " steps/sec, " << t.allocations << " allocations/step" << std::endl;
+            }
+        }
+    }
+
+    // Small systems of the sizes interactive scenarios and sweeps run
+    vSmall.push_back(measureSmall<2>(nThreads));
+    vSmall.push_back(measureSmall<4>(nThreads));
+    vSmall.push_back(measureSmall<8>(nThreads));
+    vSmall.push_back(measureSmall<16>(nThreads));
+
+    // Trail maintenance, snapshots and drawing of a disk
+    sf::RenderTexture texDraw;
+    const bool bDraw = texDraw.create(param_drawWidth, param_drawHeight);
+    if (!bDraw)
+        std::cout << "draw: no offscreen target, skipped" << std::endl;
+    for (std::size_t n : param_counts)
+    {
+        if (bQuick && (n > param_quickMax))
+            break;
+
+        cot::catalog_t cat;
+        buildScenario(SCENARIO_DISK, n, cat);
+
+        cot::Trails trl;
+        std::vector<std::uint32_t> vIds(n);
+        for (std::size_t i = 0; i < n; i++)
+            vIds[i] = static_cast<std::uint32_t>(i);
+        std::size_t nStamp = 0;
+        timing_t tTrails = measure([&]()
+        {
+            // Move every body a little so each stamp differs
+            cat.x[nStamp % n] += 1.0f;
+            trl.append(vIds.data(), cat.x.data(), cat.y.data(), n);
+            nStamp++;
+        });
+        vTrails.push_back(JsonRecord().field("n", n).field("ns_per_body", tTrails.seconds * 1e9 / n)
+            .field("allocations_per_stamp", tTrails.allocations).str());
+
+        cot::Engine eng;
+        eng.setThreads(nThreads);
+        eng.setSolver(cot::SOLVER_BARNES_HUT);
+        eng.addBodies(cat);
+        eng.update(1.0f / 120.0f);
+        // Taking a snapshot and reading every position through it, as a recorder would
+        double mSum = 0.0;
+        timing_t tSnapshot = measure([&]()
+        {
+            const cot::snapshot_t snap = eng.snapshot();
+            for (std::size_t i = 0; i < snap.count; i++)
+                mSum += snap.x[i] + snap.y[i];
+        });
+        if (!std::isfinite(mSum))
+            std::cout << "snapshot: non-finite positions" << std::endl;
+        vSnapshot.push_back(JsonRecord().field("n", n).field("ns_per_body", tSnapshot.seconds * 1e9 / n)
+            .field("allocations_per_call", tSnapshot.allocations).str());
+        std::cout << "trails n=" << n << ": " << tTrails.seconds * 1e9 / n << " ns/body, snapshot: "
+            << tSnapshot.seconds * 1e9 / n << " ns/body" << std::endl;
+
+        if (bDraw)
+        {
+            timing_t tDraw = measure([&]()
+            {
+                texDraw.clear(sf::Color::Black);
+                eng.draw(texDraw);
+                texDraw.display();
+            });
+            vDraw.push_back(JsonRecord().field("n", n).field("ms_per_frame", tDraw.seconds * 1e3)
+                .field("allocations_per_frame", tDraw.allocations).str());
+            std::cout << "draw n=" << n << ": " << tDraw.seconds * 1e3 << " ms/frame" << std::endl;
+        }
+    }
+
+    // Frames of every integrator and solver with collisions and diagnostics, which must not allocate once warmed up
+    bool bSteady = true;
+    if (!cot::metrics::countAllocations)
+        std::cout << "steady: allocations not counted, skipped" << std::endl;
+    for (cot::integrator_t integrator : { cot::INTEGRATOR_EULER, cot::INTEGRATOR_LEAPFROG, cot::INTEGRATOR_YOSHIDA4, cot::INTEGRATOR_RK4,
+        cot::INTEGRATOR_RKF45, cot::INTEGRATOR_BLOCK })
+    {
+        for (cot::solver_t solver : { cot::SOLVER_DIRECT, cot::SOLVER_BARNES_HUT })
+        {
+            if (!cot::metrics::countAllocations)
+                break;
+
+            cot::catalog_t cat;
+            buildScenario(SCENARIO_DISK, param_steadyBodies, cat);
+            cot::Engine eng;
+            eng.setThreads(nThreads);
+            eng.setIntegrator(integrator);
+            eng.setSolver(solver);
+            eng.setCollisions(true);
+            eng.setDiagnostics(true);
+            eng.addBodies(cat);
+            auto fnFrame = [&]()
+            {
+                eng.update(1.0f / 120.0f);
+                if (bDraw)
+                {
+                    texDraw.clear(sf::Color::Black);
+                    eng.draw(texDraw);
+                    texDraw.display();
+                }
+            };
+
+            // Trails fill and every reused buffer reaches its size during the warm up
+            for (std::size_t frame = 0; frame < param_steadyWarmup; frame++)
+                fnFrame();
+            const std::uint64_t nAllocBegin = cot::metrics::allocations();
+            for (std::size_t frame = 0; frame < param_steadyFrames; frame++)
+                fnFrame();
+            const std::uint64_t nAllocs = cot::metrics::allocations() - nAllocBegin;
+            bSteady = bSteady && (nAllocs == 0);
+
+            const char* szSolver = (solver == cot::SOLVER_DIRECT ? "direct" : "barnes-hut");
+            vSteady.push_back(JsonRecord().field("integrator", cot::integrator::name(integrator)).field("solver", szSolver)
+                .field("n", param_steadyBodies).field("frames", param_steadyFrames).field("allocations", nAllocs).str());
+            std::cout << "steady " << cot::integrator::name(integrator) << " " << szSolver << ": " << nAllocs << " allocations in "
+                << param_steadyFrames << " frames" << (nAllocs ? ", FAILED" : "") << std::endl;
+        }
+    }
+
+    // Catalog loading from a generated file
+    {
+        const std::string sCatalog = "cot-bench.csv";
+        cot::catalog_t cat;
+        buildScenario(SCENARIO_PLUMMER, (bQuick ? param_catalogBodies / 10 : param_catalogBodies), cat);
+        {
+            std::ofstream fCatalog(sCatalog);
+            for (std::size_t i = 0; i < cat.size(); i++)
+                fCatalog << cat.name[i] << "," << cat.mass[i] << "," << cat.x[i] << "," << cat.y[i] << "," << cat.vx[i] << "," << cat.vy[i] << ",\n";
+        }
+        std::ifstream fSize(sCatalog, std::ios::binary | std::ios::ate);
+        const double megabytes = static_cast<double>(fSize.tellg()) / 1e6;
+        timing_t t = measure([&]()
+        {
+            cot::catalog_t catLoaded;
+            cot::cfgLoadCatalog(logger, sCatalog, nThreads, catLoaded);
+        });
+        std::remove(sCatalog.c_str());
+        vCatalog.push_back(JsonRecord().field("bodies", cat.size()).field("megabytes", megabytes)
+            .field("mb_per_sec", megabytes / t.seconds).str());
+        std::cout << "catalog " << cat.size() << " bodies: " << megabytes / t.seconds << " MB/s" << std::endl;
+    }
+
+    // Peak resident set of the whole run
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    std::cout << "peak RSS " << ru.ru_maxrss << " KiB" << std::endl;
+
+    std::ofstream fOut(sOut);
+    fOut << "{\n";
+    fOut << "  \"summary\": " << JsonRecord().field("precision", (sizeof(cot::math_t) == sizeof(double) ? "double" : "float"))
+        .field("isa", cot::force::isaName(isaBest)).field("threads", nThreads).field("quick", bQuick)
+        .field("peak_rss_kib", ru.ru_maxrss).field("steady_allocation_free", bSteady).str() << ",\n";
+    writeSection(fOut, "kernel", vKernel);
+    writeSection(fOut, "update", vUpdate);
+    writeSection(fOut, "small", vSmall);
+    writeSection(fOut, "trails", vTrails);
+    writeSection(fOut, "snapshot", vSnapshot);
+    writeSection(fOut, "draw", vDraw);
+    writeSection(fOut, "steady", vSteady);
+    writeSection(fOut, "catalog", vCatalog, true);
+    fOut << "}" << std::endl;
+    std::cout << "Wrote " << sOut << std::endl;
+
+    // Allocating steady frames fail the run, so scripts can gate on it
+    return (bSteady ? 0 : 2);
+}
@@ -0,0 +1,95 @@
+// Curious Orbital Toy
+// Malhar Palkar
+// Energy drift benchmark of the integrators
+#include <curious-orbital-toy.hpp>
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Mass of the central body and its satellites
+static const cot::math_t param_centralMass = 1000.0f;
+static const cot::math_t param_satelliteMass = 1.0f;
+
+// Orbital radii of the satellites (pixels)
+static const cot::math_t param_orbits[] = { 100.0f, 150.0f, 220.0f, 300.0f };
+
+// Simulated time of every run (sec)
+static const cot::math_t param_duration = 20.0f;
+
+/**
+ * @brief Total energy of the system, kinetic plus potential
+*/
+static double energy(cot::Engine& eng)
+{
+    const cot::snapshot_t snap = eng.snapshot();
+    double e = 0.0;
+    for (std::size_t i = 0; i < snap.count; i++)
+    {
+        e += 0.5 * snap.mass[i] * (static_cast<double>(snap.vx[i]) * snap.vx[i] + static_cast<double>(snap.vy[i]) * snap.vy[i]);
+        for (std::size_t j = 0; j < i; j++)
+        {
+            double dx = static_cast<double>(snap.x[i]) - snap.x[j];
+            double dy = static_cast<double>(snap.y[i]) - snap.y[j];
+            e -= cot::force::gravity * static_cast<double>(snap.mass[i]) * snap.mass[j] / std::sqrt(dx * dx + dy * dy);
+        }
+    }
+    return e;
+}
+
+/**
+ * @brief Builds a central body with satellites on circular orbits
+*/
+static void buildSystem(cot::Engine& eng)
+{
+    eng.addBody("central", param_centralMass, cot::vector_t(0.0f, 0.0f), cot::vector_t(0.0f, 0.0f));
+    for (const cot::math_t r : param_orbits)
+    {
+        cot::math_t v = std::sqrt(cot::force::gravity * param_centralMass / r);
+        eng.addBody("satellite", param_satelliteMass, cot::vector_t(r, 0.0f), cot::vector_t(0.0f, v));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // Accuracy target for the largest usable step
+    const double target = (argc > 1 ? std::stod(argv[1]) : 1e-4);
+    std::cout << "Largest relative energy drift over " << param_duration << " sec, target " << target << std::endl;
+    std::cout << std::setw(10) << "integrator" << std::setw(12) << "dt" << std::setw(14) << "drift" 
+        << std::setw(14) << "evaluations" << std::endl;
+
+    for (cot::integrator_t integ : { cot::INTEGRATOR_EULER, cot::INTEGRATOR_LEAPFROG, cot::INTEGRATOR_YOSHIDA4, 
+        cot::INTEGRATOR_RK4, cot::INTEGRATOR_RKF45, cot::INTEGRATOR_BLOCK })
+    {
+        cot::math_t bestDt = 0.0f;
+        std::uint64_t bestEvaluations = 0;
+        for (cot::math_t dt = 1.0f / 1024.0f; dt <= 0.5f; dt *= 2.0f)
+        {
+            cot::Engine eng;
+            eng.setIntegrator(integ);
+            buildSystem(eng);
+
+            const double e0 = energy(eng);
+            double drift = 0.0;
+            for (cot::math_t t = 0.0f; t < param_duration; t += dt)
+            {
+                eng.update(dt);
+                drift = std::max(drift, std::abs((energy(eng) - e0) / e0));
+            }
+
+            std::cout << std::setw(10) << cot::integrator::name(integ) << std::setw(12) << dt << std::setw(14) << drift 
+                << std::setw(14) << eng.evaluations() << std::endl;
+            if (std::isfinite(drift) && (drift <= target))
+            {
+                bestDt = dt;
+                bestEvaluations = eng.evaluations();
+            }
+        }
+
+        std::cout << cot::integrator::name(integ) << ": largest step within target " << bestDt << " sec using " 
+            << bestEvaluations << " evaluations" << std::endl << std::endl;
+    }
+
+    return 0;
+}
@@ -10,88 +10,2290 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-// Number of persistence objects
+// Default number of persistence stamps per body
 #define COT_PERSIST     400
 
 namespace cot
 {
-    // Precision math datatype
+    // Precision math datatype, double precision builds define COT_DOUBLE
+#ifdef COT_DOUBLE
+    typedef double math_t;
+#else
     typedef float math_t;
+#endif
 
-    // Representation of a state of a physical body
-    typedef struct _state
+    // Vector of the precision math datatype
+    typedef sf::Vector2<math_t> vector_t;
+
+    // Read only view of the state of every body in a system, which copies nothing
+    // Views stay valid until the state they look at next changes, see Engine::snapshot and Engine::latest
+    typedef struct _snapshot
+    {
+        std::size_t             count;      // Number of bodies
+        const math_t*           x;          // Position X of each body (pixels)
+        const math_t*           y;          // Position Y of each body (pixels)
+        const math_t*           vx;         // Velocity X of each body (pixels/sec)
+        const math_t*           vy;         // Velocity Y of each body (pixels/sec)
+        const math_t*           mass;       // Mass of each body
+        const std::uint32_t*    id;         // Stable identifier of each body
+        const std::uint32_t*    name;       // Interned name of each body, see Engine::nameOf
+        std::uint64_t           step;       // Number of steps taken by the engine
+        math_t                  time;       // Simulated time (sec)
+        std::uint64_t           generation; // Changes whenever the state of any body changes
+        std::uint64_t           layout;     // Changes whenever bodies are added or removed
+    } snapshot_t;
+
+    // Structure-of-arrays store of the physical state of every body in a system
+    typedef struct _physics
+    {
+        std::vector<math_t> x;          // Position X of each body (pixels)
+        std::vector<math_t> y;          // Position Y of each body (pixels)
+        std::vector<math_t> vx;         // Velocity X of each body (pixels/sec)
+        std::vector<math_t> vy;         // Velocity Y of each body (pixels/sec)
+        std::vector<math_t> mass;       // Mass of each body
+        std::vector<math_t> ax;         // Acceleration X of each body from the last update (pixels/sec^2)
+        std::vector<math_t> ay;         // Acceleration Y of each body from the last update (pixels/sec^2)
+
+        /**
+         * @brief Number of bodies in the store
+        */
+        std::size_t size() const { return this->mass.size(); }
+    } physics_t;
+
+    // Physical state of a system whose number of bodies is known at compile time, laid out like physics_t
+    template <std::size_t N>
+    struct fixed_physics_t
+    {
+        std::array<math_t, N> x, y;     // Position of each body (pixels)
+        std::array<math_t, N> vx, vy;   // Velocity of each body (pixels/sec)
+        std::array<math_t, N> mass;     // Mass of each body
+        std::array<math_t, N> ax, ay;   // Acceleration of each body from the last update (pixels/sec^2)
+
+        /**
+         * @brief Number of bodies in the store
+        */
+        static constexpr std::size_t size() { return N; }
+    };
+
+    // Render state of a physical body, only touched while drawing
+    typedef struct _render
+    {
+        math_t              mass;       // Mass the radius was derived from
+        float               radius;     // Graphical radius of the body (pixels)
+    } render_t;
+
+    // Handle of a body in an engine, valid until the body is removed or merged into another
+    typedef struct _body_handle
+    {
+        std::uint32_t       slot = UINT32_MAX;  // Slot of the body in the registry of the engine
+        std::uint32_t       generation = 0;     // Generation of the slot when the body was added
+    } body_handle_t;
+
+    // Slot of the body registry of an engine
+    typedef struct _registry_slot
+    {
+        std::uint32_t       index;      // Index of the body in the physics store while in use, next free slot otherwise
+        std::uint32_t       generation; // Changes whenever the body of the slot is removed, so older handles no longer match
+    } registry_slot_t;
+
+    namespace checkpoint
+    {
+        // Leading word of a checkpoint file, "COTC" in little endian
+        const std::uint32_t magic = 0x43544F43;
+
+        // Version of the checkpoint format, bumped whenever the header or a section changes
+        const std::uint32_t version = 1;
+
+        // Flags of the integrator state in a checkpoint
+        const std::uint32_t flagAccelValid = 1;     // Acceleration is valid for the saved positions
+        const std::uint32_t flagLevels = 2;         // Block timestep levels are saved
+
+        // Value columns of a checkpoint, in file order
+        enum column_t { COLUMN_X, COLUMN_Y, COLUMN_VX, COLUMN_VY, COLUMN_MASS, COLUMN_AX, COLUMN_AY, COLUMN_RADIUS, COLUMN_COUNT };
+
+        // Header at the start of a checkpoint file
+        // Followed by sections each starting on 8 bytes: value columns, id, name and level of every body,
+        //  the name table as strings ending in zero, then the id, head and count of every trail ring and their stamps
+        typedef struct _header
+        {
+            std::uint32_t magic;        // checkpoint::magic
+            std::uint32_t version;      // Format version
+            std::uint32_t valueSize;    // Bytes per value column entry, 4 for float and 8 for double
+            std::uint32_t integrator;   // Integrator the state was saved with
+            std::uint64_t count;        // Number of bodies
+            std::uint64_t names;        // Number of interned names
+            std::uint64_t nameBytes;    // Bytes of the name table
+            std::uint64_t step;         // Number of steps taken by the engine
+            double        time;         // Simulated time (sec)
+            double        adaptiveDt;   // Substep (sec) of adaptive integrators
+            std::uint64_t merges;       // Number of merges of touching bodies
+            std::uint32_t nextId;       // Identifier of the next body added
+            std::uint32_t flags;        // Integrator state flags
+            std::uint64_t trailLength;  // Stamps per trail ring
+            std::uint64_t trails;       // Number of trail rings, zero when none are saved
+        } header_t;
+
+        /**
+         * @brief Rounds a section size up to whole 8 byte words
+        */
+        inline std::uint64_t align(const std::uint64_t bytes)
+        {
+            return (bytes + 7) & ~std::uint64_t(7);
+        }
+    }
+
+    // Copy of the full state of an engine, taken quickly and written to a checkpoint file in the background
+    typedef struct _checkpoint
+    {
+        checkpoint::header_t header;
+        std::vector<math_t> columns[checkpoint::COLUMN_COUNT];
+        std::vector<std::uint32_t> id, name;
+        std::vector<std::uint8_t> level;
+        std::string names;              // Name table, every name followed by a zero
+        std::vector<std::uint32_t> trailIds, trailHead, trailCount;
+        std::vector<sf::Vector2f> trailPoints;
+    } checkpoint_t;
+
+    // Persistence history of every body, kept as one ring of stamps per body
+    class Trails
+    {
+    private:
+
+        // Capacity of each ring
+        std::size_t nLength = COT_PERSIST;
+
+        // Square of the distance a body travels before it is stamped again, zero to stamp every frame
+        float mSpacing2 = 0.0f;
+
+        // Rings of every body laid end to end
+        std::vector<sf::Vector2f> vPoints;
+
+        // Next write index and number of stamps in the ring of each body
+        std::vector<std::uint32_t> vHead, vCount;
+
+        // Identifier of the body owning each ring
+        std::vector<std::uint32_t> vIds;
+
+        // Rings being rebuilt by remap, and the old rings in order of identifier, allocations reused between remaps
+        std::vector<sf::Vector2f> vPointsSwap;
+        std::vector<std::uint32_t> vHeadSwap, vCountSwap;
+        std::vector<std::uint32_t> vOrder;
+
+        // Line segments of every trail, drawn in one call
+        sf::VertexArray vaTrails{sf::Lines};
+
+        /**
+         * @brief Moves every ring to the new index of its body, dropping rings of bodies that are gone
+         * @note Identifiers may come in any order, bodies removed one at a time trade places with the last body
+        */
+        void remap(const std::uint32_t* id, const std::size_t n);
+
+    public:
+
+        /**
+         * @brief Sets the number of stamps kept per body, clearing every trail
+        */
+        void setLength(const std::size_t length);
+
+        /**
+         * @brief Empties every trail
+        */
+        void clear();
+
+        /**
+         * @brief Sets the distance a body travels before it is stamped again
+         * @param spacing Distance (pixels), zero to stamp every frame
+        */
+        void setSpacing(const math_t spacing);
+
+        /**
+         * @brief Number of stamps kept per body
+        */
+        std::size_t length() const;
+
+        /**
+         * @brief Stamps the current position of every body
+         * @param id Stable identifier of each body, in any order, so rings follow bodies that are added or removed
+        */
+        void append(const std::uint32_t* id, const math_t* x, const math_t* y, const std::size_t n);
+
+        /**
+         * @brief Draws every trail as a single batch of fading line segments
+        */
+        void draw(sf::RenderTarget& target);
+
+        /**
+         * @brief Copies every ring into a checkpoint
+        */
+        void capture(checkpoint_t& out_checkpoint) const;
+
+        /**
+         * @brief Replaces every ring with those of a checkpoint
+         * @return Whether the rings were restored, which needs the same length
+        */
+        bool restore(const std::uint64_t length, const std::uint64_t rings, const std::uint32_t* id, const std::uint32_t* head, 
+            const std::uint32_t* count, const sf::Vector2f* points);
+    };
+
+    // Energy and momentum of a system at the end of a step, see Engine::setDiagnostics
+    typedef struct _diagnostics
+    {
+        bool        valid = false;      // Whether diagnostics were calculated for the step
+        double      kinetic = 0.0;      // Kinetic energy
+        double      potential = 0.0;    // Potential energy of every pair, softened like the force
+        double      virial = 0.0;       // Sum of r_ij . F_ij over every pair, equal to the potential without softening
+        double      px = 0.0, py = 0.0; // Total momentum
+        double      angular = 0.0;      // Total angular momentum about the origin
+        double      drift = 0.0;        // Change of the total energy relative to its reference
+    } diagnostics_t;
+
+    // Published copy of the state of a system, handed from the physics thread to the renderer
+    typedef struct _frame
+    {
+        std::vector<math_t> x, y;       // Position of each body (pixels)
+        std::vector<math_t> vx, vy;     // Velocity of each body (pixels/sec)
+        std::vector<math_t> ax, ay;     // Acceleration of each body (pixels/sec^2)
+        std::vector<math_t> mass;       // Mass of each body
+        std::vector<std::uint32_t> id;  // Stable identifier of each body
+        std::vector<std::uint32_t> name;// Interned name of each body
+        std::uint64_t       step = 0;   // Number of steps taken by the engine
+        math_t              time = 0.0f;// Simulated time (sec)
+        bool                cut = false;// Frame does not follow on from the previous one, breaking every trail
+        std::uint64_t       generation = 0; // Generation of the state copied
+        std::uint64_t       layout = 0; // Layout of the state copied, identifiers and names are only copied when it changes
+        diagnostics_t       diag;       // Energy and momentum of the state copied
+    } frame_t;
+
+    // Lock-free single producer single consumer triple buffer
+    // The producer always has a slot to write, and the consumer always reads the latest complete slot
+    template <class T>
+    class TripleBuffer
+    {
+    private:
+
+        // Slots of the buffer
+        T slots[3];
+
+        // Index of the shared slot in the low bits, with bit 2 set when it holds an unread value
+        std::atomic<std::uint8_t> nShared{1};
+
+        // Slots owned by the producer and consumer
+        std::uint8_t nBack = 0, nFront = 2;
+
+    public:
+
+        /**
+         * @brief Slot the producer writes into
+        */
+        T& back() { return this->slots[this->nBack]; }
+
+        /**
+         * @brief Hands the back slot to the consumer and takes the shared slot in return
+        */
+        void publish() { this->nBack = this->nShared.exchange(this->nBack | 4, std::memory_order_acq_rel) & 3; }
+
+        /**
+         * @brief Takes the latest published slot if there is one
+         * @return Whether a new slot was taken
+        */
+        bool acquire()
+        {
+            if (!(this->nShared.load(std::memory_order_relaxed) & 4))
+                return false;
+            this->nFront = this->nShared.exchange(this->nFront, std::memory_order_acq_rel) & 3;
+            return true;
+        }
+
+        /**
+         * @brief Slot the consumer reads from
+        */
+        const T& front() const { return this->slots[this->nFront]; }
+    };
+
+    // Lock-free single producer single consumer ring of preallocated slots
+    // The producer fills a claimed slot in place and commits it, the consumer reads the oldest slot in place and pops it
+    template <class T>
+    class SpscRing
+    {
+    private:
+
+        // Slots of the ring
+        std::vector<T> vSlots;
+
+        // Number of slots popped by the consumer and committed by the producer
+        std::atomic<std::size_t> nHead{0}, nTail{0};
+
+    public:
+
+        /**
+         * @brief Allocates every slot of the ring
+         * @param capacity Number of slots
+        */
+        explicit SpscRing(const std::size_t capacity) : vSlots(capacity) {}
+
+        /**
+         * @brief Slot the producer writes into next
+         * @return Pointer to the slot, or null when the ring is full
+        */
+        T* claim()
+        {
+            const std::size_t tail = this->nTail.load(std::memory_order_relaxed);
+            if (tail - this->nHead.load(std::memory_order_acquire) == this->vSlots.size())
+                return nullptr;
+            return &this->vSlots[tail % this->vSlots.size()];
+        }
+
+        /**
+         * @brief Hands the claimed slot to the consumer
+        */
+        void commit() { this->nTail.store(this->nTail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        /**
+         * @brief Oldest slot committed by the producer
+         * @return Pointer to the slot, or null when the ring is empty
+        */
+        T* front()
+        {
+            const std::size_t head = this->nHead.load(std::memory_order_relaxed);
+            if (head == this->nTail.load(std::memory_order_acquire))
+                return nullptr;
+            return &this->vSlots[head % this->vSlots.size()];
+        }
+
+        /**
+         * @brief Hands the front slot back to the producer
+        */
+        void pop() { this->nHead.store(this->nHead.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    };
+
+    /**
+     * @brief Maps body mass to graphical and collision radius
+     * @param in_mass Mass of body to map
+    */
+    inline math_t mass2rad(const math_t in_mass)
+    {
+        return 20.0f * std::log((in_mass / 2.0f) + 1.0f);
+    }
+
+    // Pair of bodies that touch
+    typedef std::pair<std::uint32_t, std::uint32_t> contact_t;
+
+    // Broad and narrow phase of collision detection over a uniform grid of cells
+    // Bodies are kept sorted by cell between steps, so re-sorting only moves those that changed cell
+    class CollisionGrid
+    {
+    private:
+
+        // Body and the key of its cell, rows of cells are contiguous in key order
+        typedef struct _cell_entry
+        {
+            std::uint64_t key;
+            std::uint32_t body;
+        } cell_entry_t;
+
+        // Width of a cell, at least the diameter of every body stored in the grid
+        math_t mCell = 0.0f;
+
+        // Every body in order of cell
+        std::vector<cell_entry_t> vEntries;
+
+        // Bodies wider than a cell, tested against every cell they overlap
+        std::vector<std::uint32_t> vLarge;
+
+        // Copy of the radii, for the median
+        std::vector<math_t> vScratch;
+
+        /**
+         * @brief Key of the cell holding a point
+        */
+        std::uint64_t key(const math_t x, const math_t y) const;
+
+        /**
+         * @brief Key of a cell by column and row
+        */
+        static std::uint64_t key(const std::int64_t cx, const std::int64_t cy);
+
+        /**
+         * @brief Tests two bodies and records them if they touch
+        */
+        static void test(const std::uint32_t i, const std::uint32_t j, const math_t* x, const math_t* y, const math_t* radius, 
+            std::vector<contact_t>& out_contacts);
+
+    public:
+
+        /**
+         * @brief Drops removed bodies from the grid and renumbers the rest
+         * @param vRemap New index of every body, or UINT32_MAX for removed bodies
+        */
+        void compact(const std::vector<std::uint32_t>& vRemap);
+
+        /**
+         * @brief Finds every pair of touching bodies
+         * @param x Position X of each body
+         * @param y Position Y of each body
+         * @param radius Radius of each body
+         * @param n Number of bodies, bodies past those already in the grid are added
+         * @param out_contacts Every touching pair (i, j) with i < j, replaced
+        */
+        void detect(const math_t* x, const math_t* y, const math_t* radius, const std::size_t n, std::vector<contact_t>& out_contacts);
+    };
+
+    // Store of render state, parallel to the published frame
+    typedef std::vector<cot::render_t> render_store_t;
+
+    // Read only memory map of a whole file
+    class MappedFile
+    {
+    private:
+
+        // Mapped bytes
+        const std::uint8_t* pData = nullptr;
+        std::size_t nSize = 0;
+
+    public:
+
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        /**
+         * @brief Maps a file, pages are read from disk as they are touched
+         * @param path Path of the file
+         * @param sequential Whether the file will mostly be read front to back
+         * @return Whether the file was mapped, empty files never are
+        */
+        bool open(const std::string& path, const bool sequential);
+
+        /**
+         * @brief Unmaps the file
+        */
+        void close();
+
+        /**
+         * @brief First mapped byte, null when nothing is mapped
+        */
+        const std::uint8_t* data() const { return this->pData; }
+
+        /**
+         * @brief Number of mapped bytes
+        */
+        std::size_t size() const { return this->nSize; }
+    };
+
+    // Bodies read from a catalog, laid out like the physics store
+    typedef struct _catalog
+    {
+        std::vector<std::string> name;  // Name of each body
+        std::vector<math_t> mass;       // Mass of each body
+        std::vector<math_t> x, y;       // Initial position of each body (pixels)
+        std::vector<math_t> vx, vy;     // Initial velocity of each body (pixels/sec)
+
+        std::size_t size() const { return this->mass.size(); }
+    } catalog_t;
+
+    /**
+     * @brief Reads every body in a catalog file, parsing chunks of it in parallel
+     * @param path Path of the catalog, one "name, mass, x, y, vx, vy," line per body
+     * @param nThreads Number of threads including the calling thread
+     * @param out_catalog Bodies of every line read, appended in file order
+     * @return Whether every line was read, lines that were not are logged with their line number and skipped
+    */
+    bool cfgLoadCatalog(std::shared_ptr<spdlog::logger> logger, const std::string& path, const std::size_t nThreads, catalog_t& out_catalog);
+    
+    // Persistent pool of worker threads sharing tasks by work stealing
+    class ThreadPool
+    {
+    private:
+
+        // Number of threads including the calling thread
+        std::size_t nSize;
+
+        // Worker threads, the calling thread acts as thread 0
+        std::vector<std::thread> vThreads;
+
+        // Remaining task range of each thread, head and tail packed into one word
+        std::vector<std::atomic<std::uint64_t>> vQueues;
+
+        // Busy time of each thread (seconds) since timings were last reset
+        std::vector<double> vTimes;
+
+        // Task of the current dispatch
+        void (*pTask)(void*, std::size_t, std::size_t) = nullptr;
+        void* pContext = nullptr;
+
+        // Dispatch signalling
+        std::mutex mtxWake;
+        std::condition_variable cvWake, cvDone;
+        std::uint64_t nGeneration = 0;
+        std::atomic<std::size_t> nActive{0};
+        bool bStop = false;
+
+        /**
+         * @brief Takes the next task for a thread, stealing from other threads once its own are done
+        */
+        bool take(const std::size_t thread, std::size_t& out_task);
+
+        /**
+         * @brief Runs tasks on a thread until none are left
+        */
+        void work(const std::size_t thread);
+
+        /**
+         * @brief Main loop of a worker thread
+        */
+        void worker(const std::size_t thread);
+
+        /**
+         * @brief Runs a task function over a range of task indices and waits for all of them
+        */
+        void dispatch(const std::size_t nTasks, void (*task)(void*, std::size_t, std::size_t), void* context);
+
+    public:
+
+        /**
+         * @brief Starts the worker threads
+         * @param nThreads Number of threads including the calling thread
+        */
+        explicit ThreadPool(const std::size_t nThreads);
+        ~ThreadPool();
+
+        /**
+         * @brief Number of threads including the calling thread
+        */
+        std::size_t size() const;
+
+        /**
+         * @brief Runs fn(task, thread) for every task in [0, nTasks) and waits for all of them
+         * @param nTasks Number of tasks
+         * @param fn Function called with the task index and the index of the thread running it
+        */
+        template <class TFunc>
+        void run(const std::size_t nTasks, TFunc& fn)
+        {
+            this->dispatch(nTasks, [](void* ctx, std::size_t task, std::size_t thread) { (*static_cast<TFunc*>(ctx))(task, thread); }, &fn);
+        }
+
+        /**
+         * @brief Busy time of each thread (seconds) since timings were last reset
+        */
+        const std::vector<double>& timings() const;
+
+        /**
+         * @brief Resets the busy time of each thread
+        */
+        void resetTimings();
+    };
+
+    // Level of detail rendering of bodies too small to draw one by one, as a density texture at screen resolution
+    // Bodies are binned by band of rows in parallel, then every band is splatted and coloured by one task
+    class DensityMap
+    {
+    private:
+
+        // Threads sharing the scatter, apart from the engine threads as drawing may run alongside update
+        std::unique_ptr<ThreadPool> poolScatter = std::make_unique<ThreadPool>(1);
+
+        // Size of the grid (pixels)
+        unsigned nWidth = 0, nHeight = 0;
+
+        // Cell of each body, UINT32_MAX when it is not splatted
+        std::vector<std::uint32_t> vCells;
+
+        // Bodies grouped by band, first of each band, and the count then next write offset of each band in each chunk of bodies
+        std::vector<std::uint32_t> vOrder;
+        std::vector<std::uint32_t> vBands;
+        std::vector<std::uint32_t> vOffsets;
+
+        // Mass in each pixel, densest pixel of each band, and colour of each pixel
+        std::vector<float> vGrid;
+        std::vector<float> vBandMax;
+        std::vector<sf::Uint8> vPixels;
+
+        // Texture the colours are uploaded to, drawn over the whole target
+        sf::Texture texDensity;
+        sf::Sprite sprDensity;
+
+    public:
+
+        /**
+         * @brief Sets the number of threads sharing the scatter
+         * @param nThreads Number of threads including the calling thread
+        */
+        void setThreads(const std::size_t nThreads);
+
+        /**
+         * @brief Splats the mass of every small body inside the view of a target and draws the result over the target
+         * @param render Radius of each body
+         * @param maxRadius Bodies with a radius (world units) of this or more are left to be drawn one by one
+        */
+        void draw(sf::RenderTarget& target, const math_t* x, const math_t* y, const math_t* mass, const render_t* render, 
+            const std::size_t n, const float maxRadius);
+    };
+
+    namespace force
+    {
+        // Gravitational constant multiplied by the square of the mass scaling factor
+        const math_t gravity = static_cast<math_t>(6.6743E-11 * 1e7 * 1e7);
+
+        // Instruction sets available to the force kernels
+        typedef enum _isa
+        {
+            ISA_SCALAR,
+            ISA_SSE,
+            ISA_AVX2
+        } isa_t;
+
+        /**
+         * @brief Detects the best instruction set supported by the running processor
+        */
+        isa_t detect();
+
+        /**
+         * @brief Human readable name of an instruction set
+        */
+        const char* isaName(const isa_t isa);
+
+        // Potential energy and virial of the pairs summed by a force pass
+        typedef struct _potential
+        {
+            double      energy = 0.0;       // Sum of -G m_i m_j / r
+            double      virial = 0.0;       // Sum of r_ij . F_ij
+        } potential_t;
+
+        /**
+         * @brief Accumulates the gravitational acceleration of every pair (i, j) with j < i and rowBegin <= i < rowEnd
+         * @param x Position X of each body
+         * @param y Position Y of each body
+         * @param mass Mass of each body
+         * @param rowBegin First row i to process
+         * @param rowEnd One past the last row i to process
+         * @param soft2 Square of the Plummer softening length, zero for none
+         * @param ax Acceleration X of each body, accumulated into
+         * @param ay Acceleration Y of each body, accumulated into
+         * @param out_potential Potential energy and virial of the same pairs, accumulated into if given
+         * @param isa Instruction set to use, detected once per process if not given
+        */
+        void accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+            const math_t soft2, math_t* ax, math_t* ay, const isa_t isa);
+        void accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+            const math_t soft2, math_t* ax, math_t* ay);
+        void accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+            const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential, const isa_t isa);
+        void accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+            const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential);
+
+        /**
+         * @brief Sums the gravitational acceleration of one body from every other body, for partial updates
+         * @param n Number of bodies
+         * @param i Body to calculate the acceleration of
+         * @param out_ax Acceleration X of body i, overwritten
+         * @param out_ay Acceleration Y of body i, overwritten
+        */
+        void attract(const math_t* x, const math_t* y, const math_t* mass, const std::size_t n, const std::size_t i, 
+            const math_t soft2, math_t& out_ax, math_t& out_ay);
+
+        // Barnes-Hut quadtree, rebuilt every step from a pool of nodes
+        class QuadTree
+        {
+        private:
+
+            // Square cell of the tree
+            typedef struct _node
+            {
+                math_t          cx, cy;     // Centre of mass of the cell
+                math_t          mass;       // Total mass of the cell
+                math_t          x0, y0;     // Lower corner of the cell
+                math_t          size;       // Side length of the cell
+                std::uint32_t   begin;      // First body of the cell in Morton order
+                std::uint32_t   count;      // Number of bodies in the cell
+                std::uint32_t   next;       // Index of the first node after this subtree
+                bool            leaf;       // Whether the cell is summed body by body
+            } node_t;
+
+            // Nodes in pre-order, allocation is reused between builds
+            std::vector<node_t> vNodes;
+
+            // Morton codes and original indices of bodies, sorted by code
+            std::vector<std::uint32_t> vCodes, vOrder;
+            std::vector<std::uint32_t> vCodesTmp, vOrderTmp;
+
+            // Bodies gathered into Morton order
+            std::vector<math_t> vX, vY, vMass;
+
+            /**
+             * @brief Recursively builds the node covering a range of sorted bodies
+             * @return Index of the new node
+            */
+            std::uint32_t buildNode(const std::uint32_t begin, const std::uint32_t end, const std::uint32_t level, 
+                const math_t x0, const math_t y0, const math_t size);
+
+            /**
+             * @brief Walks the tree for the acceleration at a point, and the potential and virial per unit mass there if TPotential
+             * @param out_phi Sum of G m / r over every body or cell away from the point, overwritten if TPotential
+             * @param out_w Sum of G m / r over the same, weighted by (r^2 - soft2) / r^2, overwritten if TPotential
+            */
+            template <bool TPotential>
+            void walk(const math_t px, const math_t py, const math_t theta2, const math_t soft2, math_t& out_ax, math_t& out_ay, 
+                math_t& out_phi, math_t& out_w) const;
+
+        public:
+
+            /**
+             * @brief Rebuilds the tree from the current position of each body
+            */
+            void build(const math_t* x, const math_t* y, const math_t* mass, const std::size_t n);
+
+            /**
+             * @brief Calculates the acceleration of a range of bodies, taken in Morton order
+             * @param begin First body in Morton order
+             * @param end One past the last body in Morton order
+             * @param theta Opening angle, smaller is more accurate
+             * @param soft2 Square of the Plummer softening length
+             * @param ax Acceleration X of each body in original order, overwritten
+             * @param ay Acceleration Y of each body in original order, overwritten
+            */
+            void accelerate(const std::size_t begin, const std::size_t end, const math_t theta, const math_t soft2, 
+                math_t* ax, math_t* ay) const;
+
+            /**
+             * @brief Calculates the acceleration of a range of bodies, and half of their potential energy and virial
+             * @param out_potential Potential energy and virial, accumulated into, each pair is counted half from either end
+            */
+            void accelerate(const std::size_t begin, const std::size_t end, const math_t theta, const math_t soft2, 
+                math_t* ax, math_t* ay, potential_t& out_potential) const;
+
+            /**
+             * @brief Calculates the acceleration of a list of bodies, for partial updates
+             * @param targets Original index of each body to calculate
+             * @param count Number of targets
+             * @param x Position X of each body in original order, as the tree was built from
+             * @param y Position Y of each body in original order, as the tree was built from
+             * @param ax Acceleration X of each body in original order, overwritten for targets only
+             * @param ay Acceleration Y of each body in original order, overwritten for targets only
+            */
+            void accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, 
+                const math_t theta, const math_t soft2, math_t* ax, math_t* ay) const;
+
+            /**
+             * @brief Calculates the acceleration of a list of bodies, and half of their potential energy and virial
+             * @param mass Mass of each body in original order
+             * @param out_potential Potential energy and virial, accumulated into, each pair is counted half from either end
+            */
+            void accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, const math_t* mass, 
+                const math_t theta, const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential) const;
+        };
+    }
+
+    // Methods of calculating the gravitational interaction of the system
+    typedef enum _solver
+    {
+        SOLVER_DIRECT,          // Direct summation of every pair, exact reference
+        SOLVER_BARNES_HUT       // Barnes-Hut quadtree approximation
+    } solver_t;
+
+    // Error of the selected solver relative to direct summation
+    typedef struct _solver_error
+    {
+        math_t              rms;        // Root mean square of the relative acceleration error
+        math_t              max;        // Largest relative acceleration error of any body
+    } solver_error_t;
+
+    // Methods of integrating the motion of the system
+    typedef enum _integrator
+    {
+        INTEGRATOR_EULER,       // Explicit Euler, first order
+        INTEGRATOR_LEAPFROG,    // Kick-drift-kick leapfrog (velocity Verlet), second order symplectic
+        INTEGRATOR_YOSHIDA4,    // Yoshida composition of leapfrog, fourth order symplectic
+        INTEGRATOR_RK4,         // Classic Runge-Kutta, fourth order
+        INTEGRATOR_RKF45,       // Runge-Kutta-Fehlberg with adaptive substeps, fourth order with fifth order error estimate
+        INTEGRATOR_BLOCK        // Leapfrog with hierarchical power of two timesteps per body
+    } integrator_t;
+
+    // Integrator policies
+    // Each advances a system by dt through step<TSystem>, where TSystem is Engine or FixedEngine<N> and provides
+    //  size(), physics(), scratch(k), accelerate(x, y, ax, ay), forEachBody(fn) and the integrator state members
+    // Block also needs accelerate(targets, count, x, y, ax, ay) and the block timestep state members
+    namespace integrator
+    {
+        // Number of block timestep levels below the step passed to update, level k steps 2^-k of it
+        const std::uint32_t blockLevels = 16;
+
+        struct Euler
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        struct Leapfrog
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        struct Yoshida4
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        struct RK4
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        struct RKF45
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        struct Block
+        {
+            template <class TSystem> static void step(TSystem& sys, const math_t dt);
+        };
+
+        /**
+         * @brief Human readable name of an integrator
+        */
+        const char* name(const integrator_t integrator);
+
+        /**
+         * @brief Parses the name of an integrator
+         * @return Whether the name is known
+        */
+        bool parse(const std::string& in_name, integrator_t& out_integrator);
+    }
+
+    class Predictor;
+
+    // Physics engine
+    class Engine
+    {
+    private:
+
+        // Physical state of all bodies in the system
+        physics_t sysPhysics;
+
+        // Interned name of all bodies in the system, parallel to the physics store
+        std::vector<std::uint32_t> vNames;
+
+        // Every distinct name, indexed by interned name
+        std::vector<std::string> vNameTable;
+        std::unordered_map<std::string, std::uint32_t> mapNames;
+
+        // Generation of the state and of the set of bodies, see snapshot_t
+        std::uint64_t nGeneration = 1;
+        std::uint64_t nLayout = 1;
+
+        /**
+         * @brief Interned name of a string, added to the table if it is new
+        */
+        std::uint32_t intern(const std::string& in_name);
+
+        // Stable identifiers of all bodies in the system, parallel to the physics store
+        std::vector<std::uint32_t> vIds;
+        std::uint32_t nNextId = 0;
+
+        // Collision radius of all bodies in the system, parallel to the physics store
+        std::vector<math_t> vRadius;
+
+        // Registry slot of all bodies in the system, parallel to the physics store
+        std::vector<std::uint32_t> vSlots;
+
+        // Registry of handles to bodies, and the first free slot of its free list
+        std::vector<registry_slot_t> vRegistry;
+        std::uint32_t nFreeSlot = UINT32_MAX;
+
+        /**
+         * @brief Gives the body at an index of the physics store a slot of the registry, reusing a free one if there is any
+        */
+        body_handle_t acquireSlot(const std::uint32_t index);
+
+        /**
+         * @brief Returns a slot to the free list, so that handles to its body no longer match
+        */
+        void releaseSlot(const std::uint32_t slot);
+
+        /**
+         * @brief Releases every slot in use and gives every body a new one, after the store was replaced
+        */
+        void resetRegistry();
+
+        /**
+         * @brief Forgets the state derived from the set of bodies, after bodies were added, removed or edited
+        */
+        void invalidateBodies();
+
+        // Whether touching bodies merge, and how many merges happened
+        bool bCollisions = false;
+        std::uint64_t nMerges = 0;
+
+        // Collision state, reused between steps
+        CollisionGrid gridCollide;
+        std::vector<contact_t> vContacts;
+        std::vector<std::uint32_t> vParent, vRemap;
+        std::vector<std::uint8_t> vMerged;
+
+        /**
+         * @brief Merges every cluster of touching bodies into its heaviest body, conserving mass and momentum
+        */
+        void collide();
+
+        /**
+         * @brief Removes bodies whose new index is UINT32_MAX, keeping the order of the rest and releasing their slots
+        */
+        void compact(const std::vector<std::uint32_t>& vNewIndex);
+
+        // Square of the Plummer softening length
+        math_t mSoft2 = 0.0f;
+
+        // Simulated time (sec) and number of steps taken
+        math_t mTime = 0.0f;
+        std::uint64_t nSteps = 0;
+
+        // Selected integrator, as the step of its policy instantiated for this engine
+        integrator_t eIntegrator = INTEGRATOR_EULER;
+        void (*pIntegrate)(Engine&, const math_t) = &integrator::Euler::step<Engine>;
+
+        // Integrator state, acceleration in the physics store is valid for the current positions
+        bool bAccelValid = false;
+
+        // Integrator state, substep (sec) and position tolerance (pixels) of adaptive integrators
+        math_t mAdaptiveDt = 0.0f;
+        math_t mTolerance = 1e-3f;
+
+        // Scratch arrays of integrator stages
+        std::vector<std::vector<math_t>> vScratch;
+
+        // Block timestep state, level of each body valid with the acceleration, number of bodies per level, and bodies due
+        std::vector<std::uint8_t> vLevel;
+        std::vector<std::size_t> vLevelCounts;
+        std::vector<std::uint32_t> vActive;
+
+        // Number of times the acceleration of the system was calculated
+        std::uint64_t nEvaluations = 0;
+
+        // Diagnostics state, whether they are calculated, and the potential and virial of the last evaluation at the current positions
+        // Fresh when that evaluation happened during the current update, so with the acceleration valid it is at the final positions
+        bool bDiagnostics = false;
+        force::potential_t potLast;
+        bool bPotentialFresh = false;
+
+        // Diagnostics of the last update, the energy drift is measured against, and the drift after every update since
+        diagnostics_t diagLast;
+        double mEnergyRef = 0.0;
+        bool bEnergyRef = false;
+        std::vector<double> vDrift;
+
+        /**
+         * @brief Completes the diagnostics of an update with the sums over bodies, only evaluating the force if no evaluation gave the potential
+        */
+        void diagnose();
+
+        friend struct integrator::Euler;
+        friend struct integrator::Leapfrog;
+        friend struct integrator::Yoshida4;
+        friend struct integrator::RK4;
+        friend struct integrator::RKF45;
+        friend struct integrator::Block;
+
+        /**
+         * @brief Number of bodies, for integrator policies
+        */
+        std::size_t size() const { return this->sysPhysics.size(); }
+
+        /**
+         * @brief Physics store, for integrator policies
+        */
+        physics_t& physics() { return this->sysPhysics; }
+
+        /**
+         * @brief Scratch array k sized to the number of bodies, for integrator policies
+        */
+        math_t* scratch(const std::size_t k);
+
+        /**
+         * @brief Calculates the acceleration at the given positions with the selected solver, for integrator policies
+        */
+        void accelerate(const math_t* x, const math_t* y, math_t* ax, math_t* ay);
+
+        /**
+         * @brief Calculates the acceleration of a list of bodies from every body with the selected solver, for integrator policies
+         * @param ax Acceleration X of each body, overwritten at least for targets
+         * @param ay Acceleration Y of each body, overwritten at least for targets
+        */
+        void accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, math_t* ax, math_t* ay);
+
+        /**
+         * @brief Runs fn(begin, end) over ranges of bodies shared across the engine threads, for integrator policies
+        */
+        template <class TFunc>
+        void forEachBody(TFunc fn)
+        {
+            const std::size_t n = this->sysPhysics.size();
+            const std::size_t nPerTask = 4096;
+            auto fnTask = [&](const std::size_t task, const std::size_t)
+            {
+                fn(task * nPerTask, std::min(n, (task + 1) * nPerTask));
+            };
+            this->poolWork->run((n + nPerTask - 1) / nPerTask, fnTask);
+        }
+
+        // Frames published by update for draw, which may run on another thread
+        TripleBuffer<frame_t> bufFrames;
+
+        /**
+         * @brief Copies the current state into the back frame and publishes it
+        */
+        void publishFrame();
+
+        // Selected solver and Barnes-Hut opening angle
+        solver_t eSolver = SOLVER_DIRECT;
+        math_t mTheta = 0.5f;
+
+        // Barnes-Hut tree reused between updates
+        force::QuadTree treeForce;
+
+        // Threads sharing the force and integration passes
+        std::unique_ptr<ThreadPool> poolWork = std::make_unique<ThreadPool>(1);
+
+        // Row boundaries and private acceleration buffers of the direct summation blocks
+        std::vector<std::size_t> vBlockRows, vBlockOffsets;
+        std::vector<math_t> vBlockAx, vBlockAy;
+
+        // Potential of each block or task of a force pass, reduced in task order
+        std::vector<force::potential_t> vTaskPotential;
+
+        /**
+         * @brief Calculates the acceleration of every body at the given positions with a solver
+         * @param out_potential Potential energy and virial at the same positions, overwritten if given
+        */
+        void accelerate(const solver_t solver, const math_t* x, const math_t* y, math_t* ax, math_t* ay, force::potential_t* out_potential);
+
+        /**
+         * @brief Advances a system of N bodies by dt on a FixedEngine of its size, moving the state there and back
+        */
+        template <std::size_t N>
+        void stepFixed(const math_t dt);
+
+        /**
+         * @brief Advances the system by dt on a FixedEngine if its size and the selected methods allow
+         * @return Whether the system was advanced
+        */
+        bool integrateFixed(const math_t dt);
+
+        // Render state of all bodies in the system, only used when drawing
+        render_store_t sysRender;
+
+        // Triangles of every visible planet and force arrow, allocations reused between frames
+        sf::VertexArray vaPlanets{sf::Triangles};
+        sf::VertexArray vaArrows{sf::Triangles};
+
+        // Persistence history of all bodies, only used when drawing
+        Trails trlHistory;
+        std::uint64_t nLastStamp = 0;
+
+        // Density rendering of small bodies when zoomed out below mLodZoom pixels per unit, zero to draw every body
+        DensityMap mapDensity;
+        float mLodZoom = 1.0f;
+
+        // Predicted paths of selected bodies, drawn next to the persistence history, null for none
+        Predictor* pPredictor = nullptr;
+
+    public:
+
+        /**
+         * @brief Adds a body to the physics engine
+         * @param in_mass Mass of the body
+         * @param init_pos Initial position (pixels) of the body
+         * @param init_vel Initial velocity (pixels/sec) of the body
+         * @return Handle to the body
+        */
+        body_handle_t addBody(std::string in_name, math_t in_mass, vector_t init_pos, vector_t init_vel);
+
+        /**
+         * @brief Adds every body of a catalog to the physics engine
+         * @param in_catalog Bodies to add, in the order they are added
+         * @param out_handles Handle to each body in catalog order, overwritten if given
+        */
+        void addBodies(const catalog_t& in_catalog, std::vector<body_handle_t>* out_handles = nullptr);
+
+        /**
+         * @brief Removes a body in constant time, moving the last body of the store into its place
+         * @return Whether the handle matched a body
+        */
+        bool removeBody(const body_handle_t handle);
+
+        /**
+         * @brief Removes many bodies in one pass over the store, keeping the order of the rest
+         * @param handles Handles to the bodies, those that no longer match a body are skipped
+         * @return Number of bodies removed
+        */
+        std::size_t removeBodies(const std::vector<body_handle_t>& handles);
+
+        /**
+         * @brief Replaces the mass, position and velocity of a body, which keeps its identifier, name and handle
+         * @return Whether the handle matched a body
+        */
+        bool setBody(const body_handle_t handle, math_t in_mass, vector_t in_pos, vector_t in_vel);
+
+        /**
+         * @brief Whether a handle still matches a body
+        */
+        bool contains(const body_handle_t handle) const;
+
+        /**
+         * @brief Index of a body in the physics store and in snapshot(), which changes as bodies are added and removed
+         * @return The index, or SIZE_MAX if the handle no longer matches a body
+        */
+        std::size_t indexOf(const body_handle_t handle) const;
+
+        /**
+         * @brief Handle to the body at an index of the physics store and of snapshot()
+        */
+        body_handle_t handleOf(const std::size_t index) const;
+
+        /**
+         * @brief Sets the Plummer softening length used in gravitational interactions
+         * @param eps Softening length (pixels), zero disables softening
+        */
+        void setSoftening(const math_t eps);
+
+        /**
+         * @brief Sets the number of threads used to update the system
+         * @param nThreads Number of threads including the calling thread
+        */
+        void setThreads(const std::size_t nThreads);
+
+        /**
+         * @brief Busy time of each thread (seconds) during the last update
+        */
+        const std::vector<double>& threadTimes() const;
+
+        /**
+         * @brief Selects the method of calculating gravitational interactions
+         * @param solver Solver to use
+         * @param theta Barnes-Hut opening angle, ignored by direct summation
+        */
+        void setSolver(const solver_t solver, const math_t theta = 0.5f);
+
+        /**
+         * @brief Sets the persistence history drawn behind every body
+         * @param length Number of stamps kept per body
+         * @param spacing Distance (pixels) travelled between stamps, zero to stamp every frame
+        */
+        void setTrail(const std::size_t length, const math_t spacing);
+
+        /**
+         * @brief Sets the zoom below which bodies too small to see are drawn as a density texture
+         * @param zoom Screen pixels per world unit, zero to always draw every body
+        */
+        void setLod(const float zoom);
+
+        /**
+         * @brief Sets the predictor fed every frame drawn, whose paths are drawn next to the persistence history
+         * @param pred Predictor to feed, null for none
+        */
+        void setPredictor(Predictor* pred);
+
+        /**
+         * @brief Enables merging of touching bodies after every update
+         * @param enable Whether touching bodies merge
+        */
+        void setCollisions(const bool enable);
+
+        /**
+         * @brief Number of merges of touching bodies
+        */
+        std::uint64_t merges() const;
+
+        /**
+         * @brief Selects the method of integrating the motion of the system
+         * @param integ Integrator to use
+        */
+        void setIntegrator(const integrator_t integ);
+
+        /**
+         * @brief Sets the local position error allowed per substep by adaptive integrators
+         * @param tol Tolerance (pixels)
+        */
+        void setTolerance(const math_t tol);
+
+        /**
+         * @brief Number of times the acceleration of the system was calculated
+        */
+        std::uint64_t evaluations() const;
+
+        /**
+         * @brief Number of bodies on each block timestep level after the last update
+         * @return Counts from level 0, the full step, empty unless the block integrator is selected
+        */
+        const std::vector<std::size_t>& levels() const;
+
+        /**
+         * @brief Enables energy and momentum diagnostics after every update
+         * @param enable Whether diagnostics are calculated, the potential is summed by the force passes of the update
+         * @note Drift is measured against the energy after the first update since enabling or changing the bodies
+        */
+        void setDiagnostics(const bool enable);
+
+        /**
+         * @brief Energy and momentum after the last update, for readers on the thread calling update
+        */
+        const diagnostics_t& diagnostics() const;
+
+        /**
+         * @brief Relative energy drift after every update since the reference energy was taken
+        */
+        const std::vector<double>& driftSeries() const;
+
+        /**
+         * @brief Energy and momentum of the frame last drawn, for readers on the thread calling draw
+        */
+        const diagnostics_t& presented() const;
+
+        /**
+         * @brief Compares the selected solver against direct summation at the current state
+         * @return Relative acceleration error of the selected solver
+        */
+        solver_error_t solverError();
+
+        /**
+         * @brief Allows the physics engine to update force, velocity, and position of each body in the system
+         * @param dt Time since the update function was last called
+        */
+        void update(const math_t dt);
+
+        /**
+         * @brief Simulated time (sec)
+        */
+        math_t time() const;
+
+        /**
+         * @brief Number of steps taken
+        */
+        std::uint64_t steps() const;
+
+        /**
+         * @brief View of the current state of every body, for readers on the thread calling update
+         * @note Stays valid until the next update or change to the bodies, any number of readers may share it
+        */
+        snapshot_t snapshot() const;
+
+        /**
+         * @brief View of the frame last drawn, for readers on the thread calling draw
+         * @note Stays valid until the next draw, any number of readers may share it
+        */
+        snapshot_t latest() const;
+
+        /**
+         * @brief String of an interned name
+         * @return The name, or an empty string if it is not interned
+        */
+        const std::string& nameOf(const std::uint32_t name) const;
+
+        /**
+         * @brief Copies the state of every body, the clock and the integrator state into a checkpoint
+         * @note Must not overlap update, the copy is quick so a caller on another thread may hold update off meanwhile
+        */
+        void capture(checkpoint_t& out_checkpoint) const;
+
+        /**
+         * @brief Copies the persistence history into a checkpoint, after capture
+         * @note Must run on the thread calling draw
+        */
+        void captureTrails(checkpoint_t& out_checkpoint) const;
+
+        /**
+         * @brief Replaces every body and the clock with those of a checkpoint file
+         * @param path Path of the file, which is mapped and copied from
+         * @return Whether the file was a valid checkpoint, the engine is unchanged otherwise
+         * @note Integrator state is only restored for the integrator selected, and trails only for the same trail length
+        */
+        bool restore(const std::string& path);
+
+        /**
+         * @brief Publishes a frame for draw in place of the state of the engine, to replay a recording
+         * @param in_frame Frame to draw, accelerations may be zero
+        */
+        void present(const frame_t& in_frame);
+
+        /**
+         * @brief Draws all bodies in the system in their last published position
+         * @param wind Reference to drawing target, bodies outside its current view are skipped
+         * @note May run on a different thread to update, as long as bodies are not added meanwhile
+        */
+        void draw(sf::RenderTarget& wind);
+    };
+
+    // Watches a catalog file and applies the rows that changed since it was last read to a running engine
+    // Rows are matched by name, and by order among rows of the same name
+    class CatalogReload
+    {
+    private:
+
+        // Path of the catalog, and its modification time (nanoseconds) and size when last read and when last polled
+        std::string sPath;
+        std::int64_t nReadModified = 0, nReadSize = -1;
+        std::int64_t nPollModified = 0, nPollSize = -1;
+
+        // Rows last applied, and the handle to the body each row became
+        catalog_t catApplied;
+        std::vector<body_handle_t> vHandles;
+
+        // Rows read by prepare and not applied yet, with the row last applied that each matches, SIZE_MAX for new rows
+        catalog_t catPending;
+        std::vector<std::size_t> vMatch;
+        bool bPending = false;
+
+    public:
+
+        /**
+         * @brief Starts watching the catalog an engine was just given
+         * @param in_catalog Rows of the catalog as added
+         * @param in_handles Handle to the body of each row
+        */
+        void watch(const std::string& path, const catalog_t& in_catalog, const std::vector<body_handle_t>& in_handles);
+
+        /**
+         * @brief Checks the modification time and size of the file
+         * @return Whether the file changed since it was last read, and stayed the same since the previous poll so it is not half written
+        */
+        bool poll();
+
+        /**
+         * @brief Reads the file again and matches its rows against those last applied, without touching the engine
+         * @return Whether every line was read, a file with unreadable lines is not applied
+        */
+        bool prepare(std::shared_ptr<spdlog::logger> logger, const std::size_t nThreads);
+
+        /**
+         * @brief Applies the rows read by prepare, adding, editing and removing only the bodies whose rows changed
+         * @note Must not overlap update, bodies of rows that did not change keep their state
+        */
+        void apply(Engine& eng, std::shared_ptr<spdlog::logger> logger);
+    };
+
+    // Predicts the path of selected bodies on a worker thread, from clones of the frames drawn
+    // The clone keeps the selected bodies and only the heaviest of the rest, integrated by leapfrog at a coarse step
+    // The first pass publishes its path as it grows, later passes halve the step and replace it once complete
+    // The renderer and the worker only meet through triple buffers and atomics, so neither ever waits on the other
+    class Predictor
+    {
+    private:
+
+        // State of a frame handed to the worker
+        typedef struct _request
+        {
+            std::uint64_t serial = 0;           // Request number, the worker drops a request once a newer one is made
+            std::uint64_t selection = 0;        // Selection version the request was made for
+            std::uint64_t layout = 0;           // Layout of the frame cloned
+            math_t time = 0.0f;                 // Simulated time of the frame cloned (sec)
+            std::vector<math_t> x, y, vx, vy, mass;
+            std::vector<std::uint32_t> id;
+            std::vector<std::uint32_t> index;   // Index of each selected body in the frame
+        } request_t;
+
+        // Paths handed back to the renderer
+        typedef struct _prediction
+        {
+            std::uint64_t serial = 0;           // Request the paths answer
+            std::uint64_t selection = 0;        // Selection version of that request
+            std::uint64_t layout = 0;           // Layout of the frame cloned
+            math_t time = 0.0f;                 // Simulated time of the first point (sec)
+            math_t spacing = 0.0f;              // Simulated time between points (sec)
+            std::size_t points = 0;             // Number of points of each path predicted so far
+            std::uint32_t refinement = 0;       // Number of times the step was halved
+            std::vector<std::uint32_t> id;      // Identifier of each selected body
+            std::vector<std::uint32_t> index;   // Index of each selected body in the frame cloned
+            std::vector<sf::Vector2f> path;     // Points of every path laid end to end, the same number each
+        } prediction_t;
+
+        // Requests from the renderer and paths from the worker
+        TripleBuffer<request_t> bufRequests;
+        TripleBuffer<prediction_t> bufPredictions;
+
+        // Latest request made, the worker abandons any other
+        std::atomic<std::uint64_t> nRequested{0};
+
+        // Worker thread and its settings
+        std::thread thrWorker;
+        std::atomic<bool> bStop{false};
+        math_t mHorizon = 0.0f;
+        math_t mSoftening = 0.0f;
+
+        // Worker state, clone of the request being predicted, the bodies it was picked from and its paths
+        // Allocations are reused between requests
+        catalog_t catClone;
+        std::vector<std::uint32_t> vOthers;
+        std::vector<sf::Vector2f> vPath;
+
+        // Renderer state, selected identifiers and the request last made for them
+        std::vector<std::uint32_t> vSelected;
+        std::uint64_t nSelection = 1;
+        std::uint64_t nSerial = 0;
+        std::uint64_t nRequestSelection = 0;
+        std::uint64_t nRequestLayout = 0;
+        math_t mRequestTime = 0.0f;
+
+        // Line segments of every path, drawn in one call
+        sf::VertexArray vaPaths{sf::Lines};
+
+        /**
+         * @brief Main loop of the worker thread
+        */
+        void worker();
+
+        /**
+         * @brief Predicts the paths of a request pass by pass, returning early once a newer request is made
+        */
+        void predict(const request_t& req);
+
+        /**
+         * @brief Hands the paths predicted so far to the renderer
+        */
+        void publish(const request_t& req, const math_t spacing, const std::size_t points, const std::uint32_t refinement);
+
+        /**
+         * @brief Clones a frame for the worker if the selection or the layout changed, or the last clone is too old
+        */
+        void track(const snapshot_t& snap);
+
+    public:
+
+        ~Predictor();
+
+        /**
+         * @brief Starts the worker thread
+         * @param horizon Simulated time predicted ahead (sec)
+         * @param eps Plummer softening length (pixels) of the engine predicted
+        */
+        void start(const math_t horizon, const math_t eps);
+
+        /**
+         * @brief Stops the worker thread, abandoning any prediction
+        */
+        void stop();
+
+        /**
+         * @brief Whether the worker thread is running
+        */
+        bool running() const;
+
+        /**
+         * @brief Adds a body to the selection, or removes it if it is already selected
+         * @param id Stable identifier of the body
+        */
+        void select(const std::uint32_t id);
+
+        /**
+         * @brief Empties the selection
+        */
+        void clearSelection();
+
+        /**
+         * @brief Clones the frame for the worker when needed, then draws the latest paths from the current position of each body on
+         * @param snap Frame being drawn
+         * @note Never waits for the worker, paths of an older clone are drawn until those of the newer one come in
+        */
+        void draw(sf::RenderTarget& target, const snapshot_t& snap);
+    };
+
+    // Largest system Engine::update hands to a FixedEngine of its size
+    const std::size_t fixedMax = 16;
+
+    // Number of integrator scratch arrays of a FixedEngine, as many as RKF45 uses
+    const std::size_t fixedScratch = 28;
+
+    // Physics engine specialised for a system of N bodies by direct summation
+    // State lives in fixed size arrays and the pair loop is unrolled at compile time, instantiated for 2 to fixedMax bodies
+    template <std::size_t N>
+    class FixedEngine
+    {
+    private:
+
+        static_assert((N >= 2) && (N <= fixedMax), "FixedEngine is instantiated for 2 to fixedMax bodies");
+
+        // Number of distinct pairs, each interacting once, and padded to whole vectors of 4 with pairs that do not interact
+        static constexpr std::size_t nPairs = N * (N - 1) / 2;
+        static constexpr std::size_t nPairsPadded = (nPairs + 3) / 4 * 4;
+
+        /**
+         * @brief Row i of pair k, pairs run (1, 0), (2, 0), (2, 1), (3, 0)...
+        */
+        static constexpr std::size_t pairRow(const std::size_t k)
+        {
+            std::size_t i = 1;
+            while ((i + 1) * i / 2 <= k)
+                i++;
+            return i;
+        }
+
+        /**
+         * @brief Column j < i of pair k
+        */
+        static constexpr std::size_t pairColumn(const std::size_t k)
+        {
+            return k - pairRow(k) * (pairRow(k) - 1) / 2;
+        }
+
+        // Row and column of pair K as constants, so the unrolled loop indexes bodies directly
+        template <std::size_t K> static constexpr std::size_t row = pairRow(K);
+        template <std::size_t K> static constexpr std::size_t column = pairColumn(K);
+
+        // Physical state of all bodies in the system
+        fixed_physics_t<N> sysPhysics;
+
+        // Gravitational constant times the mass of each body, taken once per step rather than once per pair
+        std::array<math_t, N> vGravityMass;
+
+        // Stable identifier of each body, which is also its name, as the row of the catalog given to addBodies
+        std::array<std::uint32_t, N> vIds;
+
+        // Square of the Plummer softening length
+        math_t mSoft2 = 0.0f;
+
+        // Simulated time (sec) and number of steps taken
+        math_t mTime = 0.0f;
+        std::uint64_t nSteps = 0;
+
+        // Selected integrator, as the step of its policy instantiated for this engine
+        integrator_t eIntegrator = INTEGRATOR_EULER;
+        void (*pIntegrate)(FixedEngine&, const math_t) = &integrator::Euler::step<FixedEngine>;
+
+        // Integrator state, see Engine
+        bool bAccelValid = false;
+        math_t mAdaptiveDt = 0.0f;
+        math_t mTolerance = 1e-3f;
+
+        // Scratch arrays of integrator stages
+        std::array<std::array<math_t, N>, fixedScratch> vScratch;
+
+        // Block timestep state, see Engine
+        std::vector<std::uint8_t> vLevel;
+        std::vector<std::size_t> vLevelCounts;
+        std::vector<std::uint32_t> vActive;
+
+        // Number of times the acceleration of the system was calculated
+        std::uint64_t nEvaluations = 0;
+
+        // Diagnostics state, see Engine
+        bool bDiagnostics = false;
+        force::potential_t potLast;
+        bool bPotentialFresh = false;
+
+        friend class Engine;
+        friend struct integrator::Euler;
+        friend struct integrator::Leapfrog;
+        friend struct integrator::Yoshida4;
+        friend struct integrator::RK4;
+        friend struct integrator::RKF45;
+        friend struct integrator::Block;
+
+        /**
+         * @brief Number of bodies, for integrator policies
+        */
+        static constexpr std::size_t size() { return N; }
+
+        /**
+         * @brief Physics store, for integrator policies
+        */
+        fixed_physics_t<N>& physics() { return this->sysPhysics; }
+
+        /**
+         * @brief Scratch array k, for integrator policies
+        */
+        math_t* scratch(const std::size_t k) { return this->vScratch[k].data(); }
+
+        /**
+         * @brief Sums the interaction of every pair, unrolled, and their potential energy and virial if TPotential
+        */
+        template <bool TPotential, std::size_t... K>
+        void interactAll(const math_t* x, const math_t* y, math_t* ax, math_t* ay, force::potential_t& out_potential, 
+            std::index_sequence<K...>) const;
+
+        /**
+         * @brief Calculates the acceleration at the given positions, for integrator policies
+        */
+        void accelerate(const math_t* x, const math_t* y, math_t* ax, math_t* ay);
+
+        /**
+         * @brief Calculates the acceleration of every body, for the block integrator whose targets are always few
+        */
+        void accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, math_t* ax, math_t* ay);
+
+        /**
+         * @brief Runs fn(begin, end) over every body on the calling thread, for integrator policies
+        */
+        template <class TFunc>
+        void forEachBody(TFunc fn) { fn(0, N); }
+
+        /**
+         * @brief Takes the gravitational constant times the mass of each body
+        */
+        void prepare();
+
+    public:
+
+        /**
+         * @brief Sets every body of the system from a catalog
+         * @param in_catalog Bodies to add, the first N are taken
+         * @return Whether the catalog held at least N bodies, the engine is unchanged otherwise
+        */
+        bool addBodies(const catalog_t& in_catalog);
+
+        /**
+         * @brief Sets the Plummer softening length used in gravitational interactions
+         * @param eps Softening length (pixels), zero disables softening
+        */
+        void setSoftening(const math_t eps);
+
+        /**
+         * @brief Selects the method of integrating the motion of the system
+         * @param integ Integrator to use
+        */
+        void setIntegrator(const integrator_t integ);
+
+        /**
+         * @brief Sets the local position error allowed per substep by adaptive integrators
+         * @param tol Tolerance (pixels)
+        */
+        void setTolerance(const math_t tol);
+
+        /**
+         * @brief Number of times the acceleration of the system was calculated
+        */
+        std::uint64_t evaluations() const;
+
+        /**
+         * @brief Advances the system by dt
+         * @param dt Time since the update function was last called
+        */
+        void update(const math_t dt);
+
+        /**
+         * @brief Simulated time (sec)
+        */
+        math_t time() const;
+
+        /**
+         * @brief Number of steps taken
+        */
+        std::uint64_t steps() const;
+
+        /**
+         * @brief View of the current state of every body
+         * @note Stays valid until the next update or change to the bodies, names are the rows of the catalog
+        */
+        snapshot_t snapshot() const;
+    };
+    
+    namespace telemetry
     {
-        math_t              mass;       // Mass of body (used to determine radius)
-        sf::Vector2f        position;   // Position of body (pixels)
-        sf::Vector2f        velocity;   // Velocity of body (pixels/sec)
-        std::string         name;       // Name of body
-    } state_t;
+        // Leading words of a telemetry file and of each frame in it, "COTD" and "FRME" in little endian
+        const std::uint32_t fileMagic = 0x44544F43;
+        const std::uint32_t frameMagic = 0x454D5246;
+
+        // Leading word of the keyframe index closing a telemetry file, "INDX" in little endian
+        const std::uint32_t indexMagic = 0x58444E49;
+
+        // Version of the telemetry format, bumped whenever a header or column changes
+        // Version 2 closes the file with a keyframe index, version 3 adds diagnostics to the frame header
+        const std::uint32_t version = 3;
+
+        // Least number of bytes between keyframes
+        const std::uint64_t keyframeBytes = 1 << 16;
+
+        // Header at the start of a telemetry file
+        typedef struct _file_header
+        {
+            std::uint32_t magic;        // fileMagic
+            std::uint32_t version;      // Format version
+            std::uint32_t valueSize;    // Bytes per value column entry, 4 for float and 8 for double
+            std::uint32_t columns;      // Number of value columns following the identifier column
+        } file_header_t;
+
+        // Header of a frame, followed by the columns id[count], x, y, vx, vy, mass[count]
+        // Diagnostics are NaN when they were not calculated, and absent before version 3
+        typedef struct _frame_header
+        {
+            std::uint32_t magic;        // frameMagic
+            std::uint32_t count;        // Number of bodies in the frame
+            std::uint64_t step;         // Number of steps taken by the engine
+            double        time;         // Simulated time (sec)
+            double        kinetic;      // Kinetic energy
+            double        potential;    // Potential energy
+            double        virial;       // Sum of r_ij . F_ij over every pair
+            double        px, py;       // Total momentum
+            double        angular;      // Total angular momentum about the origin
+            double        drift;        // Relative energy drift
+        } frame_header_t;
+
+        /**
+         * @brief Size (bytes) of a frame header in a version of the format
+        */
+        inline std::uint64_t frameHeaderSize(const std::uint32_t version)
+        {
+            return (version >= 3 ? sizeof(frame_header_t) : offsetof(frame_header_t, kinetic));
+        }
+
+        /**
+         * @brief Copies diagnostics into a frame header, NaN if they were not calculated
+        */
+        inline void setDiagnostics(frame_header_t& header, const diagnostics_t& diag)
+        {
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            header.kinetic = (diag.valid ? diag.kinetic : nan);
+            header.potential = (diag.valid ? diag.potential : nan);
+            header.virial = (diag.valid ? diag.virial : nan);
+            header.px = (diag.valid ? diag.px : nan);
+            header.py = (diag.valid ? diag.py : nan);
+            header.angular = (diag.valid ? diag.angular : nan);
+            header.drift = (diag.valid ? diag.drift : nan);
+        }
+
+        // Value columns of a frame, in file order
+        enum column_t { COLUMN_X, COLUMN_Y, COLUMN_VX, COLUMN_VY, COLUMN_MASS, COLUMN_COUNT };
+
+        // Frame that seeking may start from, the index is in file order
+        typedef struct _keyframe
+        {
+            double        time;         // Simulated time (sec) of the frame
+            std::uint64_t offset;       // Offset (bytes) of the frame header from the start of the file
+        } keyframe_t;
+
+        // Last bytes of a file closed with a keyframe index, which ends just before it
+        typedef struct _index_trailer
+        {
+            std::uint32_t magic;        // indexMagic
+            std::uint32_t reserved;
+            std::uint64_t count;        // Number of keyframes
+        } index_trailer_t;
+
+        /**
+         * @brief Size (bytes) of a frame holding a number of bodies in a version of the format
+        */
+        inline std::uint64_t frameSize(const std::uint64_t count, const std::uint32_t valueSize, const std::uint32_t version)
+        {
+            return frameHeaderSize(version) + count * (sizeof(std::uint32_t) + COLUMN_COUNT * valueSize);
+        }
+    }
 
-    // Representation of a physical body
-    typedef struct _body : _state
+    // Asynchronous sink writing the state of an engine to a binary telemetry file
+    class Telemetry
     {
-        sf::CircleShape     planet;                 // Circular body object
-        sf::ConvexShape     arrow;                  // Force vector arrow
-        sf::CircleShape     history[COT_PERSIST];   // Persistence history
-        std::size_t         stamps;                 // Number of stamps recorded in persistence history
-    } body_t;
+    private:
 
-    // Representation of a list of bodies
-    typedef std::vector<cot::body_t> system_t;
+        // Queued copy of the state of a system, columns grow only when the number of bodies does
+        typedef struct _record
+        {
+            telemetry::frame_header_t header;
+            std::vector<std::uint32_t> id;
+            std::vector<math_t> columns[telemetry::COLUMN_COUNT];
+        } record_t;
 
-    /**
-     * @brief Returns the next body in the configuration file
-    */
-    unsigned int cfgGetNextBody(std::shared_ptr<spdlog::logger> logger, std::string& out_name, math_t& out_mass, sf::Vector2f& out_pos, sf::Vector2f& out_vel);
-    
-    // Physics engine
-    class Engine
+        // Records handed from the recording thread to the writer thread
+        SpscRing<record_t> rngRecords{64};
+
+        // Output file and the thread writing to it
+        std::FILE* fOut = nullptr;
+        std::thread thrWriter;
+        std::atomic<bool> bStop{false};
+
+        // Simulated time (sec) between records, and time since the last one
+        math_t mInterval = 0.1f;
+        math_t mElapsed = 0.0f;
+
+        // Whether recording waits for the writer instead of dropping records
+        bool bLossless = false;
+
+        // Number of records written and dropped because the writer fell behind
+        std::atomic<std::uint64_t> nWritten{0};
+        std::uint64_t nDropped = 0;
+
+        // Writer state, bytes written so far and the keyframes among them
+        std::uint64_t nOffset = 0;
+        std::vector<telemetry::keyframe_t> vKeyframes;
+
+        /**
+         * @brief Main loop of the writer thread
+        */
+        void writer();
+
+    public:
+
+        ~Telemetry();
+
+        /**
+         * @brief Creates the telemetry file and starts the writer thread
+         * @param path Path of the file, replaced if it exists
+         * @return Whether the file was created
+        */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Writes every queued record and the keyframe index, then closes the file
+        */
+        void close();
+
+        /**
+         * @brief Sets the simulated time between records
+         * @param interval Interval (sec), zero to record every step
+        */
+        void setInterval(const math_t interval);
+
+        /**
+         * @brief Selects whether recording waits for the writer when it falls behind
+         * @param lossless Wait instead of dropping records, for runs without a window
+        */
+        void setLossless(const bool lossless);
+
+        /**
+         * @brief Queues a record of the engine once the interval has passed, never blocks unless lossless
+         * @param eng Engine to record, read on the calling thread
+         * @param dt Simulated time since the last call
+        */
+        void record(const Engine& eng, const math_t dt);
+
+        /**
+         * @brief Number of records written to the file
+        */
+        std::uint64_t written() const;
+
+        /**
+         * @brief Number of records dropped because the writer fell behind
+        */
+        std::uint64_t dropped() const;
+    };
+
+    // Background writer of checkpoint files, holding one checkpoint whose allocations are reused between saves
+    // Claims, commits and waits must all come from one thread
+    class CheckpointWriter
     {
     private:
 
-        // Vector of all bodies and their corresponding shapes representing the system
-        system_t vSystem;
+        // Checkpoint being written, and where to
+        checkpoint_t cptSlot;
+        std::string sPath;
+
+        // Thread writing the checkpoint, busy from commit until the file is complete
+        std::thread thrWriter;
+        std::atomic<bool> bBusy{false};
+
+        // Number of checkpoints written and failed
+        std::atomic<std::uint64_t> nSaved{0};
+        std::atomic<std::uint64_t> nFailed{0};
+
+        /**
+         * @brief Writes the checkpoint to a temporary file then renames it over the path
+        */
+        void write();
 
     public:
 
+        ~CheckpointWriter();
+
         /**
-         * @brief Adds a body to the physics engine
-         * @param in_mass Mass of the body
-         * @param init_pos Initial position (pixels) of the body
-         * @param init_vel Initial velocity (pixels/sec) of the body
+         * @brief Checkpoint to fill before commit
+         * @return Pointer to the checkpoint, or null while the last one is still being written
         */
-        void addBody(std::string in_name, math_t in_mass, sf::Vector2f init_pos, sf::Vector2f init_vel);
+        checkpoint_t* claim();
 
         /**
-         * @brief Allows the physics engine to update force, velocity, and position of each body in the system
-         * @param dt Time since the update function was last called
+         * @brief Starts writing the claimed checkpoint in the background
+         * @param path Path of the file, replaced once complete
         */
-        void update(const math_t dt);
+        void commit(const std::string& path);
 
         /**
-         * @brief Publishes the current state of every body in the system
-         * @return An array of states for every body in the system, must be deallocated after processed
-         * @param out_sz The number of states published
+         * @brief Waits for the checkpoint being written
         */
-        std::vector<state_t> publish();
+        void wait();
 
         /**
-         * @brief Draws all bodies in the system in their last updated position
-         * @param wind Reference to drawing window
+         * @brief Number of checkpoints written and failed
         */
-        void draw(sf::RenderWindow& wind);
+        std::uint64_t saved() const;
+        std::uint64_t failed() const;
     };
-    
+
+    // Live telemetry streamed over a Unix domain socket to any number of local subscribers
+    // Each subscriber reads the file header then frames in the telemetry file format, without the keyframe index
+    class TelemetryServer
+    {
+    private:
+
+        // Subscriber and the rest of a frame it has not taken yet
+        typedef struct _client
+        {
+            int                 fd;         // Connected socket, non-blocking
+            std::vector<std::uint8_t> pending; // Bytes of the current frame still to be sent
+            std::size_t         sent = 0;   // Bytes of pending already sent
+        } client_t;
+
+        // Frames serialised by the publishing thread for the server thread
+        SpscRing<std::vector<std::uint8_t>> rngFrames{8};
+
+        // Listening socket, its path and the thread serving it
+        int nListen = -1;
+        std::string sPath;
+        std::thread thrServer;
+        std::atomic<bool> bStop{false};
+
+        // Subscribers, owned by the server thread
+        std::vector<client_t> vClients;
+
+        // Simulated time (sec) between frames, and time since the last one
+        math_t mInterval = 0.1f;
+        math_t mElapsed = 0.0f;
+
+        // Number of subscribers, frames handed to subscribers, and frames dropped for slow subscribers or a busy server
+        std::atomic<std::size_t> nClients{0};
+        std::atomic<std::uint64_t> nSent{0};
+        std::atomic<std::uint64_t> nDropped{0};
+
+        /**
+         * @brief Main loop of the server thread
+        */
+        void serve();
+
+        /**
+         * @brief Sends as much of a subscriber's pending bytes as the socket takes without blocking
+         * @return Whether the subscriber is still connected
+        */
+        static bool flush(client_t& client);
+
+    public:
+
+        ~TelemetryServer();
+
+        /**
+         * @brief Listens on a socket and starts the server thread
+         * @param path Path of the socket, replaced if it exists
+         * @return Whether the socket is listening
+        */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Disconnects every subscriber and removes the socket
+        */
+        void close();
+
+        /**
+         * @brief Sets the simulated time between frames
+         * @param interval Interval (sec), zero to stream every step
+        */
+        void setInterval(const math_t interval);
+
+        /**
+         * @brief Queues a frame of the engine once the interval has passed, never blocks
+         * @param eng Engine to stream, read on the calling thread
+         * @param dt Simulated time since the last call
+        */
+        void publish(const Engine& eng, const math_t dt);
+
+        /**
+         * @brief Number of connected subscribers
+        */
+        std::size_t clients() const;
+
+        /**
+         * @brief Number of frames handed to subscribers, counted once per subscriber
+        */
+        std::uint64_t sent() const;
+
+        /**
+         * @brief Number of frames dropped, once per slow subscriber or when the server fell behind
+        */
+        std::uint64_t dropped() const;
+    };
+
+    // Seekable player of a memory mapped telemetry file
+    class Playback
+    {
+    private:
+
+        // Mapped file
+        MappedFile mapFile;
+        const std::uint8_t* pData = nullptr;
+        std::size_t nSize = 0;
+
+        // Format version and bytes per value in the file
+        std::uint32_t nVersion = telemetry::version;
+        std::uint32_t nValueSize = sizeof(math_t);
+
+        // Keyframes in file order, and so in time order
+        std::vector<telemetry::keyframe_t> vKeyframes;
+
+        // Offset of the first byte after the last frame, and simulated time (sec) of the first and last frames
+        std::uint64_t nEnd = 0;
+        double mBegin = 0.0, mEnd = 0.0;
+
+        // Offset of the current frame, and the playback clock
+        std::uint64_t nCursor = 0;
+        double mClock = 0.0;
+        double mSpeed = 1.0;
+        bool bPaused = false;
+
+        // Current frame, and whether it changed since last taken
+        frame_t frmCurrent;
+        bool bChanged = false;
+
+        /**
+         * @brief Header of the frame at an offset
+        */
+        telemetry::frame_header_t header(const std::uint64_t offset) const;
+
+        /**
+         * @brief Offset of the frame following the one at an offset
+        */
+        std::uint64_t next(const std::uint64_t offset) const;
+
+        /**
+         * @brief Whether a whole frame starts at an offset and ends by another
+        */
+        bool complete(const std::uint64_t offset, const std::uint64_t end) const;
+
+        /**
+         * @brief Rebuilds the keyframe index of a file that was not closed cleanly by scanning frame headers
+        */
+        void scan(const std::uint64_t begin);
+
+        /**
+         * @brief Offset of the last frame at or before a time
+         * @param time Simulated time (sec)
+         * @param from Offset of a frame at or before the time to read forward from, if closer than the nearest keyframe
+        */
+        std::uint64_t locate(const double time, const std::uint64_t from) const;
+
+        /**
+         * @brief Makes the frame at an offset current
+         * @param cut Whether the frame does not follow on from the current one
+        */
+        void load(const std::uint64_t offset, const bool cut);
+
+    public:
+
+        ~Playback();
+
+        /**
+         * @brief Maps a telemetry file and reads its keyframe index
+         * @param path Path of the file
+         * @return Whether the file holds at least one frame
+        */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Unmaps the file
+        */
+        void close();
+
+        /**
+         * @brief Simulated time (sec) of the first and last frames
+        */
+        double begin() const;
+        double end() const;
+
+        /**
+         * @brief Number of keyframes in the index
+        */
+        std::size_t keyframes() const;
+
+        /**
+         * @brief Moves the playback clock and makes the last frame at or before it current
+         * @param time Simulated time (sec), clamped to the recording
+         * @note Finds the closest keyframe by binary search, then reads forward at most a keyframe interval
+        */
+        void seek(const double time);
+
+        /**
+         * @brief Moves the playback clock by real time scaled by the playback speed, unless paused
+         * @param dt Real time (sec) since the last call
+        */
+        void advance(const double dt);
+
+        /**
+         * @brief Sets the simulated seconds played per real second, negative to play in reverse
+         * @note Zero is ignored, as doubling or halving could not get playback moving again
+        */
+        void setSpeed(const double speed);
+        double speed() const;
+
+        /**
+         * @brief Pauses or resumes playback
+        */
+        void setPaused(const bool paused);
+        bool paused() const;
+
+        /**
+         * @brief Playback clock (sec)
+        */
+        double time() const;
+
+        /**
+         * @brief Takes the current frame if it changed since last taken
+         * @return Pointer to the frame, or null if it did not change
+        */
+        const frame_t* take();
+    };
+
     /**
      * @brief Handles the publishing from an engine
     */
-   void processPublish(Engine& eng, const math_t dt, std::shared_ptr<spdlog::logger> logger);
+    void processPublish(Engine& eng, const math_t dt, Telemetry& telemetry, TelemetryServer& server, std::shared_ptr<spdlog::logger> logger);
+
+    // Batches of independent runs of one catalog with perturbed initial conditions
+    namespace ensemble
+    {
+        // Leading word of an ensemble file, "COTE" in little endian
+        const std::uint32_t magic = 0x45544F43;
+
+        // Version of the ensemble format, bumped whenever the header or a column changes
+        const std::uint32_t version = 1;
+
+        // Summary columns of an ensemble file, one value per run, in file order
+        enum metric_t
+        {
+            METRIC_ENERGY_BEGIN,    // Total energy after perturbation
+            METRIC_ENERGY_END,      // Total energy at the end of the run
+            METRIC_DRIFT,           // Energy change relative to the energy at the beginning
+            METRIC_ESCAPES,         // Bodies unbound from the rest of the system at the end of the run
+            METRIC_MERGES,          // Bodies merged away by collisions
+            METRIC_EVALUATIONS,     // Number of times the acceleration of the system was calculated
+            METRIC_SECONDS,         // Wall time of the run (sec)
+            METRIC_COUNT
+        };
+
+        // Final state columns, one value per body of the base catalog per run, in file order
+        enum state_t { STATE_X, STATE_Y, STATE_VX, STATE_VY, STATE_MASS, STATE_COUNT };
+
+        // Header at the start of an ensemble file
+        // Followed by the summary then the final state columns, every value a double
+        // State values are indexed by run * bodies + the row of the body in the base catalog, bodies merged away have zero mass
+        typedef struct _header
+        {
+            std::uint32_t magic;            // magic
+            std::uint32_t version;          // Format version
+            std::uint64_t runs;             // Number of runs, run 0 is the base catalog unperturbed
+            std::uint64_t bodies;           // Number of bodies in the base catalog
+            std::uint32_t metrics;          // Number of summary columns
+            std::uint32_t states;           // Number of final state columns
+            std::uint64_t seed;             // Seed the perturbation of every run is drawn from
+            std::uint64_t steps;            // Number of steps of every run
+            double        dt;               // Timestep (sec)
+            double        position;         // Standard deviation of the position perturbation (pixels)
+            double        velocity;         // Standard deviation of the velocity perturbation, relative to the speed of each body
+            double        mass;             // Standard deviation of the mass perturbation, relative to the mass of each body
+        } header_t;
+
+        // Runs of an ensemble and the perturbation and engine settings they share
+        typedef struct _spec
+        {
+            std::size_t         runs = 1;                       // Number of runs
+            std::uint64_t       seed = 1;                       // Seed of the perturbations, run k always draws the same ones
+            std::size_t         threads = 1;                    // Number of threads sharing the runs
+            std::uint64_t       steps = 0;                      // Number of steps of every run
+            math_t              dt = 1.0f / 120.0f;             // Timestep (sec)
+            math_t              position = 0.0f;                // See header_t
+            math_t              velocity = 0.0f;                // See header_t
+            math_t              mass = 0.0f;                    // See header_t
+            solver_t            solver = SOLVER_DIRECT;         // Gravitational solver
+            math_t              theta = 0.5f;                   // Barnes-Hut opening angle
+            math_t              softening = 0.0f;               // Plummer softening length (pixels)
+            integrator_t        integrator = INTEGRATOR_EULER;  // Integrator
+            math_t              tolerance = 1e-3f;              // Adaptive integrator tolerance (pixels)
+            bool                collisions = false;             // Merge bodies that touch
+        } spec_t;
+
+        /**
+         * @brief Runs every member of an ensemble on its own engine, shared across threads one run per task, and writes a summary of each
+         * @param in_base Catalog every run perturbs
+         * @param path Path of the ensemble file, replaced if it exists
+         * @return Whether the file was written
+        */
+        bool run(std::shared_ptr<spdlog::logger> logger, const catalog_t& in_base, const spec_t& spec, const std::string& path);
+    }
 
     namespace metrics
     {
+        // Phases of a frame timed by profiling zones
+        typedef enum _phase
+        {
+            PHASE_INPUT,
+            PHASE_PHYSICS,
+            PHASE_TRAILS,
+            PHASE_DRAW,
+            PHASE_DISPLAY,
+            PHASE_PUBLISH,
+            PHASE_COUNT
+        } phase_t;
+
+        /**
+         * @brief Human readable name of a phase
+        */
+        const char* phaseName(const phase_t phase);
+
+        /**
+         * @brief Monotonic time (nanoseconds)
+        */
+        std::uint64_t now();
+
+        /**
+         * @brief Records a timed phase in the ring of the calling thread, never blocks once the thread has a ring
+         * @param phase Phase that ran
+         * @param begin Time (nanoseconds) the phase began
+         * @param end Time (nanoseconds) the phase ended
+        */
+        void record(const phase_t phase, const std::uint64_t begin, const std::uint64_t end);
+
+        // Times the enclosing scope as a phase
+        class Zone
+        {
+        private:
+
+            phase_t ePhase;
+            std::uint64_t nBegin;
+
+        public:
+
+            explicit Zone(const phase_t phase) : ePhase(phase), nBegin(now()) {}
+            ~Zone() { record(this->ePhase, this->nBegin, now()); }
+        };
+
+        /**
+         * @brief Writes the recent phases of every thread as a Chrome trace_event file
+         * @param path Path of the file, replaced if it exists
+         * @return Whether the file was written
+        */
+        bool dumpTrace(const std::string& path);
+
+        // Whether every heap allocation is counted, debug and benchmark builds define COT_COUNT_ALLOCATIONS
+#ifdef COT_COUNT_ALLOCATIONS
+        static const bool countAllocations = true;
+#else
+        static const bool countAllocations = false;
+#endif
+
+        /**
+         * @brief Heap allocations made by every thread since the process started
+         * @return Number of calls to the global operator new, always zero unless allocations are counted
+        */
+        std::uint64_t allocations();
+
         /**
          * Sets up the metrics calculations
         */
@@ -100,8 +2302,9 @@ namespace cot
         /**
          * @brief Allows the metrics calculations to update
          * @param dt Time since the update function was last called
+         * @param diag Diagnostics of the frame last drawn, shown when they were calculated
         */
-        void update(const cot::math_t dt);
+        void update(const cot::math_t dt, const diagnostics_t& diag);
 
         /**
          * @brief Draws the on-screen metrics
@@ -0,0 +1,264 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Maximum number of bodies held by a leaf before it is subdivided
+static const std::uint32_t param_leafSize = 8;
+
+// Number of bits per axis in a Morton code, which is also the maximum depth of the tree
+static const std::uint32_t param_mortonBits = 16;
+
+/**
+ * @brief Spreads the lower 16 bits of a value onto the even bits of the result
+*/
+inline std::uint32_t spreadBits(std::uint32_t v)
+{
+    v &= 0x0000FFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void cot::force::QuadTree::build(const math_t* x, const math_t* y, const math_t* mass, const std::size_t n)
+{
+    this->vNodes.clear();
+    this->vCodes.resize(n);
+    this->vOrder.resize(n);
+    this->vX.resize(n);
+    this->vY.resize(n);
+    this->vMass.resize(n);
+    if (n == 0)
+        return;
+
+    // Square bounding box of every body
+    math_t xMin = x[0], xMax = x[0], yMin = y[0], yMax = y[0];
+    for (std::size_t i = 1; i < n; i++)
+    {
+        xMin = std::min(xMin, x[i]);    xMax = std::max(xMax, x[i]);
+        yMin = std::min(yMin, y[i]);    yMax = std::max(yMax, y[i]);
+    }
+    math_t size = std::max(std::max(xMax - xMin, yMax - yMin), static_cast<math_t>(1e-3f)) * 1.0001f;
+
+    // Quantise positions onto the Morton curve
+    const math_t scale = static_cast<math_t>(1u << param_mortonBits) / size;
+    const std::uint32_t qMax = (1u << param_mortonBits) - 1;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        std::uint32_t qx = std::min(static_cast<std::uint32_t>((x[i] - xMin) * scale), qMax);
+        std::uint32_t qy = std::min(static_cast<std::uint32_t>((y[i] - yMin) * scale), qMax);
+        this->vCodes[i] = spreadBits(qx) | (spreadBits(qy) << 1);
+        this->vOrder[i] = static_cast<std::uint32_t>(i);
+    }
+
+    // Least significant digit radix sort of the codes, 8 bits per pass
+    this->vCodesTmp.resize(n);
+    this->vOrderTmp.resize(n);
+    for (std::uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        std::size_t count[257] = { 0 };
+        for (std::size_t i = 0; i < n; i++)
+            count[((this->vCodes[i] >> shift) & 0xFF) + 1]++;
+        for (std::size_t b = 0; b < 256; b++)
+            count[b + 1] += count[b];
+        for (std::size_t i = 0; i < n; i++)
+        {
+            std::size_t dst = count[(this->vCodes[i] >> shift) & 0xFF]++;
+            this->vCodesTmp[dst] = this->vCodes[i];
+            this->vOrderTmp[dst] = this->vOrder[i];
+        }
+        this->vCodes.swap(this->vCodesTmp);
+        this->vOrder.swap(this->vOrderTmp);
+    }
+
+    // Gather bodies into Morton order so leaves read contiguous memory
+    for (std::size_t k = 0; k < n; k++)
+    {
+        std::uint32_t i = this->vOrder[k];
+        this->vX[k] = x[i];
+        this->vY[k] = y[i];
+        this->vMass[k] = mass[i];
+    }
+
+    // Build nodes in pre-order so that the first child of a node immediately follows it
+    this->buildNode(0, static_cast<std::uint32_t>(n), 0, xMin, yMin, size);
+}
+
+std::uint32_t cot::force::QuadTree::buildNode(const std::uint32_t begin, const std::uint32_t end, const std::uint32_t level, 
+    const math_t x0, const math_t y0, const math_t size)
+{
+    const std::uint32_t index = static_cast<std::uint32_t>(this->vNodes.size());
+    this->vNodes.emplace_back();
+    {
+        node_t& node = this->vNodes[index];
+        node.x0 = x0;
+        node.y0 = y0;
+        node.size = size;
+        node.begin = begin;
+        node.count = end - begin;
+        node.leaf = ((node.count <= param_leafSize) || (level >= param_mortonBits));
+    }
+
+    math_t mass = 0.0f, mx = 0.0f, my = 0.0f;
+    if (this->vNodes[index].leaf)
+    {
+        // Sum bodies in the leaf directly
+        for (std::uint32_t k = begin; k < end; k++)
+        {
+            mass += this->vMass[k];
+            mx += this->vMass[k] * this->vX[k];
+            my += this->vMass[k] * this->vY[k];
+        }
+    }
+    else
+    {
+        // Split the range into quadrants by the next 2 bits of the Morton code
+        const std::uint32_t shift = 2 * (param_mortonBits - level - 1);
+        const std::uint32_t prefix = (level == 0 ? 0 : (this->vCodes[begin] >> (shift + 2)) << (shift + 2));
+        const math_t half = size * 0.5f;
+        std::uint32_t childBegin = begin;
+        for (std::uint32_t q = 0; q < 4; q++)
+        {
+            const std::uint64_t limit = static_cast<std::uint64_t>(prefix) + (static_cast<std::uint64_t>(q + 1) << shift);
+            const std::uint32_t childEnd = static_cast<std::uint32_t>(std::partition_point(
+                this->vCodes.begin() + childBegin, this->vCodes.begin() + end, 
+                [limit](const std::uint32_t code) { return code < limit; }) - this->vCodes.begin());
+
+            // Empty quadrants get no node
+            if (childEnd > childBegin)
+            {
+                const std::uint32_t child = this->buildNode(childBegin, childEnd, level + 1, 
+                    x0 + (q & 1) * half, y0 + (q >> 1) * half, half);
+                const node_t& cNode = this->vNodes[child];
+                mass += cNode.mass;
+                mx += cNode.mass * cNode.cx;
+                my += cNode.mass * cNode.cy;
+            }
+            childBegin = childEnd;
+        }
+    }
+
+    // Vector may have been reallocated by the children
+    node_t& node = this->vNodes[index];
+    node.mass = mass;
+    node.cx = (mass > 0.0f ? mx / mass : x0 + size * 0.5f);
+    node.cy = (mass > 0.0f ? my / mass : y0 + size * 0.5f);
+    node.next = static_cast<std::uint32_t>(this->vNodes.size());
+    return index;
+}
+
+template <bool TPotential>
+void cot::force::QuadTree::walk(const math_t px, const math_t py, const math_t theta2, const math_t soft2, 
+    math_t& out_ax, math_t& out_ay, math_t& out_phi, math_t& out_w) const
+{
+    const std::uint32_t nNodes = static_cast<std::uint32_t>(this->vNodes.size());
+    math_t aix = 0.0f, aiy = 0.0f, phi = 0.0f, w = 0.0f;
+
+    // Stackless pre-order walk, skipping a subtree jumps to its next index
+    std::uint32_t n = 0;
+    while (n < nNodes)
+    {
+        const node_t& node = this->vNodes[n];
+        if (node.leaf)
+        {
+            for (std::uint32_t j = node.begin; j < node.begin + node.count; j++)
+            {
+                math_t dx = this->vX[j] - px, dy = this->vY[j] - py;
+                math_t r2 = dx * dx + dy * dy + soft2;
+                if (r2 <= 0.0f)
+                    continue;
+                math_t inv = 1.0f / std::sqrt(r2);
+                math_t s = force::gravity * this->vMass[j] * inv * inv * inv;
+                aix += s * dx;
+                aiy += s * dy;
+
+                // The point has no potential energy with itself, which softening alone would give it
+                // G m / r is s r^2, so the force factor serves for both sums
+                if (TPotential && (r2 > soft2))
+                {
+                    phi += s * r2;
+                    w += s * (r2 - soft2);
+                }
+            }
+            n = node.next;
+            continue;
+        }
+
+        // Accept the cell as a single mass if it is small enough from here and does not contain the target
+        math_t dx = node.cx - px, dy = node.cy - py;
+        math_t d2 = dx * dx + dy * dy;
+        bool bInside = (px >= node.x0) && (px < node.x0 + node.size) && (py >= node.y0) && (py < node.y0 + node.size);
+        if (!bInside && (node.size * node.size < theta2 * d2))
+        {
+            math_t r2 = d2 + soft2;
+            math_t inv = 1.0f / std::sqrt(r2);
+            math_t s = force::gravity * node.mass * inv * inv * inv;
+            aix += s * dx;
+            aiy += s * dy;
+            if (TPotential)
+            {
+                phi += s * r2;
+                w += s * d2;
+            }
+            n = node.next;
+        }
+        else
+        {
+            n++;
+        }
+    }
+
+    out_ax = aix;
+    out_ay = aiy;
+    if (TPotential)
+    {
+        out_phi = phi;
+        out_w = w;
+    }
+}
+
+void cot::force::QuadTree::accelerate(const std::size_t begin, const std::size_t end, const math_t theta, const math_t soft2, 
+    math_t* ax, math_t* ay) const
+{
+    // Targets are visited in Morton order so that consecutive walks touch the same nodes
+    math_t phi, w;
+    for (std::size_t k = begin; k < end; k++)
+        this->walk<false>(this->vX[k], this->vY[k], theta * theta, soft2, ax[this->vOrder[k]], ay[this->vOrder[k]], phi, w);
+}
+
+void cot::force::QuadTree::accelerate(const std::size_t begin, const std::size_t end, const math_t theta, const math_t soft2, 
+    math_t* ax, math_t* ay, potential_t& out_potential) const
+{
+    // Every pair is seen from both of its bodies, so each side adds half
+    for (std::size_t k = begin; k < end; k++)
+    {
+        math_t phi, w;
+        this->walk<true>(this->vX[k], this->vY[k], theta * theta, soft2, ax[this->vOrder[k]], ay[this->vOrder[k]], phi, w);
+        out_potential.energy -= 0.5 * this->vMass[k] * phi;
+        out_potential.virial -= 0.5 * this->vMass[k] * w;
+    }
+}
+
+void cot::force::QuadTree::accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, 
+    const math_t theta, const math_t soft2, math_t* ax, math_t* ay) const
+{
+    math_t phi, w;
+    for (std::size_t k = 0; k < count; k++)
+        this->walk<false>(x[targets[k]], y[targets[k]], theta * theta, soft2, ax[targets[k]], ay[targets[k]], phi, w);
+}
+
+void cot::force::QuadTree::accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, 
+    const math_t* mass, const math_t theta, const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential) const
+{
+    for (std::size_t k = 0; k < count; k++)
+    {
+        math_t phi, w;
+        this->walk<true>(x[targets[k]], y[targets[k]], theta * theta, soft2, ax[targets[k]], ay[targets[k]], phi, w);
+        out_potential.energy -= 0.5 * mass[targets[k]] * phi;
+        out_potential.virial -= 0.5 * mass[targets[k]] * w;
+    }
+}
@@ -0,0 +1,270 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <cstring>
+
+// Size of the write buffer of a checkpoint file (bytes)
+static const std::size_t param_fileBuffer = 1 << 22;
+
+/**
+ * @brief Writes a section then pads it to whole 8 byte words
+ * @return Whether every byte was written
+*/
+static bool writeSection(std::FILE* fOut, const void* p, const std::size_t bytes)
+{
+    static const std::uint8_t zeros[8] = {};
+    const std::size_t nPad = cot::checkpoint::align(bytes) - bytes;
+    return (std::fwrite(p, 1, bytes, fOut) == bytes) && (std::fwrite(zeros, 1, nPad, fOut) == nPad);
+}
+
+// Sequential reader of the sections of a mapped checkpoint
+typedef struct _section_reader
+{
+    const std::uint8_t* p;      // Next section
+    const std::uint8_t* pEnd;   // First byte past the file
+
+    /**
+     * @brief Takes the next section
+     * @return First byte of the section, or null if the file ends before it
+    */
+    const std::uint8_t* take(const std::uint64_t bytes)
+    {
+        if (static_cast<std::uint64_t>(this->pEnd - this->p) < cot::checkpoint::align(bytes))
+            return nullptr;
+        const std::uint8_t* pSection = this->p;
+        this->p += cot::checkpoint::align(bytes);
+        return pSection;
+    }
+} section_reader_t;
+
+void cot::Engine::capture(checkpoint_t& out_checkpoint) const
+{
+    const physics_t& phys = this->sysPhysics;
+    const std::size_t n = phys.size();
+
+    checkpoint::header_t& header = out_checkpoint.header;
+    header.magic = checkpoint::magic;
+    header.version = checkpoint::version;
+    header.valueSize = sizeof(math_t);
+    header.integrator = this->eIntegrator;
+    header.count = n;
+    header.names = this->vNameTable.size();
+    header.step = this->nSteps;
+    header.time = this->mTime;
+    header.adaptiveDt = this->mAdaptiveDt;
+    header.merges = this->nMerges;
+    header.nextId = this->nNextId;
+    header.flags = (this->bAccelValid ? checkpoint::flagAccelValid : 0) | (this->vLevel.size() == n ? checkpoint::flagLevels : 0);
+    header.trailLength = 0;
+    header.trails = 0;
+
+    // Copies only allocate when the system grew since the last capture
+    out_checkpoint.columns[checkpoint::COLUMN_X].assign(phys.x.begin(), phys.x.end());
+    out_checkpoint.columns[checkpoint::COLUMN_Y].assign(phys.y.begin(), phys.y.end());
+    out_checkpoint.columns[checkpoint::COLUMN_VX].assign(phys.vx.begin(), phys.vx.end());
+    out_checkpoint.columns[checkpoint::COLUMN_VY].assign(phys.vy.begin(), phys.vy.end());
+    out_checkpoint.columns[checkpoint::COLUMN_MASS].assign(phys.mass.begin(), phys.mass.end());
+    out_checkpoint.columns[checkpoint::COLUMN_AX].assign(phys.ax.begin(), phys.ax.end());
+    out_checkpoint.columns[checkpoint::COLUMN_AY].assign(phys.ay.begin(), phys.ay.end());
+    out_checkpoint.columns[checkpoint::COLUMN_RADIUS].assign(this->vRadius.begin(), this->vRadius.end());
+    out_checkpoint.id.assign(this->vIds.begin(), this->vIds.end());
+    out_checkpoint.name.assign(this->vNames.begin(), this->vNames.end());
+    if (header.flags & checkpoint::flagLevels)
+        out_checkpoint.level.assign(this->vLevel.begin(), this->vLevel.end());
+    else
+        out_checkpoint.level.assign(n, 0);
+    out_checkpoint.names.clear();
+    for (const auto& cName : this->vNameTable)
+    {
+        out_checkpoint.names += cName;
+        out_checkpoint.names.push_back('\0');
+    }
+    header.nameBytes = out_checkpoint.names.size();
+
+    // Trails are only kept when captured by the drawing thread
+    out_checkpoint.trailIds.clear();
+    out_checkpoint.trailHead.clear();
+    out_checkpoint.trailCount.clear();
+    out_checkpoint.trailPoints.clear();
+}
+
+void cot::Engine::captureTrails(checkpoint_t& out_checkpoint) const
+{
+    this->trlHistory.capture(out_checkpoint);
+}
+
+bool cot::Engine::restore(const std::string& path)
+{
+    MappedFile mapFile;
+    if (!mapFile.open(path, true) || (mapFile.size() < sizeof(checkpoint::header_t)))
+        return false;
+
+    // Checkpoints are only read back by a build of the same precision
+    checkpoint::header_t header;
+    std::memcpy(&header, mapFile.data(), sizeof(header));
+    if ((header.magic != checkpoint::magic) || (header.version != checkpoint::version) || (header.valueSize != sizeof(math_t)))
+        return false;
+
+    // Counts are only multiplied out once each is known to fit in the file, so no section size can wrap around
+    const std::uint64_t n = header.count;
+    const std::uint64_t nFile = mapFile.size();
+    if ((n > nFile / sizeof(math_t)) || (header.nameBytes > nFile) || (header.names > header.nameBytes) || 
+        (header.trails > nFile / sizeof(std::uint32_t)) || 
+        ((header.trails > 0) && (header.trailLength > nFile / sizeof(sf::Vector2f) / header.trails)))
+        return false;
+
+    // Locate every section before anything is changed
+    section_reader_t reader{ mapFile.data() + checkpoint::align(sizeof(header)), mapFile.data() + mapFile.size() };
+    const math_t* pColumns[checkpoint::COLUMN_COUNT];
+    for (auto& pColumn : pColumns)
+        pColumn = reinterpret_cast<const math_t*>(reader.take(n * sizeof(math_t)));
+    const std::uint32_t* pId = reinterpret_cast<const std::uint32_t*>(reader.take(n * sizeof(std::uint32_t)));
+    const std::uint32_t* pName = reinterpret_cast<const std::uint32_t*>(reader.take(n * sizeof(std::uint32_t)));
+    const std::uint8_t* pLevel = reader.take(n);
+    const char* pNames = reinterpret_cast<const char*>(reader.take(header.nameBytes));
+    const std::uint32_t* pTrailId = reinterpret_cast<const std::uint32_t*>(reader.take(header.trails * sizeof(std::uint32_t)));
+    const std::uint32_t* pTrailHead = reinterpret_cast<const std::uint32_t*>(reader.take(header.trails * sizeof(std::uint32_t)));
+    const std::uint32_t* pTrailCount = reinterpret_cast<const std::uint32_t*>(reader.take(header.trails * sizeof(std::uint32_t)));
+    const sf::Vector2f* pTrailPoints = reinterpret_cast<const sf::Vector2f*>(reader.take(header.trails * header.trailLength * sizeof(sf::Vector2f)));
+    for (const auto* pColumn : pColumns)
+    {
+        if (!pColumn)
+            return false;
+    }
+    if (!pId || !pName || !pLevel || !pNames || !pTrailId || !pTrailHead || !pTrailCount || !pTrailPoints)
+        return false;
+
+    // Name table, every name of a body must be in it
+    std::vector<std::string> vTable;
+    vTable.reserve(header.names);
+    for (const char* p = pNames; (p < pNames + header.nameBytes) && (vTable.size() < header.names); )
+    {
+        const char* pZero = static_cast<const char*>(std::memchr(p, '\0', pNames + header.nameBytes - p));
+        if (!pZero)
+            return false;
+        vTable.emplace_back(p, pZero);
+        p = pZero + 1;
+    }
+    if (vTable.size() != header.names)
+        return false;
+    for (std::uint64_t i = 0; i < n; i++)
+    {
+        if (pName[i] >= header.names)
+            return false;
+    }
+
+    // Arrays are copied straight from the mapping
+    physics_t& phys = this->sysPhysics;
+    phys.x.assign(pColumns[checkpoint::COLUMN_X], pColumns[checkpoint::COLUMN_X] + n);
+    phys.y.assign(pColumns[checkpoint::COLUMN_Y], pColumns[checkpoint::COLUMN_Y] + n);
+    phys.vx.assign(pColumns[checkpoint::COLUMN_VX], pColumns[checkpoint::COLUMN_VX] + n);
+    phys.vy.assign(pColumns[checkpoint::COLUMN_VY], pColumns[checkpoint::COLUMN_VY] + n);
+    phys.mass.assign(pColumns[checkpoint::COLUMN_MASS], pColumns[checkpoint::COLUMN_MASS] + n);
+    phys.ax.assign(pColumns[checkpoint::COLUMN_AX], pColumns[checkpoint::COLUMN_AX] + n);
+    phys.ay.assign(pColumns[checkpoint::COLUMN_AY], pColumns[checkpoint::COLUMN_AY] + n);
+    this->vRadius.assign(pColumns[checkpoint::COLUMN_RADIUS], pColumns[checkpoint::COLUMN_RADIUS] + n);
+    this->vIds.assign(pId, pId + n);
+    this->vNames.assign(pName, pName + n);
+    this->vNameTable.swap(vTable);
+    this->mapNames.clear();
+    this->mapNames.reserve(this->vNameTable.size());
+    for (std::size_t k = 0; k < this->vNameTable.size(); k++)
+        this->mapNames.emplace(this->vNameTable[k], static_cast<std::uint32_t>(k));
+    this->nNextId = header.nextId;
+    this->nMerges = header.merges;
+
+    // Handles to the bodies replaced no longer match, every restored body gets a new one
+    this->resetRegistry();
+    this->mTime = static_cast<math_t>(header.time);
+    this->nSteps = header.step;
+
+    // Integrator state only carries over to the same integrator, any other starts afresh
+    const bool bSameIntegrator = (header.integrator == static_cast<std::uint32_t>(this->eIntegrator));
+    this->bAccelValid = bSameIntegrator && (header.flags & checkpoint::flagAccelValid);
+    this->mAdaptiveDt = (bSameIntegrator ? static_cast<math_t>(header.adaptiveDt) : 0.0f);
+    if (bSameIntegrator && (header.flags & checkpoint::flagLevels))
+        this->vLevel.assign(pLevel, pLevel + n);
+    else
+        this->vLevel.clear();
+
+    // Trails follow on when the length matches, and start empty otherwise
+    if (!this->trlHistory.restore(header.trailLength, header.trails, pTrailId, pTrailHead, pTrailCount, pTrailPoints))
+        this->trlHistory.clear();
+
+    // Energy drift is measured afresh from the restored state
+    this->bEnergyRef = false;
+    this->vDrift.clear();
+
+    this->nGeneration++;
+    this->nLayout++;
+    this->publishFrame();
+    return true;
+}
+
+cot::CheckpointWriter::~CheckpointWriter()
+{
+    this->wait();
+}
+
+cot::checkpoint_t* cot::CheckpointWriter::claim()
+{
+    if (this->bBusy)
+        return nullptr;
+    this->wait();
+    return &this->cptSlot;
+}
+
+void cot::CheckpointWriter::commit(const std::string& path)
+{
+    this->sPath = path;
+    this->bBusy = true;
+    this->thrWriter = std::thread(&CheckpointWriter::write, this);
+}
+
+void cot::CheckpointWriter::wait()
+{
+    if (this->thrWriter.joinable())
+        this->thrWriter.join();
+}
+
+void cot::CheckpointWriter::write()
+{
+    // Readers never see a partly written checkpoint, the previous one is replaced only once this one is complete
+    const std::string sTemp = this->sPath + ".tmp";
+    std::FILE* fOut = std::fopen(sTemp.c_str(), "wb");
+    bool bOk = (fOut != nullptr);
+    if (bOk)
+    {
+        const checkpoint_t& cpt = this->cptSlot;
+        std::setvbuf(fOut, nullptr, _IOFBF, param_fileBuffer);
+        bOk = writeSection(fOut, &cpt.header, sizeof(cpt.header));
+        for (const auto& cColumn : cpt.columns)
+            bOk = bOk && writeSection(fOut, cColumn.data(), cColumn.size() * sizeof(math_t));
+        bOk = bOk && writeSection(fOut, cpt.id.data(), cpt.id.size() * sizeof(std::uint32_t));
+        bOk = bOk && writeSection(fOut, cpt.name.data(), cpt.name.size() * sizeof(std::uint32_t));
+        bOk = bOk && writeSection(fOut, cpt.level.data(), cpt.level.size());
+        bOk = bOk && writeSection(fOut, cpt.names.data(), cpt.names.size());
+        bOk = bOk && writeSection(fOut, cpt.trailIds.data(), cpt.trailIds.size() * sizeof(std::uint32_t));
+        bOk = bOk && writeSection(fOut, cpt.trailHead.data(), cpt.trailHead.size() * sizeof(std::uint32_t));
+        bOk = bOk && writeSection(fOut, cpt.trailCount.data(), cpt.trailCount.size() * sizeof(std::uint32_t));
+        bOk = bOk && writeSection(fOut, cpt.trailPoints.data(), cpt.trailPoints.size() * sizeof(sf::Vector2f));
+        bOk = (std::fclose(fOut) == 0) && bOk;
+    }
+    bOk = bOk && (std::rename(sTemp.c_str(), this->sPath.c_str()) == 0);
+    if (!bOk)
+        std::remove(sTemp.c_str());
+
+    (bOk ? this->nSaved : this->nFailed)++;
+    this->bBusy = false;
+}
+
+std::uint64_t cot::CheckpointWriter::saved() const
+{
+    return this->nSaved;
+}
+
+std::uint64_t cot::CheckpointWriter::failed() const
+{
+    return this->nFailed;
+}
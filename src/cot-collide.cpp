@@ -0,0 +1,292 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <limits>
+#include <numeric>
+
+// Width of a grid cell in median radii, changed only when the median drifts by a factor of two
+static const cot::math_t param_cellRadii = 8.0f;
+static const cot::math_t param_cellMin = 1e-3f;
+
+// Most entry moves of the incremental sort per entry before it falls back to a full sort
+static const std::size_t param_sortMoves = 8;
+
+// Bias of cell coordinates so that keys of negative cells sort before positive ones
+static const std::int64_t param_cellBias = std::int64_t(1) << 31;
+static const std::int64_t param_cellLimit = std::int64_t(1) << 30;
+
+// Marks a removed body in a remap
+static const std::uint32_t param_removed = std::numeric_limits<std::uint32_t>::max();
+
+std::uint64_t cot::CollisionGrid::key(const std::int64_t cx, const std::int64_t cy)
+{
+    return (static_cast<std::uint64_t>(cy + param_cellBias) << 32) | static_cast<std::uint64_t>(cx + param_cellBias);
+}
+
+std::uint64_t cot::CollisionGrid::key(const math_t x, const math_t y) const
+{
+    // Bodies flung far away or to NaN share the edge cells
+    auto fnCell = [this](const math_t v) -> std::int64_t
+    {
+        const math_t c = std::floor(v / this->mCell);
+        if (!(c > -param_cellLimit))
+            return -param_cellLimit;
+        return std::min(static_cast<std::int64_t>(c), param_cellLimit);
+    };
+    return key(fnCell(x), fnCell(y));
+}
+
+void cot::CollisionGrid::test(const std::uint32_t i, const std::uint32_t j, const math_t* x, const math_t* y, const math_t* radius,
+    std::vector<contact_t>& out_contacts)
+{
+    const math_t dx = x[j] - x[i], dy = y[j] - y[i];
+    const math_t reach = radius[i] + radius[j];
+    if (dx * dx + dy * dy < reach * reach)
+        out_contacts.push_back(contact_t(std::min(i, j), std::max(i, j)));
+}
+
+void cot::CollisionGrid::compact(const std::vector<std::uint32_t>& vRemap)
+{
+    std::size_t k = 0;
+    for (const auto& cEntry : this->vEntries)
+    {
+        if (vRemap[cEntry.body] != param_removed)
+            this->vEntries[k++] = cell_entry_t{ cEntry.key, vRemap[cEntry.body] };
+    }
+    this->vEntries.resize(k);
+}
+
+void cot::CollisionGrid::detect(const math_t* x, const math_t* y, const math_t* radius, const std::size_t n, std::vector<contact_t>& out_contacts)
+{
+    out_contacts.clear();
+
+    // Bodies removed without a compaction leave the grid unusable, start afresh
+    if (this->vEntries.size() > n)
+        this->vEntries.clear();
+    for (std::size_t i = this->vEntries.size(); i < n; i++)
+        this->vEntries.push_back(cell_entry_t{ 0, static_cast<std::uint32_t>(i) });
+    if (n < 2)
+        return;
+
+    // Cell width follows the median radius, only changing when it drifts far enough to matter
+    this->vScratch.assign(radius, radius + n);
+    std::nth_element(this->vScratch.begin(), this->vScratch.begin() + n / 2, this->vScratch.end());
+    const math_t mTarget = std::max(this->vScratch[n / 2] * param_cellRadii, param_cellMin);
+    if ((this->mCell <= 0.0f) || (mTarget > 2.0f * this->mCell) || (2.0f * mTarget < this->mCell))
+        this->mCell = mTarget;
+
+    // Key of every body, and the bodies too wide for a cell
+    this->vLarge.clear();
+    for (auto& cEntry : this->vEntries)
+    {
+        cEntry.key = this->key(x[cEntry.body], y[cEntry.body]);
+        if (2.0f * radius[cEntry.body] > this->mCell)
+            this->vLarge.push_back(cEntry.body);
+    }
+
+    // Insertion sort of the order kept from the last step, only bodies that changed cell move
+    auto fnLess = [](const cell_entry_t& a, const cell_entry_t& b) { return (a.key < b.key) || ((a.key == b.key) && (a.body < b.body)); };
+    const std::size_t nBudget = param_sortMoves * n;
+    std::size_t nMoves = 0;
+    for (std::size_t i = 1; (i < n) && (nMoves <= nBudget); i++)
+    {
+        const cell_entry_t e = this->vEntries[i];
+        std::size_t j = i;
+        for (; (j > 0) && fnLess(e, this->vEntries[j - 1]); j--)
+            this->vEntries[j] = this->vEntries[j - 1];
+        this->vEntries[j] = e;
+        nMoves += i - j;
+    }
+    if (nMoves > nBudget)
+        std::sort(this->vEntries.begin(), this->vEntries.end(), fnLess);
+
+    // Bodies that fit a cell can only touch bodies in the same or adjacent cells
+    // Each pair is found once, from the cell above or to the left of the other
+    const std::size_t m = this->vEntries.size();
+    const std::uint64_t nextRow = std::uint64_t(1) << 32;
+    std::size_t p = 0;
+    for (std::size_t a = 0; a < m; a++)
+    {
+        const cell_entry_t& ea = this->vEntries[a];
+        if (2.0f * radius[ea.body] > this->mCell)
+            continue;
+
+        // Rest of the same cell and the next cell along the row
+        for (std::size_t b = a + 1; (b < m) && (this->vEntries[b].key <= ea.key + 1); b++)
+        {
+            if (2.0f * radius[this->vEntries[b].body] <= this->mCell)
+                test(ea.body, this->vEntries[b].body, x, y, radius, out_contacts);
+        }
+
+        // Three cells of the next row, whose first key only grows with a
+        const std::uint64_t keyLo = ea.key + nextRow - 1, keyHi = ea.key + nextRow + 1;
+        while ((p < m) && (this->vEntries[p].key < keyLo))
+            p++;
+        for (std::size_t b = p; (b < m) && (this->vEntries[b].key <= keyHi); b++)
+        {
+            if (2.0f * radius[this->vEntries[b].body] <= this->mCell)
+                test(ea.body, this->vEntries[b].body, x, y, radius, out_contacts);
+        }
+    }
+
+    // Wide bodies search every cell within their reach, or every body if that is cheaper
+    for (const std::uint32_t i : this->vLarge)
+    {
+        const std::int64_t cx0 = static_cast<std::int64_t>(std::floor((x[i] - radius[i]) / this->mCell)) - 1;
+        const std::int64_t cx1 = static_cast<std::int64_t>(std::floor((x[i] + radius[i]) / this->mCell)) + 1;
+        const std::int64_t cy0 = static_cast<std::int64_t>(std::floor((y[i] - radius[i]) / this->mCell)) - 1;
+        const std::int64_t cy1 = static_cast<std::int64_t>(std::floor((y[i] + radius[i]) / this->mCell)) + 1;
+        if ((cy1 - cy0 >= static_cast<std::int64_t>(m)) || (cx0 < -param_cellLimit) || (cx1 > param_cellLimit) ||
+            (cy0 < -param_cellLimit) || (cy1 > param_cellLimit))
+        {
+            for (const auto& cEntry : this->vEntries)
+            {
+                if (2.0f * radius[cEntry.body] <= this->mCell)
+                    test(i, cEntry.body, x, y, radius, out_contacts);
+            }
+            continue;
+        }
+        for (std::int64_t cy = cy0; cy <= cy1; cy++)
+        {
+            const std::uint64_t keyLo = key(cx0, cy), keyHi = key(cx1, cy);
+            auto itEntry = std::lower_bound(this->vEntries.begin(), this->vEntries.end(), keyLo,
+                [](const cell_entry_t& e, const std::uint64_t k) { return e.key < k; });
+            for (; (itEntry != this->vEntries.end()) && (itEntry->key <= keyHi); ++itEntry)
+            {
+                if (2.0f * radius[itEntry->body] <= this->mCell)
+                    test(i, itEntry->body, x, y, radius, out_contacts);
+            }
+        }
+    }
+
+    // Wide bodies against each other, of which there are few
+    for (std::size_t a = 0; a < this->vLarge.size(); a++)
+    {
+        for (std::size_t b = a + 1; b < this->vLarge.size(); b++)
+            test(this->vLarge[a], this->vLarge[b], x, y, radius, out_contacts);
+    }
+}
+
+void cot::Engine::setCollisions(const bool enable)
+{
+    this->bCollisions = enable;
+}
+
+std::uint64_t cot::Engine::merges() const
+{
+    return this->nMerges;
+}
+
+void cot::Engine::collide()
+{
+    physics_t& phys = this->sysPhysics;
+    const std::size_t n = phys.size();
+    this->gridCollide.detect(phys.x.data(), phys.y.data(), this->vRadius.data(), n, this->vContacts);
+    if (this->vContacts.empty())
+        return;
+
+    // Clusters of touching bodies, each rooted at its heaviest body
+    this->vParent.resize(n);
+    std::iota(this->vParent.begin(), this->vParent.end(), 0);
+    auto fnFind = [this](std::uint32_t i)
+    {
+        while (this->vParent[i] != i)
+        {
+            this->vParent[i] = this->vParent[this->vParent[i]];
+            i = this->vParent[i];
+        }
+        return i;
+    };
+    for (const auto& cContact : this->vContacts)
+    {
+        std::uint32_t a = fnFind(cContact.first), b = fnFind(cContact.second);
+        if (a == b)
+            continue;
+
+        // Heavier body survives, the lower index on a tie
+        if ((phys.mass[b] > phys.mass[a]) || ((phys.mass[b] == phys.mass[a]) && (b < a)))
+            std::swap(a, b);
+        this->vParent[b] = a;
+    }
+
+    // Survivors gather the mass, mass weighted position and momentum of their cluster
+    this->vMerged.assign(n, 0);
+    for (std::uint32_t i = 0; i < n; i++)
+    {
+        const std::uint32_t r = fnFind(i);
+        if (r == i)
+            continue;
+        if (!this->vMerged[r])
+        {
+            this->vMerged[r] = 1;
+            phys.x[r] *= phys.mass[r];
+            phys.y[r] *= phys.mass[r];
+            phys.vx[r] *= phys.mass[r];
+            phys.vy[r] *= phys.mass[r];
+        }
+        phys.x[r] += phys.mass[i] * phys.x[i];
+        phys.y[r] += phys.mass[i] * phys.y[i];
+        phys.vx[r] += phys.mass[i] * phys.vx[i];
+        phys.vy[r] += phys.mass[i] * phys.vy[i];
+        phys.mass[r] += phys.mass[i];
+        this->nMerges++;
+    }
+    for (std::size_t r = 0; r < n; r++)
+    {
+        if (!this->vMerged[r])
+            continue;
+        phys.x[r] /= phys.mass[r];
+        phys.y[r] /= phys.mass[r];
+        phys.vx[r] /= phys.mass[r];
+        phys.vy[r] /= phys.mass[r];
+        this->vRadius[r] = mass2rad(phys.mass[r]);
+    }
+
+    // Remove absorbed bodies, survivors keep their order and identifier
+    this->vRemap.resize(n);
+    std::uint32_t k = 0;
+    for (std::uint32_t i = 0; i < n; i++)
+        this->vRemap[i] = (fnFind(i) == i ? k++ : param_removed);
+    this->compact(this->vRemap);
+}
+
+void cot::Engine::compact(const std::vector<std::uint32_t>& vNewIndex)
+{
+    auto fnCompact = [&vNewIndex](auto& v)
+    {
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < v.size(); i++)
+        {
+            if (vNewIndex[i] != param_removed)
+                v[k++] = std::move(v[i]);
+        }
+        v.resize(k);
+    };
+
+    // Removed bodies give up their slot, survivors tell the registry where they moved to
+    for (std::size_t i = 0; i < this->vSlots.size(); i++)
+    {
+        if (vNewIndex[i] == param_removed)
+            this->releaseSlot(this->vSlots[i]);
+    }
+
+    physics_t& phys = this->sysPhysics;
+    fnCompact(phys.x);
+    fnCompact(phys.y);
+    fnCompact(phys.vx);
+    fnCompact(phys.vy);
+    fnCompact(phys.mass);
+    fnCompact(phys.ax);
+    fnCompact(phys.ay);
+    fnCompact(this->vNames);
+    fnCompact(this->vIds);
+    fnCompact(this->vRadius);
+    fnCompact(this->vSlots);
+    for (std::size_t k = 0; k < this->vSlots.size(); k++)
+        this->vRegistry[this->vSlots[k]].index = static_cast<std::uint32_t>(k);
+    this->gridCollide.compact(vNewIndex);
+    this->bAccelValid = false;
+    this->nGeneration++;
+    this->nLayout++;
+}
@@ -2,71 +2,197 @@
 // Malhar Palkar
 #include <curious-orbital-toy.hpp>
 
-#include <fstream>
-#include <sstream>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 
-static std::string sConfig;
-static std::stringstream strConfig;
+// Bytes of catalog parsed per task
+static const std::size_t param_chunkBytes = 1 << 22;
 
-unsigned int cot::cfgGetNextBody(std::shared_ptr<spdlog::logger> logger, std::string& out_name, math_t& out_mass, sf::Vector2f& out_pos, sf::Vector2f& out_vel)
+// Most errors reported per task, later ones are only counted
+static const std::size_t param_chunkErrors = 16;
+
+// Number of numeric fields following the name of a body
+static const std::size_t param_catalogFields = 5;
+
+// Line of a catalog that could not be read
+typedef struct _catalog_error
 {
-    // Check if configuration file has been read
-    if (sConfig.length() <= 0)
-    {
-        std::fstream fConfig;
-        std::stringstream isConfig;
+    std::size_t         line;       // Line number within the chunk, from zero
+    const char*         what;       // Reason the line was rejected
+} catalog_error_t;
 
-        // Try to open configuration file
-        logger->debug("Opening config file.");
-        fConfig.open("cot.csv", std::ios::in);
-        if (!fConfig.is_open())
-        {
-            logger->error("Unable to open config file.");
-            return 0;
-        }
+// Bodies and errors of one chunk of a catalog
+typedef struct _catalog_chunk
+{
+    const char*         begin;      // First byte of the chunk
+    const char*         end;        // First byte past the chunk
+    cot::catalog_t      bodies;     // Bodies read from the chunk
+    std::size_t         lines = 0;  // Number of lines in the chunk
+    std::size_t         failed = 0; // Number of lines that could not be read
+    std::vector<catalog_error_t> errors;
+} catalog_chunk_t;
+
+/**
+ * @brief Skips spaces and tabs
+*/
+inline const char* skipBlank(const char* p, const char* pEnd)
+{
+    while ((p < pEnd) && ((*p == ' ') || (*p == '\t')))
+        p++;
+    return p;
+}
 
-        // Read contents of configuration file into string and new stream
-        logger->debug("Reading contents of configuration file.");
-        isConfig << fConfig.rdbuf();
-        sConfig = isConfig.str();
-        strConfig.str(sConfig);
+/**
+ * @brief Reads one "name, mass, x, y, vx, vy," line into a chunk
+ * @return Reason the line was rejected, or null if it was read
+*/
+static const char* parseLine(const char* p, const char* pEnd, cot::catalog_t& out_bodies)
+{
+    // Name runs up to the first separator
+    const char* pName = p;
+    const char* pSep = static_cast<const char*>(std::memchr(p, ',', pEnd - p));
+    if (!pSep)
+        return "expected 6 fields";
+
+    cot::math_t values[param_catalogFields];
+    p = pSep + 1;
+    for (std::size_t k = 0; k < param_catalogFields; k++)
+    {
+        p = skipBlank(p, pEnd);
+        if ((p < pEnd) && (*p == '+'))
+            p++;
+        auto result = std::from_chars(p, pEnd, values[k]);
+        if (result.ec != std::errc())
+            return (p == pEnd ? "expected 6 fields" : "invalid number");
+        p = skipBlank(result.ptr, pEnd);
 
-        // Close everything
-        logger->debug("Closing config file.");
-        fConfig.close();
+        // Every field is followed by a separator, except that the last one may end the line
+        if ((p < pEnd) && (*p == ','))
+            p++;
+        else if ((p < pEnd) || (k + 1 < param_catalogFields))
+            return (p == pEnd ? "expected 6 fields" : "invalid number");
     }
+    if (skipBlank(p, pEnd) != pEnd)
+        return "unexpected text after 6 fields";
+
+    out_bodies.name.emplace_back(pName, pSep);
+    out_bodies.mass.push_back(values[0]);
+    out_bodies.x.push_back(values[1]);
+    out_bodies.y.push_back(values[2]);
+    out_bodies.vx.push_back(values[3]);
+    out_bodies.vy.push_back(values[4]);
+    return nullptr;
+}
 
-    // Check if another body is available
-    std::string cLine;
-    if (std::getline(strConfig, cLine))
+/**
+ * @brief Reads every line of a chunk
+*/
+static void parseChunk(catalog_chunk_t& chunk)
+{
+    const char* p = chunk.begin;
+    while (p < chunk.end)
     {
-        logger->debug("Read config line '{0}'", cLine);
+        const char* pEol = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+        const char* pNext = (pEol ? pEol + 1 : chunk.end);
+        const char* pEnd = (pEol ? pEol : chunk.end);
+        if ((pEnd > p) && (pEnd[-1] == '\r'))
+            pEnd--;
+        chunk.lines++;
 
-        // Check if line contains another body
-        std::vector<std::string> vTokens;
-        for (size_t pos = 0; (pos = cLine.find(',')) != std::string::npos; cLine.erase(0, pos + 1))
+        // Blank lines are allowed anywhere
+        if (skipBlank(p, pEnd) != pEnd)
         {
-            vTokens.push_back(cLine.substr(0, pos));
+            const char* what = parseLine(p, pEnd, chunk.bodies);
+            if (what)
+            {
+                if (chunk.errors.size() < param_chunkErrors)
+                    chunk.errors.push_back(catalog_error_t{ chunk.lines - 1, what });
+                chunk.failed++;
+            }
         }
-        if (vTokens.size() != 6)
+        p = pNext;
+    }
+}
+
+/**
+ * @brief Appends one array to another
+*/
+template <class T>
+inline void append(std::vector<T>& out, std::vector<T>& in)
+{
+    out.insert(out.end(), std::make_move_iterator(in.begin()), std::make_move_iterator(in.end()));
+}
+
+bool cot::cfgLoadCatalog(std::shared_ptr<spdlog::logger> logger, const std::string& path, const std::size_t nThreads, catalog_t& out_catalog)
+{
+    auto tBegin = std::chrono::steady_clock::now();
+
+    // Try to map configuration file
+    MappedFile mapConfig;
+    if (!mapConfig.open(path, true))
+    {
+        logger->error("Unable to open catalog '{0}'.", path);
+        return false;
+    }
+    const char* pData = reinterpret_cast<const char*>(mapConfig.data());
+    const std::size_t nSize = mapConfig.size();
+
+    // Split into chunks of whole lines
+    const std::size_t nChunks = (nSize + param_chunkBytes - 1) / param_chunkBytes;
+    std::vector<catalog_chunk_t> vChunks(nChunks);
+    const char* pBegin = pData;
+    for (std::size_t k = 0; k < nChunks; k++)
+    {
+        const char* pEnd = pData + std::min(nSize, (k + 1) * param_chunkBytes);
+        if ((pEnd < pData + nSize) && (pEnd > pBegin))
         {
-            logger->error("Incorrectly read {0:d} tokens.", vTokens.size());
-            return 0;
+            const char* pEol = static_cast<const char*>(std::memchr(pEnd - 1, '\n', pData + nSize - (pEnd - 1)));
+            pEnd = (pEol ? pEol + 1 : pData + nSize);
         }
-    
-        // Extract body data
-        out_name = vTokens[0];
-        out_mass = std::stof(vTokens[1]);
-        out_pos.x = std::stof(vTokens[2]);
-        out_pos.y = std::stof(vTokens[3]);
-        out_vel.x = std::stof(vTokens[4]);
-        out_vel.y = std::stof(vTokens[5]);
-        logger->debug(std::string("Read mass '") + out_name + 
-            std::string("' {:.2f} init position ({:.2f},{:.2f}) init velocity ({:.2f},{:.2f})"), 
-            out_mass, out_pos.x, out_pos.y, out_vel.x, out_vel.y);
-        return 1;
+        pEnd = std::max(pEnd, pBegin);
+        vChunks[k].begin = pBegin;
+        vChunks[k].end = pEnd;
+        pBegin = pEnd;
     }
-    
-    logger->debug("No bodies specified in remainder of config file.");
-    return 0;
-}
\ No newline at end of file
+
+    // Parse every chunk in parallel
+    ThreadPool poolParse(nThreads);
+    auto fnParse = [&](const std::size_t k, const std::size_t) { parseChunk(vChunks[k]); };
+    poolParse.run(nChunks, fnParse);
+
+    // Report errors with their line number in the file
+    std::size_t nLine = 1, nFailed = 0, nBodies = 0;
+    for (const auto& cChunk : vChunks)
+    {
+        for (const auto& cError : cChunk.errors)
+            logger->error("{0}:{1:d}: {2}.", path, nLine + cError.line, cError.what);
+        nLine += cChunk.lines;
+        nFailed += cChunk.failed;
+        nBodies += cChunk.bodies.size();
+    }
+    if (nFailed > 0)
+        logger->error("Skipped {0:d} lines of catalog '{1}'.", nFailed, path);
+
+    // Gather bodies in file order
+    out_catalog.name.reserve(out_catalog.size() + nBodies);
+    out_catalog.mass.reserve(out_catalog.size() + nBodies);
+    out_catalog.x.reserve(out_catalog.size() + nBodies);
+    out_catalog.y.reserve(out_catalog.size() + nBodies);
+    out_catalog.vx.reserve(out_catalog.size() + nBodies);
+    out_catalog.vy.reserve(out_catalog.size() + nBodies);
+    for (auto& cChunk : vChunks)
+    {
+        append(out_catalog.name, cChunk.bodies.name);
+        append(out_catalog.mass, cChunk.bodies.mass);
+        append(out_catalog.x, cChunk.bodies.x);
+        append(out_catalog.y, cChunk.bodies.y);
+        append(out_catalog.vx, cChunk.bodies.vx);
+        append(out_catalog.vy, cChunk.bodies.vy);
+    }
+
+    std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+    logger->info("Read {0:d} bodies from catalog '{1}' ({2:.2f} MB) in {3:.3f} sec, {4:.1f} MB/s.",
+        nBodies, path, nSize / 1e6, tElapsed.count(), nSize / 1e6 / std::max(tElapsed.count(), 1e-9));
+    return (nFailed == 0);
+}
@@ -0,0 +1,179 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <array>
+#include <cmath>
+
+// Number of bodies binned per task
+static const std::size_t param_densityChunk = 16384;
+
+// Number of pixel rows in a band, each band is splatted and coloured by one task
+static const unsigned param_densityBandRows = 16;
+
+// Decades of density below the densest pixel spanned by the colour map
+static const float param_densityDecades = 4.0f;
+
+/**
+ * @brief Colour of every normalised log density from sparse to dense
+*/
+static const std::array<sf::Color, 256>& colourMap()
+{
+    static const std::array<sf::Color, 256> aColours = []()
+    {
+        // Dark violet through magenta and orange to white
+        static const float stops[][4] = {
+            { 0.00f,  40.0f,   0.0f,  70.0f },
+            { 0.35f, 150.0f,  30.0f, 120.0f },
+            { 0.65f, 240.0f, 110.0f,  30.0f },
+            { 0.90f, 250.0f, 220.0f,  80.0f },
+            { 1.00f, 255.0f, 255.0f, 255.0f }
+        };
+        std::array<sf::Color, 256> a;
+        std::size_t s = 0;
+        for (std::size_t k = 0; k < a.size(); k++)
+        {
+            const float t = k / 255.0f;
+            while (t > stops[s + 1][0])
+                s++;
+            const float f = (t - stops[s][0]) / (stops[s + 1][0] - stops[s][0]);
+            a[k] = sf::Color(static_cast<sf::Uint8>(stops[s][1] + f * (stops[s + 1][1] - stops[s][1])),
+                static_cast<sf::Uint8>(stops[s][2] + f * (stops[s + 1][2] - stops[s][2])),
+                static_cast<sf::Uint8>(stops[s][3] + f * (stops[s + 1][3] - stops[s][3])));
+        }
+        return a;
+    }();
+    return aColours;
+}
+
+void cot::DensityMap::setThreads(const std::size_t nThreads)
+{
+    this->poolScatter = std::make_unique<ThreadPool>(nThreads);
+}
+
+void cot::DensityMap::draw(sf::RenderTarget& target, const math_t* x, const math_t* y, const math_t* mass, const render_t* render, 
+    const std::size_t n, const float maxRadius)
+{
+    const sf::Vector2u vSize = target.getSize();
+    if ((vSize.x == 0) || (vSize.y == 0))
+        return;
+
+    // Grid follows the size of the target, allocations are kept between frames of the same size
+    if ((vSize.x != this->nWidth) || (vSize.y != this->nHeight))
+    {
+        this->nWidth = vSize.x;
+        this->nHeight = vSize.y;
+        this->vGrid.resize(static_cast<std::size_t>(this->nWidth) * this->nHeight);
+        this->vPixels.resize(4 * this->vGrid.size());
+        this->texDensity.create(this->nWidth, this->nHeight);
+        this->sprDensity.setTexture(this->texDensity, true);
+    }
+    const unsigned w = this->nWidth, h = this->nHeight;
+
+    // Pixel scale and origin of the current view
+    const sf::View& view = target.getView();
+    const float viewL = view.getCenter().x - view.getSize().x * 0.5f, viewT = view.getCenter().y - view.getSize().y * 0.5f;
+    const float sx = w / std::max(view.getSize().x, 1e-6f), sy = h / std::max(view.getSize().y, 1e-6f);
+
+    const std::size_t nBands = (h + param_densityBandRows - 1) / param_densityBandRows;
+    const std::size_t nChunks = std::max<std::size_t>(1, (n + param_densityChunk - 1) / param_densityChunk);
+    this->vCells.resize(n);
+    this->vOrder.resize(n);
+    this->vBands.resize(nBands + 1);
+    this->vBandMax.resize(nBands);
+    this->vOffsets.assign(nChunks * nBands, 0);
+
+    // Cell of each small body in view, counted by band in each chunk
+    auto fnBin = [&](const std::size_t chunk, const std::size_t)
+    {
+        std::uint32_t* pCount = this->vOffsets.data() + chunk * nBands;
+        for (std::size_t i = chunk * param_densityChunk; i < std::min(n, (chunk + 1) * param_densityChunk); i++)
+        {
+            const float gx = (static_cast<float>(x[i]) - viewL) * sx, gy = (static_cast<float>(y[i]) - viewT) * sy;
+            if ((render[i].radius >= maxRadius) || !(gx >= 0.0f) || !(gy >= 0.0f) || (gx >= w) || (gy >= h))
+            {
+                this->vCells[i] = UINT32_MAX;
+                continue;
+            }
+            const unsigned row = static_cast<unsigned>(gy);
+            this->vCells[i] = row * w + static_cast<unsigned>(gx);
+            pCount[row / param_densityBandRows]++;
+        }
+    };
+    this->poolScatter->run(nChunks, fnBin);
+
+    // Bands laid end to end, chunks in order within each band
+    std::uint32_t nTotal = 0;
+    for (std::size_t band = 0; band < nBands; band++)
+    {
+        this->vBands[band] = nTotal;
+        for (std::size_t chunk = 0; chunk < nChunks; chunk++)
+        {
+            const std::uint32_t nCount = this->vOffsets[chunk * nBands + band];
+            this->vOffsets[chunk * nBands + band] = nTotal;
+            nTotal += nCount;
+        }
+    }
+    this->vBands[nBands] = nTotal;
+
+    // Group bodies by band, every chunk writes its own ranges
+    auto fnGroup = [&](const std::size_t chunk, const std::size_t)
+    {
+        std::uint32_t* pOffset = this->vOffsets.data() + chunk * nBands;
+        for (std::size_t i = chunk * param_densityChunk; i < std::min(n, (chunk + 1) * param_densityChunk); i++)
+        {
+            const std::uint32_t cell = this->vCells[i];
+            if (cell != UINT32_MAX)
+                this->vOrder[pOffset[cell / w / param_densityBandRows]++] = static_cast<std::uint32_t>(i);
+        }
+    };
+    this->poolScatter->run(nChunks, fnGroup);
+
+    // Splat every band into its own rows, no two tasks touch the same pixel
+    auto fnSplat = [&](const std::size_t band, const std::size_t)
+    {
+        float* pBegin = this->vGrid.data() + band * param_densityBandRows * w;
+        float* pEnd = this->vGrid.data() + std::min<std::size_t>(h, (band + 1) * param_densityBandRows) * w;
+        std::fill(pBegin, pEnd, 0.0f);
+        for (std::uint32_t k = this->vBands[band]; k < this->vBands[band + 1]; k++)
+        {
+            const std::uint32_t i = this->vOrder[k];
+            this->vGrid[this->vCells[i]] += static_cast<float>(mass[i]);
+        }
+        this->vBandMax[band] = *std::max_element(pBegin, pEnd);
+    };
+    this->poolScatter->run(nBands, fnSplat);
+    const float mDensest = *std::max_element(this->vBandMax.begin(), this->vBandMax.end());
+
+    // Colour by the log of density relative to the densest pixel, empty pixels stay clear
+    const std::array<sf::Color, 256>& aColours = colourMap();
+    auto fnColour = [&](const std::size_t band, const std::size_t)
+    {
+        const std::size_t pBegin = band * param_densityBandRows * w;
+        const std::size_t pEnd = std::min<std::size_t>(h, (band + 1) * param_densityBandRows) * w;
+        for (std::size_t p = pBegin; p < pEnd; p++)
+        {
+            sf::Uint8* pPixel = this->vPixels.data() + 4 * p;
+            const float d = this->vGrid[p];
+            if (d <= 0.0f)
+            {
+                pPixel[0] = pPixel[1] = pPixel[2] = pPixel[3] = 0;
+                continue;
+            }
+            const float t = std::max(0.0f, 1.0f + std::log10(d / mDensest) / param_densityDecades);
+            const sf::Color& c = aColours[static_cast<std::size_t>(t * 255.0f)];
+            pPixel[0] = c.r;
+            pPixel[1] = c.g;
+            pPixel[2] = c.b;
+            pPixel[3] = 255;
+        }
+    };
+    this->poolScatter->run(nBands, fnColour);
+    this->texDensity.update(this->vPixels.data());
+
+    // Texture covers the target pixel for pixel whatever view it uses
+    const sf::View viewWorld = view;
+    target.setView(sf::View(sf::FloatRect(0.0f, 0.0f, static_cast<float>(w), static_cast<float>(h))));
+    target.draw(this->sprDensity);
+    target.setView(viewWorld);
+}
@@ -2,215 +2,654 @@
 // Malhar Palkar
 #include <curious-orbital-toy.hpp>
 
+#include <algorithm>
 #include <ctgmath>
 
-/**
- * @brief Calculates the gravitational attraction force between 2 bodies
- * @param bodyPair Pair of bodies
- * @return Pair of force vectors corresponding to input parameter pair
-*/
-std::pair<sf::Vector2f, sf::Vector2f> force2(const std::pair<cot::body_t, cot::body_t>& bodyPair)
-{
-    // Gravitational constant
-    static const cot::math_t gConst = 6.6743E-11f;
+// Number of Barnes-Hut targets per task
+static const std::size_t param_targetsPerTask = 256;
 
-    // Mass scaling factor
-    static const cot::math_t mScale = 1e7f;
+// Number of partial update targets per task
+static const std::size_t param_activePerTask = 64;
 
-    // Calculate distances and angles
-    sf::Vector2f vDist;
-    vDist.x = bodyPair.first.position.x - bodyPair.second.position.x;
-    vDist.y = bodyPair.first.position.y - bodyPair.second.position.y;
-    cot::math_t mDist = std::sqrt(std::pow(vDist.x, 2.0f) + std::pow(vDist.y, 2.0f));
-    cot::math_t mAngle = std::atan(std::abs(vDist.y / vDist.x));
+// Minimum number of bodies per direct summation block, and the most blocks used
+static const std::size_t param_blockMinBodies = 256;
+static const std::size_t param_blockMax = 64;
 
-    // Calculate absolute value of force - zero if distance is non-zero
-    cot::math_t mForce = (mDist != 0.0f ? gConst * bodyPair.first.mass * bodyPair.second.mass * std::pow(mScale, 2.0f) / std::pow(mDist, 2.0f) : 0.0f);
+// Fewest entries the energy drift series grows by at once, so a diagnosed update seldom allocates
+static const std::size_t param_driftBlock = 1 << 16;
 
-    // Decompose force vector into constituents
-    sf::Vector2f vForceA;
-    vForceA.x = std::copysign(mForce * std::cos(mAngle), -vDist.x);
-    vForceA.y = std::copysign(mForce * std::sin(mAngle), -vDist.y);
-    
-    // Force on body B
-    sf::Vector2f vForceB;
-    vForceB.x = -vForceA.x;
-    vForceB.y = -vForceA.y;
+// Number of triangles in a planet fan, and on-screen radius (pixels) below which a quarter of them are used
+static const std::size_t param_planetSegments = 24;
+static const float param_smallPlanet = 4.0f;
 
-    return std::make_pair(vForceA, vForceB);
-}
+// On-screen radius (pixels) below which bodies are drawn into the density texture when zoomed out
+static const float param_lodRadius = 1.5f;
+
+// Force arrow scale and length (pixels)
+static const float param_arrowScale = 5.0f;
+static const float param_arrowLength = 6.0f * param_arrowScale;
+
+// Force arrow pointing along +X as a shaft of 2 triangles and a head of 1
+static const std::size_t param_arrowTriangles = 3;
+static const sf::Vector2f arrowShape[3 * param_arrowTriangles] = {
+    sf::Vector2f(0.0f, -1.0f), sf::Vector2f(4.0f, -1.0f), sf::Vector2f(4.0f, 1.0f),
+    sf::Vector2f(0.0f, -1.0f), sf::Vector2f(4.0f, 1.0f), sf::Vector2f(0.0f, 1.0f),
+    sf::Vector2f(4.0f, -3.0f), sf::Vector2f(6.0f, 0.0f), sf::Vector2f(4.0f, 3.0f)
+};
 
 /**
- * @brief Mathematical sign function
+ * @brief Point k of the unit circle divided into planet segments
 */
-inline cot::math_t sgn(const cot::math_t _i)
+inline const sf::Vector2f& unitCircle(const std::size_t k)
 {
-    return (_i > 0.0f) - (_i < 0.0f);
+    static const std::vector<sf::Vector2f> vCircle = []()
+    {
+        std::vector<sf::Vector2f> v(param_planetSegments);
+        for (std::size_t i = 0; i < param_planetSegments; i++)
+            v[i] = sf::Vector2f(std::cos(2.0f * M_PI * i / param_planetSegments), std::sin(2.0f * M_PI * i / param_planetSegments));
+        return v;
+    }();
+    return vCircle[k];
 }
 
-/**
- * @brief Calculates the angle based on a force vector
- * @param fVect Force vector
- * @return Angle of force vector in radians (0 - 2pi)
-*/
-inline cot::math_t forceAngle(const sf::Vector2f& fVect)
+void cot::Engine::setSoftening(const math_t eps)
 {
-    // Mark angle as NaN if no force
-    return ((fVect.x == 0.0f) && (fVect.y == 0.0f) ? NAN : (M_PI 
-        - ((M_PI / 2.0f) * (1.0f + sgn(fVect.x)) * (1 - sgn(std::pow(fVect.y, 2.0f))))
-        - ((M_PI / 4.0f) * (2.0f + sgn(fVect.x)) * sgn(fVect.y))
-        - (sgn(fVect.x * fVect.y) * std::atan((std::abs(fVect.x) - std::abs(fVect.y)) / (std::abs(fVect.x) + std::abs(fVect.y))))));
+    this->mSoft2 = eps * eps;
+}
+
+void cot::Engine::setSolver(const solver_t solver, const math_t theta)
+{
+    this->eSolver = solver;
+    this->mTheta = theta;
+}
+
+void cot::Engine::setThreads(const std::size_t nThreads)
+{
+    this->poolWork = std::make_unique<ThreadPool>(nThreads);
+    this->mapDensity.setThreads(nThreads);
+}
+
+const std::vector<double>& cot::Engine::threadTimes() const
+{
+    return this->poolWork->timings();
 }
 
 /**
- * @brief Maps body mass to graphical radius
- * @param in_mass Mass of body to map
+ * @brief Sums the potential of every task in task order, so the total does not depend on the number of threads
 */
-inline cot::math_t mass2rad(cot::math_t in_mass)
+static void reducePotential(const std::vector<cot::force::potential_t>& vTasks, cot::force::potential_t& out_potential)
 {
-    return 20.0f * std::log((in_mass / 2.0f) + 1.0f);
+    out_potential = cot::force::potential_t();
+    for (const auto& cTask : vTasks)
+    {
+        out_potential.energy += cTask.energy;
+        out_potential.virial += cTask.virial;
+    }
 }
 
-void cot::Engine::update(const cot::math_t dt)
+void cot::Engine::accelerate(const solver_t solver, const math_t* x, const math_t* y, math_t* ax, math_t* ay, 
+    force::potential_t* out_potential)
 {
-    // List of forces for each object in the system
-    std::vector<sf::Vector2f> vForces(this->vSystem.size());
+    const physics_t& phys = this->sysPhysics;
+    const std::size_t n = phys.size();
 
-    // Note position of each body in the scene for persistence history
-    for (auto& cBod : this->vSystem)
+    if (solver == SOLVER_BARNES_HUT)
     {
-        // Add new stamp
-        if (cBod.stamps < COT_PERSIST)
-            cBod.stamps++;
+        // Rebuild tree at the given positions then walk it for every body
+        const std::size_t nTasks = (n + param_targetsPerTask - 1) / param_targetsPerTask;
+        this->treeForce.build(x, y, phys.mass.data(), n);
+        if (out_potential)
+            this->vTaskPotential.assign(nTasks, force::potential_t());
+        auto fnWalk = [&](const std::size_t task, const std::size_t)
+        {
+            const std::size_t kBegin = task * param_targetsPerTask, kEnd = std::min(n, (task + 1) * param_targetsPerTask);
+            if (out_potential)
+                this->treeForce.accelerate(kBegin, kEnd, this->mTheta, this->mSoft2, ax, ay, this->vTaskPotential[task]);
+            else
+                this->treeForce.accelerate(kBegin, kEnd, this->mTheta, this->mSoft2, ax, ay);
+        };
+        this->poolWork->run(nTasks, fnWalk);
+        if (out_potential)
+            reducePotential(this->vTaskPotential, *out_potential);
+        return;
+    }
 
-        // Shift along stamp positions
-        // This is inefficient, could use start and end pointers instead
-        // Switch to virtual circular buffer
-        for (std::size_t i = (cBod.stamps - 1); i > 0; i--)
+    // Blocks of rows depend only on the number of bodies, never on the number of threads
+    // Every block sums into its own buffer, and buffers are reduced in block order
+    const std::size_t nBlocks = std::max<std::size_t>(1, std::min(param_blockMax, n / param_blockMinBodies));
+    if (nBlocks == 1)
+    {
+        // Accumulate interaction of each body combination in the scene
+        std::fill(ax, ax + n, 0.0f);
+        std::fill(ay, ay + n, 0.0f);
+        if (out_potential)
         {
-            cBod.history[i].setPosition(cBod.history[i - 1].getPosition());
+            *out_potential = force::potential_t();
+            cot::force::accumulate(x, y, phys.mass.data(), 0, n, this->mSoft2, ax, ay, *out_potential);
         }
-
-        // Persist current position of body
-        cBod.history[0].setPosition(cBod.position);
-
-        // Update persistence object colours
-        for (std::size_t i = 0; i < cBod.stamps; i++)
+        else
         {
-            cBod.history[i].setFillColor(sf::Color(255, 255, 255, 255 * (cBod.stamps - i - 1) / cBod.stamps));
+            cot::force::accumulate(x, y, phys.mass.data(), 0, n, this->mSoft2, ax, ay);
         }
+        return;
     }
 
-    // Loop through each body combination in the scene
-    for (std::size_t i = 0; i < this->vSystem.size(); i++)
+    // Split rows so that every block holds about the same number of pairs
+    // Block k only touches bodies below its last row, so its buffer ends there
+    this->vBlockRows.resize(nBlocks + 1);
+    this->vBlockOffsets.resize(nBlocks + 1);
+    this->vBlockOffsets[0] = 0;
+    for (std::size_t k = 0; k <= nBlocks; k++)
+    {
+        this->vBlockRows[k] = static_cast<std::size_t>(n * std::sqrt(static_cast<double>(k) / nBlocks));
+        if (k > 0)
+            this->vBlockOffsets[k] = this->vBlockOffsets[k - 1] + this->vBlockRows[k];
+    }
+    this->vBlockRows[nBlocks] = n;
+    this->vBlockOffsets[nBlocks] = this->vBlockOffsets[nBlocks - 1] + n;
+    this->vBlockAx.resize(this->vBlockOffsets[nBlocks]);
+    this->vBlockAy.resize(this->vBlockOffsets[nBlocks]);
+    if (out_potential)
+        this->vTaskPotential.assign(nBlocks, force::potential_t());
+
+    auto fnBlock = [&](const std::size_t k, const std::size_t)
+    {
+        math_t* bx = this->vBlockAx.data() + this->vBlockOffsets[k];
+        math_t* by = this->vBlockAy.data() + this->vBlockOffsets[k];
+        std::fill(bx, bx + this->vBlockRows[k + 1], 0.0f);
+        std::fill(by, by + this->vBlockRows[k + 1], 0.0f);
+        if (out_potential)
+            cot::force::accumulate(x, y, phys.mass.data(), this->vBlockRows[k], this->vBlockRows[k + 1], 
+                this->mSoft2, bx, by, this->vTaskPotential[k]);
+        else
+            cot::force::accumulate(x, y, phys.mass.data(), this->vBlockRows[k], this->vBlockRows[k + 1], 
+                this->mSoft2, bx, by);
+    };
+    this->poolWork->run(nBlocks, fnBlock);
+    if (out_potential)
+        reducePotential(this->vTaskPotential, *out_potential);
+
+    // Fixed order reduction of the block buffers
+    this->forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
     {
-        for (std::size_t j = 0; j < i; j++)
+        for (std::size_t i = iBegin; i < iEnd; i++)
         {
-            // Calculate force interaction between the 2 bodies
-            std::pair<sf::Vector2f, sf::Vector2f> vForcePair = force2(std::make_pair(this->vSystem[i], this->vSystem[j]));
+            math_t sx = 0.0f, sy = 0.0f;
+            for (std::size_t k = 0; k < nBlocks; k++)
+            {
+                if (i < this->vBlockRows[k + 1])
+                {
+                    sx += this->vBlockAx[this->vBlockOffsets[k] + i];
+                    sy += this->vBlockAy[this->vBlockOffsets[k] + i];
+                }
+            }
+            ax[i] = sx;
+            ay[i] = sy;
+        }
+    });
+}
+
+void cot::Engine::accelerate(const math_t* x, const math_t* y, math_t* ax, math_t* ay)
+{
+    // Evaluations at the current positions give the potential for diagnostics as well
+    const bool bPotential = this->bDiagnostics && (x == this->sysPhysics.x.data());
+    this->accelerate(this->eSolver, x, y, ax, ay, (bPotential ? &this->potLast : nullptr));
+    this->bPotentialFresh = this->bPotentialFresh || bPotential;
+    this->nEvaluations++;
+}
+
+void cot::Engine::accelerate(const std::uint32_t* targets, const std::size_t count, const math_t* x, const math_t* y, 
+    math_t* ax, math_t* ay)
+{
+    const physics_t& phys = this->sysPhysics;
+    const std::size_t n = phys.size();
 
-            // Add force interaction to the system force vector
-            vForces[i].x += vForcePair.first.x;     vForces[i].y += vForcePair.first.y;
-            vForces[j].x += vForcePair.second.x;    vForces[j].y += vForcePair.second.y;
+    // Symmetric summation of every pair is cheaper once about half of the bodies are targets
+    if ((this->eSolver == SOLVER_DIRECT) && (2 * count >= n))
+    {
+        this->accelerate(x, y, ax, ay);
+        return;
+    }
+
+    // Barnes-Hut tree is rebuilt at the given positions, but only walked for targets
+    // Walks of every body at the current positions give the potential for diagnostics as well
+    const std::size_t nTasks = (count + param_activePerTask - 1) / param_activePerTask;
+    const bool bPotential = this->bDiagnostics && (this->eSolver == SOLVER_BARNES_HUT) && (count == n) && (x == phys.x.data());
+    if (this->eSolver == SOLVER_BARNES_HUT)
+        this->treeForce.build(x, y, phys.mass.data(), n);
+    if (bPotential)
+        this->vTaskPotential.assign(nTasks, force::potential_t());
+    auto fnTargets = [&](const std::size_t task, const std::size_t)
+    {
+        const std::size_t kBegin = task * param_activePerTask, kEnd = std::min(count, (task + 1) * param_activePerTask);
+        if (bPotential)
+        {
+            this->treeForce.accelerate(targets + kBegin, kEnd - kBegin, x, y, phys.mass.data(), this->mTheta, this->mSoft2, 
+                ax, ay, this->vTaskPotential[task]);
+            return;
         }
+        if (this->eSolver == SOLVER_BARNES_HUT)
+        {
+            this->treeForce.accelerate(targets + kBegin, kEnd - kBegin, x, y, this->mTheta, this->mSoft2, ax, ay);
+            return;
+        }
+        for (std::size_t k = kBegin; k < kEnd; k++)
+            cot::force::attract(x, y, phys.mass.data(), n, targets[k], this->mSoft2, ax[targets[k]], ay[targets[k]]);
+    };
+    this->poolWork->run(nTasks, fnTargets);
+    if (bPotential)
+    {
+        reducePotential(this->vTaskPotential, this->potLast);
+        this->bPotentialFresh = true;
     }
+    this->nEvaluations++;
+}
+
+cot::math_t* cot::Engine::scratch(const std::size_t k)
+{
+    if (this->vScratch.size() <= k)
+        this->vScratch.resize(k + 1);
+    this->vScratch[k].resize(this->sysPhysics.size());
+    return this->vScratch[k].data();
+}
 
-    // Loop through each body in the scene
-    for (std::size_t i = 0; i < this->vSystem.size(); i++)
+void cot::Engine::setTrail(const std::size_t length, const math_t spacing)
+{
+    this->trlHistory.setLength(length);
+    this->trlHistory.setSpacing(spacing);
+}
+
+void cot::Engine::setLod(const float zoom)
+{
+    this->mLodZoom = zoom;
+}
+
+void cot::Engine::setPredictor(Predictor* pred)
+{
+    this->pPredictor = pred;
+}
+
+void cot::Engine::setIntegrator(const integrator_t integ)
+{
+    this->eIntegrator = integ;
+    switch (integ)
     {
-        // Calculate position movement due to velocity
-        this->vSystem[i].position.x += this->vSystem[i].velocity.x * dt;
-        this->vSystem[i].position.y += this->vSystem[i].velocity.y * dt;
+    case INTEGRATOR_LEAPFROG:
+        this->pIntegrate = &integrator::Leapfrog::step<Engine>;
+        break;
+    case INTEGRATOR_YOSHIDA4:
+        this->pIntegrate = &integrator::Yoshida4::step<Engine>;
+        break;
+    case INTEGRATOR_RK4:
+        this->pIntegrate = &integrator::RK4::step<Engine>;
+        break;
+    case INTEGRATOR_RKF45:
+        this->pIntegrate = &integrator::RKF45::step<Engine>;
+        break;
+    case INTEGRATOR_BLOCK:
+        this->pIntegrate = &integrator::Block::step<Engine>;
+        break;
+    default:
+        this->pIntegrate = &integrator::Euler::step<Engine>;
+        break;
+    }
+
+    // Start afresh with the new method
+    this->bAccelValid = false;
+    this->mAdaptiveDt = 0.0f;
+    this->vLevelCounts.clear();
+}
+
+void cot::Engine::setTolerance(const math_t tol)
+{
+    this->mTolerance = tol;
+}
+
+std::uint64_t cot::Engine::evaluations() const
+{
+    return this->nEvaluations;
+}
 
-        // Calculate next velocity based on force
-        this->vSystem[i].velocity.x += vForces[i].x * dt / this->vSystem[i].mass;
-        this->vSystem[i].velocity.y += vForces[i].y * dt / this->vSystem[i].mass;
+const std::vector<std::size_t>& cot::Engine::levels() const
+{
+    return this->vLevelCounts;
+}
 
-        // Update force angle
-        math_t forceVectorAngle = forceAngle(vForces[i]);
+void cot::Engine::setDiagnostics(const bool enable)
+{
+    this->bDiagnostics = enable;
+    this->bPotentialFresh = false;
+    this->bEnergyRef = false;
+    this->vDrift.clear();
+    this->diagLast = diagnostics_t();
+}
 
-        // Update position from body object to circle shape
-        this->vSystem[i].planet.setPosition(this->vSystem[i].position);
+const cot::diagnostics_t& cot::Engine::diagnostics() const
+{
+    return this->diagLast;
+}
 
-        // Transform arrow to face the force vector
-        this->vSystem[i].arrow.setRotation(forceVectorAngle * 180.0f / M_PI);
+const std::vector<double>& cot::Engine::driftSeries() const
+{
+    return this->vDrift;
+}
 
-        // Place arrow on the edge of the mass
-        this->vSystem[i].arrow.setPosition(this->vSystem[i].position);
-        this->vSystem[i].arrow.move(
-            this->vSystem[i].planet.getRadius() * std::cos(forceVectorAngle), 
-            this->vSystem[i].planet.getRadius() * std::sin(forceVectorAngle));
+const cot::diagnostics_t& cot::Engine::presented() const
+{
+    return this->bufFrames.front().diag;
+}
+
+void cot::Engine::diagnose()
+{
+    physics_t& phys = this->sysPhysics;
+
+    // Potential of the last evaluation is only at the final positions if it happened this update and nothing moved since
+    if (!this->bAccelValid || !this->bPotentialFresh)
+    {
+        this->accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+        this->bAccelValid = true;
     }
+
+    // Kinetic energy and momentum in one pass, in body order
+    double kinetic = 0.0, px = 0.0, py = 0.0, angular = 0.0;
+    for (std::size_t i = 0; i < phys.size(); i++)
+    {
+        const double m = phys.mass[i], vx = phys.vx[i], vy = phys.vy[i];
+        kinetic += 0.5 * m * (vx * vx + vy * vy);
+        px += m * vx;
+        py += m * vy;
+        angular += m * (static_cast<double>(phys.x[i]) * vy - static_cast<double>(phys.y[i]) * vx);
+    }
+
+    diagnostics_t& diag = this->diagLast;
+    diag.valid = true;
+    diag.kinetic = kinetic;
+    diag.potential = this->potLast.energy;
+    diag.virial = this->potLast.virial;
+    diag.px = px;
+    diag.py = py;
+    diag.angular = angular;
+
+    // Drift is relative to the energy after the first diagnosed update
+    const double energy = diag.kinetic + diag.potential;
+    if (!this->bEnergyRef)
+    {
+        this->mEnergyRef = energy;
+        this->bEnergyRef = true;
+    }
+    diag.drift = (this->mEnergyRef != 0.0 ? (energy - this->mEnergyRef) / std::abs(this->mEnergyRef) : 0.0);
+    if (this->vDrift.size() == this->vDrift.capacity())
+        this->vDrift.reserve(this->vDrift.size() + std::max(this->vDrift.size(), param_driftBlock));
+    this->vDrift.push_back(diag.drift);
 }
 
-void cot::Engine::draw(sf::RenderWindow& wind)
+cot::solver_error_t cot::Engine::solverError()
 {
-    // Loop through each body in the system
-    for (auto& cBod : this->vSystem)
+    const physics_t& phys = this->sysPhysics;
+    std::vector<math_t> vRefX(phys.size()), vRefY(phys.size()), vAx(phys.size()), vAy(phys.size());
+    this->accelerate(SOLVER_DIRECT, phys.x.data(), phys.y.data(), vRefX.data(), vRefY.data(), nullptr);
+    this->accelerate(this->eSolver, phys.x.data(), phys.y.data(), vAx.data(), vAy.data(), nullptr);
+
+    // Compare magnitude of the acceleration error against the reference of each body
+    solver_error_t err = { 0.0f, 0.0f };
+    double sum = 0.0;
+    for (std::size_t i = 0; i < vRefX.size(); i++)
     {
-        // Draw objects
-        wind.draw(cBod.planet);
-        wind.draw(cBod.arrow);
+        math_t mRef = std::sqrt(vRefX[i] * vRefX[i] + vRefY[i] * vRefY[i]);
+        math_t mErr = std::sqrt((vAx[i] - vRefX[i]) * (vAx[i] - vRefX[i]) + (vAy[i] - vRefY[i]) * (vAy[i] - vRefY[i]));
+        math_t mRel = (mRef > 0.0f ? mErr / mRef : 0.0f);
+        sum += static_cast<double>(mRel) * mRel;
+        err.max = std::max(err.max, mRel);
+    }
+    if (!vRefX.empty())
+        err.rms = static_cast<math_t>(std::sqrt(sum / vRefX.size()));
+
+    return err;
+}
+
+void cot::Engine::update(const cot::math_t dt)
+{
+    this->poolWork->resetTimings();
+    this->bPotentialFresh = false;
+
+    // Advance position and velocity of each body with the selected integrator, small systems on an engine of their size
+    if (!this->integrateFixed(dt))
+        this->pIntegrate(*this, dt);
+
+    // Merge bodies that touch after the step
+    if (this->bCollisions)
+        this->collide();
+
+    // Energy and momentum of the new state
+    if (this->bDiagnostics)
+        this->diagnose();
+
+    // Advance clock and hand the new state to the renderer
+    this->mTime += dt;
+    this->nSteps++;
+    this->nGeneration++;
+    this->publishFrame();
+}
+
+cot::math_t cot::Engine::time() const
+{
+    return this->mTime;
+}
+
+std::uint64_t cot::Engine::steps() const
+{
+    return this->nSteps;
+}
 
-        // Draw persistence history
-        for (std::size_t i = 0; i < cBod.stamps; i++)
-            wind.draw(cBod.history[i]);
+void cot::Engine::publishFrame()
+{
+    // Assignment reuses the capacity of the slot
+    frame_t& frame = this->bufFrames.back();
+    frame.x.assign(this->sysPhysics.x.begin(), this->sysPhysics.x.end());
+    frame.y.assign(this->sysPhysics.y.begin(), this->sysPhysics.y.end());
+    frame.vx.assign(this->sysPhysics.vx.begin(), this->sysPhysics.vx.end());
+    frame.vy.assign(this->sysPhysics.vy.begin(), this->sysPhysics.vy.end());
+    frame.ax.assign(this->sysPhysics.ax.begin(), this->sysPhysics.ax.end());
+    frame.ay.assign(this->sysPhysics.ay.begin(), this->sysPhysics.ay.end());
+    frame.mass.assign(this->sysPhysics.mass.begin(), this->sysPhysics.mass.end());
+    if (frame.layout != this->nLayout)
+    {
+        frame.id.assign(this->vIds.begin(), this->vIds.end());
+        frame.name.assign(this->vNames.begin(), this->vNames.end());
+        frame.layout = this->nLayout;
     }
+    frame.step = this->nSteps;
+    frame.time = this->mTime;
+    frame.cut = false;
+    frame.generation = this->nGeneration;
+    frame.diag = this->diagLast;
+    this->bufFrames.publish();
 }
 
-void cot::Engine::addBody(std::string in_name, math_t in_mass, sf::Vector2f init_pos, sf::Vector2f init_vel)
+void cot::Engine::present(const frame_t& in_frame)
 {
-    // Create body based on mass and initial data
-    body_t newBod;
-    newBod.mass = in_mass;
-    newBod.position = init_pos;
-    newBod.velocity = init_vel;
-    newBod.name = in_name;
+    // Assignment reuses the capacity of the slot
+    this->bufFrames.back() = in_frame;
+    this->bufFrames.publish();
+}
 
-    // Setup body graphics object
-    newBod.planet.setFillColor(sf::Color::Yellow);
-    cot::math_t radius = mass2rad(in_mass);
-    newBod.planet.setRadius(radius);
-    newBod.planet.setOrigin(radius, radius);
+void cot::Engine::draw(sf::RenderTarget& wind)
+{
+    // Take the latest frame published by update
+    this->bufFrames.acquire();
+    const frame_t& frame = this->bufFrames.front();
+    const std::size_t n = frame.x.size();
 
-    // Setup force vector arrow object
-    newBod.arrow.setPointCount(7);
-    newBod.arrow.setPoint(0, sf::Vector2f(0.0f, -1.0f));
-    newBod.arrow.setPoint(1, sf::Vector2f(4.0f, -1.0f));
-    newBod.arrow.setPoint(2, sf::Vector2f(4.0f, -3.0f));
-    newBod.arrow.setPoint(3, sf::Vector2f(6.0f, 0.0f));
-    newBod.arrow.setPoint(4, sf::Vector2f(4.0f, 3.0f));
-    newBod.arrow.setPoint(5, sf::Vector2f(4.0f, 1.0f));
-    newBod.arrow.setPoint(6, sf::Vector2f(0.0f, 1.0f));
-    newBod.arrow.setOrigin(0.0f, 0.0f);
-    newBod.arrow.setScale(5.0f, 5.0f);
+    // Stamp persistence history once per new frame, then draw it behind the bodies
+    {
+        metrics::Zone zone(metrics::PHASE_TRAILS);
+        if (frame.step != this->nLastStamp)
+        {
+            if (frame.cut)
+                this->trlHistory.clear();
+            this->trlHistory.append(frame.id.data(), frame.x.data(), frame.y.data(), n);
+            this->nLastStamp = frame.step;
+        }
+        this->trlHistory.draw(wind);
 
-    // Setup persistence history vertices
-    for (std::size_t i = 0; i < COT_PERSIST; i++)
+        // Predicted paths continue on from the history
+        if (this->pPredictor)
+            this->pPredictor->draw(wind, this->latest());
+    }
+
+    // Visible region of the current view
+    const sf::View& view = wind.getView();
+    const float viewL = view.getCenter().x - view.getSize().x * 0.5f, viewR = view.getCenter().x + view.getSize().x * 0.5f;
+    const float viewT = view.getCenter().y - view.getSize().y * 0.5f, viewB = view.getCenter().y + view.getSize().y * 0.5f;
+    const float pixelsPerUnit = static_cast<float>(wind.getSize().x) / std::max(view.getSize().x, 1e-6f);
+
+    // Zoomed out, bodies too small to see are splatted into one texture rather than drawn one by one
+    const bool bLod = (this->mLodZoom > 0.0f) && (pixelsPerUnit < this->mLodZoom);
+    const float maxLodRadius = (bLod ? param_lodRadius / pixelsPerUnit : 0.0f);
+
+    // Radius only changes with mass, and only bodies at least maxLodRadius across are drawn one by one
+    if (this->sysRender.size() != n)
+        this->sysRender.resize(n, render_t{ -1.0f, 0.0f });
+    std::size_t nLarge = 0;
+    for (std::size_t i = 0; i < n; i++)
     {
-        newBod.history[i].setFillColor(sf::Color::White);
-        newBod.history[i].setRadius(1);
+        if (this->sysRender[i].mass != frame.mass[i])
+        {
+            this->sysRender[i].mass = frame.mass[i];
+            this->sysRender[i].radius = static_cast<float>(mass2rad(frame.mass[i]));
+        }
+        nLarge += (this->sysRender[i].radius >= maxLodRadius ? 1 : 0);
     }
-    newBod.stamps = 0;
+    if (bLod)
+        this->mapDensity.draw(wind, frame.x.data(), frame.y.data(), frame.mass.data(), this->sysRender.data(), n, maxLodRadius);
+
+    // Size buffers for the worst case, trimmed to what was written afterwards
+    this->vaPlanets.resize(nLarge * 3 * param_planetSegments);
+    this->vaArrows.resize(nLarge * 3 * param_arrowTriangles);
+    std::size_t nPlanetVertices = 0, nArrowVertices = 0;
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        const float px = static_cast<float>(frame.x[i]), py = static_cast<float>(frame.y[i]);
+        const float radius = this->sysRender[i].radius;
+        if (radius < maxLodRadius)
+            continue;
+
+        // Skip bodies whose planet and arrow lie entirely outside the view
+        const float reach = radius + param_arrowLength;
+        if ((px + reach < viewL) || (px - reach > viewR) || (py + reach < viewT) || (py - reach > viewB))
+            continue;
+
+        // Planet as a fan of triangles, with fewer segments when small on screen
+        const std::size_t stride = (radius * pixelsPerUnit < param_smallPlanet ? param_planetSegments / 4 : 1);
+        const sf::Vector2f vCentre(px, py);
+        for (std::size_t k = 0; k < param_planetSegments; k += stride)
+        {
+            const std::size_t kNext = (k + stride) % param_planetSegments;
+            this->vaPlanets[nPlanetVertices++] = sf::Vertex(vCentre, sf::Color::Yellow);
+            this->vaPlanets[nPlanetVertices++] = sf::Vertex(sf::Vector2f(px + radius * unitCircle(k).x, py + radius * unitCircle(k).y), sf::Color::Yellow);
+            this->vaPlanets[nPlanetVertices++] = sf::Vertex(sf::Vector2f(px + radius * unitCircle(kNext).x, py + radius * unitCircle(kNext).y), sf::Color::Yellow);
+        }
 
-    // Add new body to vector
-    this->vSystem.push_back(newBod);
+        // Arrow along the unit acceleration vector, starting on the edge of the mass
+        const float mAx = static_cast<float>(frame.ax[i]), mAy = static_cast<float>(frame.ay[i]);
+        const float mAccel = std::sqrt(mAx * mAx + mAy * mAy);
+        if (mAccel <= 0.0f)
+            continue;
+        const float c = mAx / mAccel, s = mAy / mAccel;
+        const float ox = px + radius * c, oy = py + radius * s;
+        for (std::size_t k = 0; k < 3 * param_arrowTriangles; k++)
+        {
+            const sf::Vector2f& p = arrowShape[k];
+            this->vaArrows[nArrowVertices++] = sf::Vertex(
+                sf::Vector2f(ox + param_arrowScale * (p.x * c - p.y * s), oy + param_arrowScale * (p.x * s + p.y * c)), sf::Color::White);
+        }
+    }
+
+    // Draw objects
+    this->vaPlanets.resize(nPlanetVertices);
+    this->vaArrows.resize(nArrowVertices);
+    wind.draw(this->vaPlanets);
+    wind.draw(this->vaArrows);
 }
 
-std::vector<cot::state_t> cot::Engine::publish()
+cot::body_handle_t cot::Engine::addBody(std::string in_name, math_t in_mass, vector_t init_pos, vector_t init_vel)
 {
-    std::vector<cot::state_t> vOut;
-    cot::state_t cState;
+    // Add physical state of body based on mass and initial data
+    this->sysPhysics.x.push_back(init_pos.x);
+    this->sysPhysics.y.push_back(init_pos.y);
+    this->sysPhysics.vx.push_back(init_vel.x);
+    this->sysPhysics.vy.push_back(init_vel.y);
+    this->sysPhysics.mass.push_back(in_mass);
+    this->sysPhysics.ax.push_back(0.0f);
+    this->sysPhysics.ay.push_back(0.0f);
+    this->vNames.push_back(this->intern(in_name));
+    this->vIds.push_back(this->nNextId++);
+    this->vRadius.push_back(mass2rad(in_mass));
+    const body_handle_t handle = this->acquireSlot(static_cast<std::uint32_t>(this->vSlots.size()));
+    this->vSlots.push_back(handle.slot);
+    this->invalidateBodies();
+    return handle;
+}
 
-    for (const auto& cBody : this->vSystem)
+void cot::Engine::addBodies(const catalog_t& in_catalog, std::vector<body_handle_t>* out_handles)
+{
+    // Append each array once instead of growing every array per body
+    physics_t& phys = this->sysPhysics;
+    const std::size_t nFirst = phys.size();
+    const std::size_t n = nFirst + in_catalog.size();
+    phys.x.insert(phys.x.end(), in_catalog.x.begin(), in_catalog.x.end());
+    phys.y.insert(phys.y.end(), in_catalog.y.begin(), in_catalog.y.end());
+    phys.vx.insert(phys.vx.end(), in_catalog.vx.begin(), in_catalog.vx.end());
+    phys.vy.insert(phys.vy.end(), in_catalog.vy.begin(), in_catalog.vy.end());
+    phys.mass.insert(phys.mass.end(), in_catalog.mass.begin(), in_catalog.mass.end());
+    phys.ax.resize(n, 0.0f);
+    phys.ay.resize(n, 0.0f);
+    this->vIds.reserve(n);
+    this->vRadius.reserve(n);
+    this->vNames.reserve(n);
+    this->vSlots.reserve(n);
+    if (out_handles)
+        out_handles->resize(in_catalog.size());
+    for (std::size_t i = 0; i < in_catalog.size(); i++)
     {
-        cState.mass = cBody.mass;
-        cState.name = cBody.name;
-        cState.position = cBody.position;
-        cState.velocity = cBody.velocity;
-        vOut.push_back(cState);
+        this->vNames.push_back(this->intern(in_catalog.name[i]));
+        this->vIds.push_back(this->nNextId++);
+        this->vRadius.push_back(mass2rad(in_catalog.mass[i]));
+        const body_handle_t handle = this->acquireSlot(static_cast<std::uint32_t>(nFirst + i));
+        this->vSlots.push_back(handle.slot);
+        if (out_handles)
+            (*out_handles)[i] = handle;
     }
+    this->invalidateBodies();
+}
+
+std::uint32_t cot::Engine::intern(const std::string& in_name)
+{
+    auto itName = this->mapNames.find(in_name);
+    if (itName != this->mapNames.end())
+        return itName->second;
+    this->vNameTable.push_back(in_name);
+    this->mapNames.emplace(in_name, static_cast<std::uint32_t>(this->vNameTable.size() - 1));
+    return static_cast<std::uint32_t>(this->vNameTable.size() - 1);
+}
+
+cot::snapshot_t cot::Engine::snapshot() const
+{
+    const physics_t& phys = this->sysPhysics;
+    return snapshot_t{ phys.size(), phys.x.data(), phys.y.data(), phys.vx.data(), phys.vy.data(), phys.mass.data(),
+        this->vIds.data(), this->vNames.data(), this->nSteps, this->mTime, this->nGeneration, this->nLayout };
+}
 
-    return vOut;
+cot::snapshot_t cot::Engine::latest() const
+{
+    const frame_t& frame = this->bufFrames.front();
+    return snapshot_t{ frame.x.size(), frame.x.data(), frame.y.data(), frame.vx.data(), frame.vy.data(), frame.mass.data(),
+        frame.id.data(), frame.name.data(), frame.step, frame.time, frame.generation, frame.layout };
 }
 
+const std::string& cot::Engine::nameOf(const std::uint32_t name) const
+{
+    static const std::string sUnknown;
+    return (name < this->vNameTable.size() ? this->vNameTable[name] : sUnknown);
+}
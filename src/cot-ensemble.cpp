@@ -0,0 +1,180 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+/**
+ * @brief Total energy of a system and the number of bodies unbound from the rest of it
+ * @param soft2 Square of the Plummer softening length, the potential matches the softened force
+*/
+static void summarise(const cot::snapshot_t& snap, const cot::math_t soft2, double& out_energy, std::size_t& out_escapes)
+{
+    // Velocity of the centre of mass, which escapes are measured against
+    double mTotal = 0.0, px = 0.0, py = 0.0;
+    for (std::size_t i = 0; i < snap.count; i++)
+    {
+        mTotal += snap.mass[i];
+        px += static_cast<double>(snap.mass[i]) * snap.vx[i];
+        py += static_cast<double>(snap.mass[i]) * snap.vy[i];
+    }
+    const double cvx = (mTotal > 0.0 ? px / mTotal : 0.0);
+    const double cvy = (mTotal > 0.0 ? py / mTotal : 0.0);
+
+    // Potential of each body from every other body, summed once per pair
+    std::vector<double> vPotential(snap.count, 0.0);
+    double e = 0.0;
+    for (std::size_t i = 0; i < snap.count; i++)
+    {
+        e += 0.5 * snap.mass[i] * (static_cast<double>(snap.vx[i]) * snap.vx[i] + static_cast<double>(snap.vy[i]) * snap.vy[i]);
+        for (std::size_t j = 0; j < i; j++)
+        {
+            const double dx = static_cast<double>(snap.x[i]) - snap.x[j];
+            const double dy = static_cast<double>(snap.y[i]) - snap.y[j];
+            const double r2 = dx * dx + dy * dy + soft2;
+            if (r2 <= 0.0)
+                continue;
+            const double inv = cot::force::gravity / std::sqrt(r2);
+            vPotential[i] -= inv * snap.mass[j];
+            vPotential[j] -= inv * snap.mass[i];
+            e -= inv * snap.mass[i] * snap.mass[j];
+        }
+    }
+
+    // Bodies whose own energy in the frame of the centre of mass is positive never return
+    out_escapes = 0;
+    for (std::size_t i = 0; i < snap.count; i++)
+    {
+        const double dvx = snap.vx[i] - cvx, dvy = snap.vy[i] - cvy;
+        if (0.5 * (dvx * dvx + dvy * dvy) + vPotential[i] > 0.0)
+            out_escapes++;
+    }
+    out_energy = e;
+}
+
+/**
+ * @brief Perturbs the initial conditions of a catalog with draws of its own run
+*/
+static void perturb(cot::catalog_t& cat, const cot::ensemble::spec_t& spec, const std::size_t run)
+{
+    // Every run seeds its own generator, so its draws do not depend on which thread runs it or when
+    std::seed_seq seq{ static_cast<std::uint32_t>(spec.seed), static_cast<std::uint32_t>(spec.seed >> 32),
+        static_cast<std::uint32_t>(run), static_cast<std::uint32_t>(static_cast<std::uint64_t>(run) >> 32) };
+    std::mt19937_64 rng(seq);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    for (std::size_t i = 0; i < cat.size(); i++)
+    {
+        cat.x[i] += static_cast<cot::math_t>(spec.position * normal(rng));
+        cat.y[i] += static_cast<cot::math_t>(spec.position * normal(rng));
+        const double speed = std::sqrt(static_cast<double>(cat.vx[i]) * cat.vx[i] + static_cast<double>(cat.vy[i]) * cat.vy[i]);
+        cat.vx[i] += static_cast<cot::math_t>(spec.velocity * speed * normal(rng));
+        cat.vy[i] += static_cast<cot::math_t>(spec.velocity * speed * normal(rng));
+        cat.mass[i] *= static_cast<cot::math_t>(std::max(0.0, 1.0 + spec.mass * normal(rng)));
+    }
+}
+
+bool cot::ensemble::run(std::shared_ptr<spdlog::logger> logger, const catalog_t& in_base, const spec_t& spec, const std::string& path)
+{
+    const std::size_t nRuns = spec.runs, nBodies = in_base.size();
+    const math_t soft2 = spec.softening * spec.softening;
+    logger->info("Running an ensemble of {0:d} runs of {1:d} bodies for {2:d} steps on {3:d} threads.", nRuns, nBodies, spec.steps, spec.threads);
+
+    // Columns are sized up front and every run only writes its own entries
+    std::vector<double> vMetrics(METRIC_COUNT * nRuns, 0.0);
+    std::vector<double> vStates(STATE_COUNT * nRuns * nBodies, 0.0);
+    auto fnRun = [&](const std::size_t run, const std::size_t)
+    {
+        auto tBegin = std::chrono::steady_clock::now();
+
+        // Every run owns its catalog and its engine, which runs on this thread alone
+        catalog_t cat = in_base;
+        if (run > 0)
+            perturb(cat, spec, run);
+        Engine eng;
+        eng.setSoftening(spec.softening);
+        eng.setSolver(spec.solver, spec.theta);
+        eng.setIntegrator(spec.integrator);
+        eng.setTolerance(spec.tolerance);
+        eng.setCollisions(spec.collisions);
+        eng.addBodies(cat);
+
+        double e0, e1;
+        std::size_t nEscapes;
+        summarise(eng.snapshot(), soft2, e0, nEscapes);
+        for (std::uint64_t step = 0; step < spec.steps; step++)
+            eng.update(spec.dt);
+        const snapshot_t snap = eng.snapshot();
+        summarise(snap, soft2, e1, nEscapes);
+
+        std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+        vMetrics[METRIC_ENERGY_BEGIN * nRuns + run] = e0;
+        vMetrics[METRIC_ENERGY_END * nRuns + run] = e1;
+        vMetrics[METRIC_DRIFT * nRuns + run] = (e0 != 0.0 ? (e1 - e0) / std::abs(e0) : 0.0);
+        vMetrics[METRIC_ESCAPES * nRuns + run] = static_cast<double>(nEscapes);
+        vMetrics[METRIC_MERGES * nRuns + run] = static_cast<double>(eng.merges());
+        vMetrics[METRIC_EVALUATIONS * nRuns + run] = static_cast<double>(eng.evaluations());
+        vMetrics[METRIC_SECONDS * nRuns + run] = tElapsed.count();
+
+        // Engine identifiers are the catalog rows, survivors of merges keep theirs
+        for (std::size_t i = 0; i < snap.count; i++)
+        {
+            const std::size_t k = run * nBodies + snap.id[i];
+            vStates[STATE_X * nRuns * nBodies + k] = snap.x[i];
+            vStates[STATE_Y * nRuns * nBodies + k] = snap.y[i];
+            vStates[STATE_VX * nRuns * nBodies + k] = snap.vx[i];
+            vStates[STATE_VY * nRuns * nBodies + k] = snap.vy[i];
+            vStates[STATE_MASS * nRuns * nBodies + k] = snap.mass[i];
+        }
+    };
+    auto tBegin = std::chrono::steady_clock::now();
+    {
+        ThreadPool poolRuns(spec.threads);
+        poolRuns.run(nRuns, fnRun);
+    }
+    std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+
+    // Spread of the outcomes over every run
+    double mDrift = 0.0, mEscapes = 0.0, mMerges = 0.0;
+    for (std::size_t run = 0; run < nRuns; run++)
+    {
+        mDrift = std::max(mDrift, std::abs(vMetrics[METRIC_DRIFT * nRuns + run]));
+        mEscapes += vMetrics[METRIC_ESCAPES * nRuns + run];
+        mMerges += vMetrics[METRIC_MERGES * nRuns + run];
+    }
+    const double rate = (tElapsed.count() > 0.0 ? nRuns / tElapsed.count() : 0.0);
+    logger->info("Ran {0:d} runs in {1:.3f} sec, {2:.1f} runs/sec, {3:.1f} steps/sec.", nRuns, tElapsed.count(), rate, rate * spec.steps);
+    logger->info("Largest energy drift {0:.3e}, {1:.0f} escapes and {2:.0f} merges over every run.", mDrift, mEscapes, mMerges);
+
+    header_t header;
+    header.magic = magic;
+    header.version = version;
+    header.runs = nRuns;
+    header.bodies = nBodies;
+    header.metrics = METRIC_COUNT;
+    header.states = STATE_COUNT;
+    header.seed = spec.seed;
+    header.steps = spec.steps;
+    header.dt = spec.dt;
+    header.position = spec.position;
+    header.velocity = spec.velocity;
+    header.mass = spec.mass;
+
+    std::FILE* fOut = std::fopen(path.c_str(), "wb");
+    if (!fOut)
+    {
+        logger->error("Unable to create ensemble file '{0}'.", path);
+        return false;
+    }
+    bool bOk = (std::fwrite(&header, sizeof(header), 1, fOut) == 1);
+    bOk = bOk && (std::fwrite(vMetrics.data(), sizeof(double), vMetrics.size(), fOut) == vMetrics.size());
+    bOk = bOk && (std::fwrite(vStates.data(), sizeof(double), vStates.size(), fOut) == vStates.size());
+    bOk = (std::fclose(fOut) == 0) && bOk;
+    if (bOk)
+        logger->info("Wrote ensemble to '{0}'.", path);
+    else
+        logger->error("Unable to write ensemble file '{0}'.", path);
+    return bOk;
+}
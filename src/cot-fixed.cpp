@@ -0,0 +1,255 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <cmath>
+
+template <std::size_t N>
+template <bool TPotential, std::size_t... K>
+void cot::FixedEngine<N>::interactAll(const math_t* x, const math_t* y, math_t* ax, math_t* ay, force::potential_t& out_potential, 
+    std::index_sequence<K...>) const
+{
+    // Separation of every pair, gathered into pair order, padding is zero
+    std::array<math_t, nPairsPadded> dx = { (x[column<K>] - x[row<K>])... };
+    std::array<math_t, nPairsPadded> dy = { (y[column<K>] - y[row<K>])... };
+
+    // 1 / r^3 of every pair in one branchless pass over contiguous arrays, which vectorises
+    // Coincident bodies without softening do not interact
+    std::array<math_t, nPairsPadded> s, r2;
+    for (std::size_t k = 0; k < nPairsPadded; k++)
+    {
+        r2[k] = dx[k] * dx[k] + dy[k] * dy[k] + this->mSoft2;
+        const math_t valid = (r2[k] > 0.0f ? 1.0f : 0.0f);
+        const math_t r2Safe = r2[k] + (1.0f - valid);
+        s[k] = valid / (r2Safe * std::sqrt(r2Safe));
+    }
+
+    // Each pair factor is taken once and applied to both bodies, scaled by the gravity of the opposite body
+    const std::array<math_t, N>& gm = this->vGravityMass;
+    std::array<math_t, N> sx = {}, sy = {};
+    ((sx[row<K>] += s[K] * gm[column<K>] * dx[K],
+      sy[row<K>] += s[K] * gm[column<K>] * dy[K],
+      sx[column<K>] -= s[K] * gm[row<K>] * dx[K],
+      sy[column<K>] -= s[K] * gm[row<K>] * dy[K]), ...);
+    std::copy_n(sx.begin(), N, ax);
+    std::copy_n(sy.begin(), N, ay);
+
+    // G m_i m_j / r is the same pair factor times r^2, and r_ij . F_ij takes the unsoftened r^2
+    if (TPotential)
+    {
+        const fixed_physics_t<N>& phys = this->sysPhysics;
+        double phi = 0.0, vir = 0.0;
+        ((phi -= static_cast<double>(s[K] * r2[K]) * gm[column<K>] * phys.mass[row<K>],
+          vir -= static_cast<double>(s[K] * (r2[K] - this->mSoft2)) * gm[column<K>] * phys.mass[row<K>]), ...);
+        out_potential.energy = phi;
+        out_potential.virial = vir;
+    }
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::accelerate(const math_t* x, const math_t* y, math_t* ax, math_t* ay)
+{
+    // Potential comes with evaluations at the current positions, see Engine
+    if (this->bDiagnostics && (x == this->sysPhysics.x.data()))
+    {
+        this->interactAll<true>(x, y, ax, ay, this->potLast, std::make_index_sequence<nPairs>());
+        this->bPotentialFresh = true;
+    }
+    else
+    {
+        this->interactAll<false>(x, y, ax, ay, this->potLast, std::make_index_sequence<nPairs>());
+    }
+    this->nEvaluations++;
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::accelerate(const std::uint32_t*, const std::size_t, const math_t* x, const math_t* y, math_t* ax, math_t* ay)
+{
+    this->accelerate(x, y, ax, ay);
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::prepare()
+{
+    for (std::size_t i = 0; i < N; i++)
+        this->vGravityMass[i] = cot::force::gravity * this->sysPhysics.mass[i];
+}
+
+template <std::size_t N>
+bool cot::FixedEngine<N>::addBodies(const catalog_t& in_catalog)
+{
+    if (in_catalog.size() < N)
+        return false;
+
+    fixed_physics_t<N>& phys = this->sysPhysics;
+    std::copy_n(in_catalog.x.begin(), N, phys.x.begin());
+    std::copy_n(in_catalog.y.begin(), N, phys.y.begin());
+    std::copy_n(in_catalog.vx.begin(), N, phys.vx.begin());
+    std::copy_n(in_catalog.vy.begin(), N, phys.vy.begin());
+    std::copy_n(in_catalog.mass.begin(), N, phys.mass.begin());
+    phys.ax.fill(0.0f);
+    phys.ay.fill(0.0f);
+    for (std::size_t i = 0; i < N; i++)
+        this->vIds[i] = static_cast<std::uint32_t>(i);
+    this->prepare();
+
+    // Acceleration must be recalculated for the new bodies
+    this->bAccelValid = false;
+    return true;
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::setSoftening(const math_t eps)
+{
+    this->mSoft2 = eps * eps;
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::setIntegrator(const integrator_t integ)
+{
+    this->eIntegrator = integ;
+    switch (integ)
+    {
+    case INTEGRATOR_LEAPFROG:
+        this->pIntegrate = &integrator::Leapfrog::step<FixedEngine>;
+        break;
+    case INTEGRATOR_YOSHIDA4:
+        this->pIntegrate = &integrator::Yoshida4::step<FixedEngine>;
+        break;
+    case INTEGRATOR_RK4:
+        this->pIntegrate = &integrator::RK4::step<FixedEngine>;
+        break;
+    case INTEGRATOR_RKF45:
+        this->pIntegrate = &integrator::RKF45::step<FixedEngine>;
+        break;
+    case INTEGRATOR_BLOCK:
+        this->pIntegrate = &integrator::Block::step<FixedEngine>;
+        break;
+    default:
+        this->pIntegrate = &integrator::Euler::step<FixedEngine>;
+        break;
+    }
+
+    // Start afresh with the new method
+    this->bAccelValid = false;
+    this->mAdaptiveDt = 0.0f;
+    this->vLevelCounts.clear();
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::setTolerance(const math_t tol)
+{
+    this->mTolerance = tol;
+}
+
+template <std::size_t N>
+std::uint64_t cot::FixedEngine<N>::evaluations() const
+{
+    return this->nEvaluations;
+}
+
+template <std::size_t N>
+void cot::FixedEngine<N>::update(const math_t dt)
+{
+    this->pIntegrate(*this, dt);
+    this->mTime += dt;
+    this->nSteps++;
+}
+
+template <std::size_t N>
+cot::math_t cot::FixedEngine<N>::time() const
+{
+    return this->mTime;
+}
+
+template <std::size_t N>
+std::uint64_t cot::FixedEngine<N>::steps() const
+{
+    return this->nSteps;
+}
+
+template <std::size_t N>
+cot::snapshot_t cot::FixedEngine<N>::snapshot() const
+{
+    const fixed_physics_t<N>& phys = this->sysPhysics;
+    snapshot_t snap;
+    snap.count = N;
+    snap.x = phys.x.data();
+    snap.y = phys.y.data();
+    snap.vx = phys.vx.data();
+    snap.vy = phys.vy.data();
+    snap.mass = phys.mass.data();
+    snap.id = this->vIds.data();
+    snap.name = this->vIds.data();
+    snap.step = this->nSteps;
+    snap.time = this->mTime;
+    snap.generation = this->nSteps + 1;
+    snap.layout = 1;
+    return snap;
+}
+
+template <std::size_t N>
+void cot::Engine::stepFixed(const math_t dt)
+{
+    // State moves into fixed arrays for the step and back, a few hundred bytes either way
+    physics_t& phys = this->sysPhysics;
+    FixedEngine<N> fixed;
+    fixed.setIntegrator(this->eIntegrator);
+    fixed.mSoft2 = this->mSoft2;
+    fixed.bAccelValid = this->bAccelValid;
+    fixed.mAdaptiveDt = this->mAdaptiveDt;
+    fixed.mTolerance = this->mTolerance;
+    fixed.bDiagnostics = this->bDiagnostics;
+    std::copy_n(phys.x.begin(), N, fixed.sysPhysics.x.begin());
+    std::copy_n(phys.y.begin(), N, fixed.sysPhysics.y.begin());
+    std::copy_n(phys.vx.begin(), N, fixed.sysPhysics.vx.begin());
+    std::copy_n(phys.vy.begin(), N, fixed.sysPhysics.vy.begin());
+    std::copy_n(phys.mass.begin(), N, fixed.sysPhysics.mass.begin());
+    std::copy_n(phys.ax.begin(), N, fixed.sysPhysics.ax.begin());
+    std::copy_n(phys.ay.begin(), N, fixed.sysPhysics.ay.begin());
+    fixed.prepare();
+
+    fixed.pIntegrate(fixed, dt);
+
+    std::copy_n(fixed.sysPhysics.x.begin(), N, phys.x.begin());
+    std::copy_n(fixed.sysPhysics.y.begin(), N, phys.y.begin());
+    std::copy_n(fixed.sysPhysics.vx.begin(), N, phys.vx.begin());
+    std::copy_n(fixed.sysPhysics.vy.begin(), N, phys.vy.begin());
+    std::copy_n(fixed.sysPhysics.ax.begin(), N, phys.ax.begin());
+    std::copy_n(fixed.sysPhysics.ay.begin(), N, phys.ay.begin());
+    this->bAccelValid = fixed.bAccelValid;
+    this->mAdaptiveDt = fixed.mAdaptiveDt;
+    this->nEvaluations += fixed.nEvaluations;
+    if (fixed.bPotentialFresh)
+    {
+        this->potLast = fixed.potLast;
+        this->bPotentialFresh = true;
+    }
+}
+
+bool cot::Engine::integrateFixed(const math_t dt)
+{
+    // Block timestep levels live only in the general engine, and other solvers approximate direct summation
+    const std::size_t n = this->sysPhysics.size();
+    if ((this->eSolver != SOLVER_DIRECT) || (this->eIntegrator == INTEGRATOR_BLOCK) || (n < 2) || (n > fixedMax))
+        return false;
+
+    // Step of every size, indexed by the number of bodies
+    typedef void (Engine::*step_t)(const math_t);
+    static const step_t fixedSteps[fixedMax + 1] = {
+        nullptr,                    nullptr,                    &Engine::stepFixed<2>,      &Engine::stepFixed<3>,
+        &Engine::stepFixed<4>,      &Engine::stepFixed<5>,      &Engine::stepFixed<6>,      &Engine::stepFixed<7>,
+        &Engine::stepFixed<8>,      &Engine::stepFixed<9>,      &Engine::stepFixed<10>,     &Engine::stepFixed<11>,
+        &Engine::stepFixed<12>,     &Engine::stepFixed<13>,     &Engine::stepFixed<14>,     &Engine::stepFixed<15>,
+        &Engine::stepFixed<16>
+    };
+    (this->*fixedSteps[n])(dt);
+    return true;
+}
+
+// Engines of every size the general engine hands over
+template class cot::FixedEngine<2>;     template class cot::FixedEngine<3>;     template class cot::FixedEngine<4>;
+template class cot::FixedEngine<5>;     template class cot::FixedEngine<6>;     template class cot::FixedEngine<7>;
+template class cot::FixedEngine<8>;     template class cot::FixedEngine<9>;     template class cot::FixedEngine<10>;
+template class cot::FixedEngine<11>;    template class cot::FixedEngine<12>;    template class cot::FixedEngine<13>;
+template class cot::FixedEngine<14>;    template class cot::FixedEngine<15>;    template class cot::FixedEngine<16>;
@@ -0,0 +1,319 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <cmath>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COT_X86
+#endif
+
+/**
+ * @brief Portable kernel, also used for the remainder of the vector kernels
+ * @tparam TPotential Whether the potential energy and virial of the row are accumulated as well
+*/
+template <bool TPotential>
+static void accumulateScalar(const cot::math_t* x, const cot::math_t* y, const cot::math_t* mass, 
+    const std::size_t i, const std::size_t jBegin, const cot::math_t soft2, cot::math_t* ax, cot::math_t* ay, 
+    cot::force::potential_t& out_potential)
+{
+    cot::math_t aix = 0.0f, aiy = 0.0f, phi = 0.0f, q = 0.0f;
+    for (std::size_t j = jBegin; j < i; j++)
+    {
+        // Separation from body i to body j
+        cot::math_t dx = x[j] - x[i];
+        cot::math_t dy = y[j] - y[i];
+        cot::math_t r2 = dx * dx + dy * dy + soft2;
+
+        // Coincident bodies without softening do not interact
+        if (r2 <= 0.0f)
+            continue;
+
+        // G / r^3, then scaled by the mass of the opposite body
+        cot::math_t inv = 1.0f / std::sqrt(r2);
+        cot::math_t s = cot::force::gravity * inv * inv * inv;
+        aix += s * mass[j] * dx;    aiy += s * mass[j] * dy;
+        ax[j] -= s * mass[i] * dx;  ay[j] -= s * mass[i] * dy;
+        if (TPotential)
+        {
+            phi += s * mass[j] * r2;
+            q += s * mass[j];
+        }
+    }
+    ax[i] += aix;
+    ay[i] += aiy;
+    if (TPotential)
+    {
+        out_potential.energy -= static_cast<double>(mass[i]) * phi;
+        out_potential.virial -= static_cast<double>(mass[i]) * (static_cast<double>(phi) - static_cast<double>(soft2) * q);
+    }
+}
+
+#ifdef COT_X86
+
+// Vector kernel shared by every instruction set
+// Included once per instruction set region below with TLanes naming the lane operations of that set
+// Potential and virial lanes are only summed when TPotential, otherwise the compiler drops them
+// G m_j / r is s m_j r^2, and r_ij . F_ij is the potential less soft2 s m_i m_j, so both reuse the force factor
+#define COT_VECTOR_KERNEL(TLanes) \
+{ \
+    typedef typename TLanes::reg reg; \
+    const reg xi = TLanes::set1(x[i]), yi = TLanes::set1(y[i]), mi = TLanes::set1(mass[i]); \
+    const reg eps2 = TLanes::set1(soft2), g = TLanes::set1(cot::force::gravity); \
+    reg aix = TLanes::zero(), aiy = TLanes::zero(), phi = TLanes::zero(), q = TLanes::zero(); \
+    std::size_t j = 0; \
+    for (; j + TLanes::width <= i; j += TLanes::width) \
+    { \
+        reg dx = TLanes::sub(TLanes::load(x + j), xi); \
+        reg dy = TLanes::sub(TLanes::load(y + j), yi); \
+        reg r2 = TLanes::fmadd(dx, dx, TLanes::fmadd(dy, dy, eps2)); \
+        reg inv = TLanes::rsqrt(r2); \
+        reg s = TLanes::positive(r2, TLanes::mul(g, TLanes::mul(inv, TLanes::mul(inv, inv)))); \
+        reg sj = TLanes::mul(s, TLanes::load(mass + j)); \
+        aix = TLanes::fmadd(sj, dx, aix); \
+        aiy = TLanes::fmadd(sj, dy, aiy); \
+        reg si = TLanes::mul(s, mi); \
+        TLanes::store(ax + j, TLanes::fnmadd(si, dx, TLanes::load(ax + j))); \
+        TLanes::store(ay + j, TLanes::fnmadd(si, dy, TLanes::load(ay + j))); \
+        if (TPotential) \
+        { \
+            phi = TLanes::fmadd(sj, r2, phi); \
+            q = TLanes::add(q, sj); \
+        } \
+    } \
+    ax[i] += TLanes::sum(aix); \
+    ay[i] += TLanes::sum(aiy); \
+    if (TPotential) \
+    { \
+        const double rowPhi = TLanes::sum(phi); \
+        out_potential.energy -= static_cast<double>(mass[i]) * rowPhi; \
+        out_potential.virial -= static_cast<double>(mass[i]) * (rowPhi - static_cast<double>(soft2) * TLanes::sum(q)); \
+    } \
+    accumulateScalar<TPotential>(x, y, mass, i, j, soft2, ax, ay, out_potential); \
+}
+
+// SSE lanes of single and double precision
+typedef struct _lanes_sse_f32
+{
+    typedef __m128 reg;
+    static const std::size_t width = 4;
+    static reg set1(float v) { return _mm_set1_ps(v); }
+    static reg zero() { return _mm_setzero_ps(); }
+    static reg load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg fnmadd(reg a, reg b, reg c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    static reg rsqrt(reg v) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(v)); }
+    static reg positive(reg test, reg v) { return _mm_and_ps(_mm_cmpgt_ps(test, _mm_setzero_ps()), v); }
+    static float sum(reg v)
+    {
+        alignas(16) float l[4];
+        _mm_store_ps(l, v);
+        return (l[0] + l[1]) + (l[2] + l[3]);
+    }
+} lanes_sse_f32;
+
+typedef struct _lanes_sse_f64
+{
+    typedef __m128d reg;
+    static const std::size_t width = 2;
+    static reg set1(double v) { return _mm_set1_pd(v); }
+    static reg zero() { return _mm_setzero_pd(); }
+    static reg load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm_storeu_pd(p, v); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static reg fnmadd(reg a, reg b, reg c) { return _mm_sub_pd(c, _mm_mul_pd(a, b)); }
+    static reg rsqrt(reg v) { return _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(v)); }
+    static reg positive(reg test, reg v) { return _mm_and_pd(_mm_cmpgt_pd(test, _mm_setzero_pd()), v); }
+    static double sum(reg v)
+    {
+        alignas(16) double l[2];
+        _mm_store_pd(l, v);
+        return l[0] + l[1];
+    }
+} lanes_sse_f64;
+
+/**
+ * @brief SSE kernel for a single row
+*/
+template <bool TPotential>
+static void accumulateSSE(const cot::math_t* x, const cot::math_t* y, const cot::math_t* mass, 
+    const std::size_t i, const cot::math_t soft2, cot::math_t* ax, cot::math_t* ay, cot::force::potential_t& out_potential)
+{
+    typedef std::conditional<std::is_same<cot::math_t, float>::value, lanes_sse_f32, lanes_sse_f64>::type lanes;
+    COT_VECTOR_KERNEL(lanes)
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+// AVX2 lanes of single and double precision
+typedef struct _lanes_avx2_f32
+{
+    typedef __m256 reg;
+    static const std::size_t width = 8;
+    static reg set1(float v) { return _mm256_set1_ps(v); }
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    static reg fnmadd(reg a, reg b, reg c) { return _mm256_fnmadd_ps(a, b, c); }
+    static reg rsqrt(reg v) { return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(v)); }
+    static reg positive(reg test, reg v) { return _mm256_and_ps(_mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_GT_OQ), v); }
+    static float sum(reg v)
+    {
+        alignas(32) float l[8];
+        _mm256_store_ps(l, v);
+        return ((l[0] + l[1]) + (l[2] + l[3])) + ((l[4] + l[5]) + (l[6] + l[7]));
+    }
+} lanes_avx2_f32;
+
+typedef struct _lanes_avx2_f64
+{
+    typedef __m256d reg;
+    static const std::size_t width = 4;
+    static reg set1(double v) { return _mm256_set1_pd(v); }
+    static reg zero() { return _mm256_setzero_pd(); }
+    static reg load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, reg v) { _mm256_storeu_pd(p, v); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    static reg fnmadd(reg a, reg b, reg c) { return _mm256_fnmadd_pd(a, b, c); }
+    static reg rsqrt(reg v) { return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(v)); }
+    static reg positive(reg test, reg v) { return _mm256_and_pd(_mm256_cmp_pd(test, _mm256_setzero_pd(), _CMP_GT_OQ), v); }
+    static double sum(reg v)
+    {
+        alignas(32) double l[4];
+        _mm256_store_pd(l, v);
+        return (l[0] + l[1]) + (l[2] + l[3]);
+    }
+} lanes_avx2_f64;
+
+/**
+ * @brief AVX2 kernel for a single row
+*/
+template <bool TPotential>
+static void accumulateAVX2(const cot::math_t* x, const cot::math_t* y, const cot::math_t* mass, 
+    const std::size_t i, const cot::math_t soft2, cot::math_t* ax, cot::math_t* ay, cot::force::potential_t& out_potential)
+{
+    typedef std::conditional<std::is_same<cot::math_t, float>::value, lanes_avx2_f32, lanes_avx2_f64>::type lanes;
+    COT_VECTOR_KERNEL(lanes)
+}
+
+#pragma GCC pop_options
+
+#endif // COT_X86
+
+cot::force::isa_t cot::force::detect()
+{
+#ifdef COT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA_SSE;
+#endif
+    return ISA_SCALAR;
+}
+
+const char* cot::force::isaName(const isa_t isa)
+{
+    switch (isa)
+    {
+    case ISA_AVX2:
+        return "AVX2";
+    case ISA_SSE:
+        return "SSE";
+    default:
+        return "scalar";
+    }
+}
+
+/**
+ * @brief Runs the kernel of an instruction set over a range of rows
+*/
+template <bool TPotential>
+static void accumulateRows(const cot::math_t* x, const cot::math_t* y, const cot::math_t* mass, const std::size_t rowBegin, 
+    const std::size_t rowEnd, const cot::math_t soft2, cot::math_t* ax, cot::math_t* ay, cot::force::potential_t& out_potential, 
+    const cot::force::isa_t isa)
+{
+    for (std::size_t i = rowBegin; i < rowEnd; i++)
+    {
+        switch (isa)
+        {
+#ifdef COT_X86
+        case cot::force::ISA_AVX2:
+            accumulateAVX2<TPotential>(x, y, mass, i, soft2, ax, ay, out_potential);
+            break;
+        case cot::force::ISA_SSE:
+            accumulateSSE<TPotential>(x, y, mass, i, soft2, ax, ay, out_potential);
+            break;
+#endif
+        default:
+            accumulateScalar<TPotential>(x, y, mass, i, 0, soft2, ax, ay, out_potential);
+            break;
+        }
+    }
+}
+
+void cot::force::accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+    const math_t soft2, math_t* ax, math_t* ay, const isa_t isa)
+{
+    potential_t potUnused;
+    accumulateRows<false>(x, y, mass, rowBegin, rowEnd, soft2, ax, ay, potUnused, isa);
+}
+
+void cot::force::accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+    const math_t soft2, math_t* ax, math_t* ay)
+{
+    // Instruction set is detected once per process
+    static const isa_t isa = detect();
+    accumulate(x, y, mass, rowBegin, rowEnd, soft2, ax, ay, isa);
+}
+
+void cot::force::accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+    const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential, const isa_t isa)
+{
+    accumulateRows<true>(x, y, mass, rowBegin, rowEnd, soft2, ax, ay, out_potential, isa);
+}
+
+void cot::force::accumulate(const math_t* x, const math_t* y, const math_t* mass, const std::size_t rowBegin, const std::size_t rowEnd, 
+    const math_t soft2, math_t* ax, math_t* ay, potential_t& out_potential)
+{
+    static const isa_t isa = detect();
+    accumulate(x, y, mass, rowBegin, rowEnd, soft2, ax, ay, out_potential, isa);
+}
+
+void cot::force::attract(const math_t* x, const math_t* y, const math_t* mass, const std::size_t n, const std::size_t i, 
+    const math_t soft2, math_t& out_ax, math_t& out_ay)
+{
+    const math_t px = x[i], py = y[i];
+    math_t aix = 0.0f, aiy = 0.0f;
+    for (std::size_t j = 0; j < n; j++)
+    {
+        // Body i itself and coincident bodies without softening do not interact
+        math_t dx = x[j] - px, dy = y[j] - py;
+        math_t r2 = dx * dx + dy * dy + soft2;
+        if ((j == i) || (r2 <= 0.0f))
+            continue;
+        math_t inv = 1.0f / std::sqrt(r2);
+        math_t s = gravity * mass[j] * inv * inv * inv;
+        aix += s * dx;
+        aiy += s * dy;
+    }
+    out_ax = aix;
+    out_ay = aiy;
+}
@@ -0,0 +1,437 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Safety factor and bounds on the change of an adaptive substep
+static const cot::math_t param_adaptiveSafety = 0.9f;
+static const cot::math_t param_adaptiveShrink = 0.2f;
+static const cot::math_t param_adaptiveGrow = 5.0f;
+
+// Runge-Kutta-Fehlberg tableau
+static const double rkf_a[6][5] = {
+    { 0.0, 0.0, 0.0, 0.0, 0.0 },
+    { 1.0 / 4.0, 0.0, 0.0, 0.0, 0.0 },
+    { 3.0 / 32.0, 9.0 / 32.0, 0.0, 0.0, 0.0 },
+    { 1932.0 / 2197.0, -7200.0 / 2197.0, 7296.0 / 2197.0, 0.0, 0.0 },
+    { 439.0 / 216.0, -8.0, 3680.0 / 513.0, -845.0 / 4104.0, 0.0 },
+    { -8.0 / 27.0, 2.0, -3544.0 / 2565.0, 1859.0 / 4104.0, -11.0 / 40.0 }
+};
+static const double rkf_b5[6] = { 16.0 / 135.0, 0.0, 6656.0 / 12825.0, 28561.0 / 56430.0, -9.0 / 50.0, 2.0 / 55.0 };
+static const double rkf_b4[6] = { 25.0 / 216.0, 0.0, 1408.0 / 2565.0, 2197.0 / 4104.0, -1.0 / 5.0, 0.0 };
+
+template <class TSystem>
+void cot::integrator::Euler::step(TSystem& sys, const math_t dt)
+{
+    auto& phys = sys.physics();
+
+    // Acceleration at the current positions, unless diagnostics already took it after the last step
+    if (!sys.bAccelValid)
+        sys.accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            // Calculate position movement due to velocity
+            phys.x[i] += phys.vx[i] * dt;
+            phys.y[i] += phys.vy[i] * dt;
+
+            // Calculate next velocity based on acceleration
+            phys.vx[i] += phys.ax[i] * dt;
+            phys.vy[i] += phys.ay[i] * dt;
+        }
+    });
+
+    // Positions moved after the acceleration was taken
+    sys.bAccelValid = false;
+}
+
+template <class TSystem>
+void cot::integrator::Leapfrog::step(TSystem& sys, const math_t dt)
+{
+    auto& phys = sys.physics();
+    const math_t half = dt * 0.5f;
+
+    // Acceleration carries over from the previous step unless the system changed
+    if (!sys.bAccelValid)
+        sys.accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+
+    // Half kick then drift
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            phys.vx[i] += phys.ax[i] * half;
+            phys.vy[i] += phys.ay[i] * half;
+            phys.x[i] += phys.vx[i] * dt;
+            phys.y[i] += phys.vy[i] * dt;
+        }
+    });
+
+    // Half kick with the acceleration at the new positions
+    sys.accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            phys.vx[i] += phys.ax[i] * half;
+            phys.vy[i] += phys.ay[i] * half;
+        }
+    });
+
+    sys.bAccelValid = true;
+}
+
+template <class TSystem>
+void cot::integrator::Yoshida4::step(TSystem& sys, const math_t dt)
+{
+    // Triple jump composition of leapfrog steps
+    static const double cbrt2 = std::cbrt(2.0);
+    static const math_t w1 = static_cast<math_t>(1.0 / (2.0 - cbrt2));
+    static const math_t w0 = static_cast<math_t>(-cbrt2 / (2.0 - cbrt2));
+
+    Leapfrog::step(sys, w1 * dt);
+    Leapfrog::step(sys, w0 * dt);
+    Leapfrog::step(sys, w1 * dt);
+}
+
+template <class TSystem>
+void cot::integrator::RK4::step(TSystem& sys, const math_t dt)
+{
+    auto& phys = sys.physics();
+
+    // Stage state, stage derivative and weighted sums of the derivatives
+    math_t* tx = sys.scratch(0);    math_t* ty = sys.scratch(1);
+    math_t* kvx = sys.scratch(2);   math_t* kvy = sys.scratch(3);
+    math_t* kax = sys.scratch(4);   math_t* kay = sys.scratch(5);
+    math_t* sx = sys.scratch(6);    math_t* sy = sys.scratch(7);
+    math_t* svx = sys.scratch(8);   math_t* svy = sys.scratch(9);
+
+    // First stage at the current state, kept as the acceleration of the step
+    if (!sys.bAccelValid)
+        sys.accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            kvx[i] = phys.vx[i];    kvy[i] = phys.vy[i];
+            kax[i] = phys.ax[i];    kay[i] = phys.ay[i];
+            sx[i] = kvx[i];         sy[i] = kvy[i];
+            svx[i] = kax[i];        svy[i] = kay[i];
+        }
+    });
+
+    // Remaining stages at half, half and full step
+    for (std::size_t stage = 1; stage < 4; stage++)
+    {
+        const math_t h = (stage < 3 ? dt * 0.5f : dt);
+        const math_t w = (stage < 3 ? 2.0f : 1.0f);
+        sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+        {
+            for (std::size_t i = iBegin; i < iEnd; i++)
+            {
+                tx[i] = phys.x[i] + kvx[i] * h;
+                ty[i] = phys.y[i] + kvy[i] * h;
+                kvx[i] = phys.vx[i] + kax[i] * h;
+                kvy[i] = phys.vy[i] + kay[i] * h;
+            }
+        });
+        sys.accelerate(tx, ty, kax, kay);
+        sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+        {
+            for (std::size_t i = iBegin; i < iEnd; i++)
+            {
+                sx[i] += kvx[i] * w;    sy[i] += kvy[i] * w;
+                svx[i] += kax[i] * w;   svy[i] += kay[i] * w;
+            }
+        });
+    }
+
+    // Combine stages
+    const math_t sixth = dt / 6.0f;
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            phys.x[i] += sx[i] * sixth;     phys.y[i] += sy[i] * sixth;
+            phys.vx[i] += svx[i] * sixth;   phys.vy[i] += svy[i] * sixth;
+        }
+    });
+
+    sys.bAccelValid = false;
+}
+
+template <class TSystem>
+void cot::integrator::RKF45::step(TSystem& sys, const math_t dt)
+{
+    auto& phys = sys.physics();
+
+    // Stage state and the 6 stage derivatives of position and velocity
+    math_t* tx = sys.scratch(0);    math_t* ty = sys.scratch(1);
+    math_t* tvx = sys.scratch(2);   math_t* tvy = sys.scratch(3);
+    math_t* kvx[6]; math_t* kvy[6]; math_t* kax[6]; math_t* kay[6];
+    for (std::size_t s = 0; s < 6; s++)
+    {
+        kvx[s] = sys.scratch(4 + 4 * s);    kvy[s] = sys.scratch(5 + 4 * s);
+        kax[s] = sys.scratch(6 + 4 * s);    kay[s] = sys.scratch(7 + 4 * s);
+    }
+
+    // First stage is at the start of the substep, so a retry reuses it, as does the first substep while the acceleration is valid
+    bool bStartValid = sys.bAccelValid;
+    if (bStartValid)
+    {
+        std::copy(phys.ax.begin(), phys.ax.end(), kax[0]);
+        std::copy(phys.ay.begin(), phys.ay.end(), kay[0]);
+    }
+
+    // Take as many substeps as needed to cover dt
+    math_t mRemaining = dt;
+    if (sys.mAdaptiveDt <= 0.0f)
+        sys.mAdaptiveDt = dt;
+    while (mRemaining > 0.0f)
+    {
+        const math_t h = std::min(sys.mAdaptiveDt, mRemaining);
+
+        // Stages of the substep
+        for (std::size_t s = 0; s < 6; s++)
+        {
+            sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+            {
+                for (std::size_t i = iBegin; i < iEnd; i++)
+                {
+                    math_t dx = 0.0f, dy = 0.0f, dvx = 0.0f, dvy = 0.0f;
+                    for (std::size_t j = 0; j < s; j++)
+                    {
+                        const math_t a = static_cast<math_t>(rkf_a[s][j]);
+                        dx += a * kvx[j][i];    dy += a * kvy[j][i];
+                        dvx += a * kax[j][i];   dvy += a * kay[j][i];
+                    }
+                    tx[i] = phys.x[i] + dx * h;     ty[i] = phys.y[i] + dy * h;
+                    tvx[i] = phys.vx[i] + dvx * h;  tvy[i] = phys.vy[i] + dvy * h;
+                    kvx[s][i] = tvx[i];             kvy[s][i] = tvy[i];
+                }
+            });
+            if ((s > 0) || !bStartValid)
+                sys.accelerate(tx, ty, kax[s], kay[s]);
+        }
+        bStartValid = true;
+
+        // Largest difference between the fourth and fifth order solutions, relative to the tolerance
+        math_t mError = 0.0f;
+        for (std::size_t i = 0; i < phys.size(); i++)
+        {
+            math_t ex = 0.0f, ey = 0.0f, evx = 0.0f, evy = 0.0f;
+            for (std::size_t s = 0; s < 6; s++)
+            {
+                const math_t e = static_cast<math_t>(rkf_b5[s] - rkf_b4[s]);
+                ex += e * kvx[s][i];    ey += e * kvy[s][i];
+                evx += e * kax[s][i];   evy += e * kay[s][i];
+            }
+            math_t mPos = std::sqrt(ex * ex + ey * ey) * h;
+            math_t mVel = std::sqrt(evx * evx + evy * evy) * h * h;
+            mError = std::max(mError, std::max(mPos, mVel) / sys.mTolerance);
+        }
+
+        // Accept with the fifth order solution, or retry smaller
+        if ((mError <= 1.0f) || (h <= dt * 1e-6f))
+        {
+            sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+            {
+                for (std::size_t i = iBegin; i < iEnd; i++)
+                {
+                    math_t dx = 0.0f, dy = 0.0f, dvx = 0.0f, dvy = 0.0f;
+                    for (std::size_t s = 0; s < 6; s++)
+                    {
+                        const math_t b = static_cast<math_t>(rkf_b5[s]);
+                        dx += b * kvx[s][i];    dy += b * kvy[s][i];
+                        dvx += b * kax[s][i];   dvy += b * kay[s][i];
+                    }
+                    phys.x[i] += dx * h;        phys.y[i] += dy * h;
+                    phys.vx[i] += dvx * h;      phys.vy[i] += dvy * h;
+                    phys.ax[i] = kax[0][i];     phys.ay[i] = kay[0][i];
+                }
+            });
+            mRemaining -= h;
+            bStartValid = false;
+        }
+
+        // Next substep from the fifth root of the error
+        math_t mScale = (mError > 0.0f ? param_adaptiveSafety * std::pow(mError, static_cast<math_t>(-0.2f)) : param_adaptiveGrow);
+        sys.mAdaptiveDt = h * std::min(param_adaptiveGrow, std::max(param_adaptiveShrink, mScale));
+    }
+
+    sys.bAccelValid = false;
+}
+
+template <class TSystem>
+void cot::integrator::Block::step(TSystem& sys, const math_t dt)
+{
+    auto& phys = sys.physics();
+    const std::size_t n = sys.size();
+    if (n == 0)
+        return;
+
+    // Time is counted in ticks of the finest level, so every step of every level ends on a whole tick
+    const std::uint32_t nTicks = 1u << blockLevels;
+    const math_t mTick = dt / nTicks;
+    math_t* kax = sys.scratch(0);
+    math_t* kay = sys.scratch(1);
+
+    // Coarsest level whose step keeps the position error of a body within tolerance by acceleration and jerk
+    auto fnLevel = [&](const std::size_t i, const math_t jerk) -> std::uint32_t
+    {
+        const math_t a = std::sqrt(phys.ax[i] * phys.ax[i] + phys.ay[i] * phys.ay[i]);
+        math_t h = dt;
+        if (a > 0.0f)
+            h = std::min(h, std::sqrt(2.0f * sys.mTolerance / a));
+        if (jerk > 0.0f)
+            h = std::min(h, std::cbrt(6.0f * sys.mTolerance / jerk));
+        std::uint32_t level = 0;
+        for (math_t hLevel = dt; (level < blockLevels) && (hLevel > h); hLevel *= 0.5f)
+            level++;
+        return level;
+    };
+
+    // Bodies start on the level their acceleration allows whenever the system changed, jerk is not known yet
+    if (!sys.bAccelValid || (sys.vLevel.size() != n))
+    {
+        sys.accelerate(phys.x.data(), phys.y.data(), phys.ax.data(), phys.ay.data());
+        sys.vLevel.resize(n);
+        for (std::size_t i = 0; i < n; i++)
+            sys.vLevel[i] = static_cast<std::uint8_t>(fnLevel(i, 0.0f));
+    }
+    sys.vLevelCounts.assign(blockLevels + 1, 0);
+    for (std::size_t i = 0; i < n; i++)
+        sys.vLevelCounts[sys.vLevel[i]]++;
+
+    // Opening half kick of every body
+    sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+    {
+        for (std::size_t i = iBegin; i < iEnd; i++)
+        {
+            const math_t half = 0.5f * std::ldexp(dt, -static_cast<int>(sys.vLevel[i]));
+            phys.vx[i] += phys.ax[i] * half;
+            phys.vy[i] += phys.ay[i] * half;
+        }
+    });
+
+    std::uint32_t t = 0;
+    while (t < nTicks)
+    {
+        // Next tick at which the steps of the finest populated level end
+        std::uint32_t finest = blockLevels;
+        while (sys.vLevelCounts[finest] == 0)
+            finest--;
+        const std::uint32_t nStride = nTicks >> finest;
+        const std::uint32_t tNext = (t / nStride + 1) * nStride;
+
+        // Drift every body, which predicts the position of bodies whose step has not ended
+        const math_t h = (tNext - t) * mTick;
+        sys.forEachBody([&](const std::size_t iBegin, const std::size_t iEnd)
+        {
+            for (std::size_t i = iBegin; i < iEnd; i++)
+            {
+                phys.x[i] += phys.vx[i] * h;
+                phys.y[i] += phys.vy[i] * h;
+            }
+        });
+        t = tNext;
+
+        // Only bodies whose step ends now feel the force at the new positions
+        sys.vActive.clear();
+        for (std::uint32_t i = 0; i < n; i++)
+        {
+            if ((t & ((nTicks >> sys.vLevel[i]) - 1)) == 0)
+                sys.vActive.push_back(i);
+        }
+        sys.accelerate(sys.vActive.data(), sys.vActive.size(), phys.x.data(), phys.y.data(), kax, kay);
+
+        // Closing half kick, then the level and opening half kick of the next step
+        for (const std::uint32_t i : sys.vActive)
+        {
+            const std::uint32_t level = sys.vLevel[i];
+            const math_t hOld = std::ldexp(dt, -static_cast<int>(level));
+            phys.vx[i] += kax[i] * 0.5f * hOld;
+            phys.vy[i] += kay[i] * 0.5f * hOld;
+            const math_t dax = kax[i] - phys.ax[i], day = kay[i] - phys.ay[i];
+            phys.ax[i] = kax[i];
+            phys.ay[i] = kay[i];
+
+            // Finer levels always fit, coarser ones only one at a time and where their step would begin
+            std::uint32_t next = fnLevel(i, std::sqrt(dax * dax + day * day) / hOld);
+            if (next < level)
+                next = ((t & ((nTicks >> (level - 1)) - 1)) == 0 ? level - 1 : level);
+            sys.vLevelCounts[level]--;
+            sys.vLevelCounts[next]++;
+            sys.vLevel[i] = static_cast<std::uint8_t>(next);
+
+            // Steps ending with the update open at the start of the next one
+            if (t < nTicks)
+            {
+                const math_t half = 0.5f * std::ldexp(dt, -static_cast<int>(next));
+                phys.vx[i] += phys.ax[i] * half;
+                phys.vy[i] += phys.ay[i] * half;
+            }
+        }
+    }
+
+    // Every body ended its step with the update, so the acceleration is valid for the current positions
+    sys.bAccelValid = true;
+}
+
+const char* cot::integrator::name(const integrator_t integrator)
+{
+    switch (integrator)
+    {
+    case INTEGRATOR_LEAPFROG:
+        return "leapfrog";
+    case INTEGRATOR_YOSHIDA4:
+        return "yoshida4";
+    case INTEGRATOR_RK4:
+        return "rk4";
+    case INTEGRATOR_RKF45:
+        return "rkf45";
+    case INTEGRATOR_BLOCK:
+        return "block";
+    default:
+        return "euler";
+    }
+}
+
+bool cot::integrator::parse(const std::string& in_name, integrator_t& out_integrator)
+{
+    for (integrator_t integ : { INTEGRATOR_EULER, INTEGRATOR_LEAPFROG, INTEGRATOR_YOSHIDA4, INTEGRATOR_RK4, INTEGRATOR_RKF45, INTEGRATOR_BLOCK })
+    {
+        if (in_name == name(integ))
+        {
+            out_integrator = integ;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Policies instantiated for the general engine
+template void cot::integrator::Euler::step<cot::Engine>(cot::Engine&, const cot::math_t);
+template void cot::integrator::Leapfrog::step<cot::Engine>(cot::Engine&, const cot::math_t);
+template void cot::integrator::Yoshida4::step<cot::Engine>(cot::Engine&, const cot::math_t);
+template void cot::integrator::RK4::step<cot::Engine>(cot::Engine&, const cot::math_t);
+template void cot::integrator::RKF45::step<cot::Engine>(cot::Engine&, const cot::math_t);
+template void cot::integrator::Block::step<cot::Engine>(cot::Engine&, const cot::math_t);
+
+// Policies instantiated for every fixed size engine
+#define COT_FIXED_POLICIES(N) \
+    template void cot::integrator::Euler::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t); \
+    template void cot::integrator::Leapfrog::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t); \
+    template void cot::integrator::Yoshida4::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t); \
+    template void cot::integrator::RK4::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t); \
+    template void cot::integrator::RKF45::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t); \
+    template void cot::integrator::Block::step<cot::FixedEngine<N>>(cot::FixedEngine<N>&, const cot::math_t);
+
+COT_FIXED_POLICIES(2)  COT_FIXED_POLICIES(3)  COT_FIXED_POLICIES(4)  COT_FIXED_POLICIES(5)
+COT_FIXED_POLICIES(6)  COT_FIXED_POLICIES(7)  COT_FIXED_POLICIES(8)  COT_FIXED_POLICIES(9)
+COT_FIXED_POLICIES(10) COT_FIXED_POLICIES(11) COT_FIXED_POLICIES(12) COT_FIXED_POLICIES(13)
+COT_FIXED_POLICIES(14) COT_FIXED_POLICIES(15) COT_FIXED_POLICIES(16)
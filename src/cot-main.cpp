@@ -2,24 +2,359 @@
 // Malhar Palkar
 #include <curious-orbital-toy.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
 
-int main(int argc, char **argv)
+// Most simulated time the physics thread catches up on at once (sec)
+static const cot::math_t param_maxLag = 0.25f;
+
+// Change in camera zoom per mouse wheel notch
+static const float param_zoomStep = 1.1f;
+
+// Share of a recording skipped per scrub key press during playback
+static const double param_scrubStep = 0.02;
+
+// Trace written by F12 when no path is given
+static const char* param_tracePath = "cot-trace.json";
+
+// How often the catalog is checked for edits when reloading (sec)
+static const cot::math_t param_reloadPoll = 0.5f;
+
+// Distance around a planet a right click still selects it by (screen pixels)
+static const float param_pickPixels = 6.0f;
+
+// Command line options
+typedef struct _options
 {
-    // Set up logger to be really verbose
-    auto logger = spdlog::basic_logger_mt("logger", "cot.log");
-    logger->set_level(spdlog::level::debug);
-    logger->info("Start of session.");
+    cot::solver_t       solver = cot::SOLVER_DIRECT;    // Gravitational solver
+    cot::math_t         theta = 0.5f;                   // Barnes-Hut opening angle
+    cot::math_t         softening = 0.0f;               // Plummer softening length (pixels)
+    cot::integrator_t   integrator = cot::INTEGRATOR_EULER; // Integrator
+    cot::math_t         tolerance = 1e-3f;              // Adaptive integrator tolerance (pixels)
+    std::size_t         threads = 1;                    // Number of engine threads
+    cot::math_t         dt = 1.0f / 120.0f;             // Fixed physics timestep (sec)
+    cot::math_t         speed = 1.0f;                   // Simulated seconds per real second, zero for unlimited
+    std::size_t         trail = COT_PERSIST;            // Number of persistence stamps per body
+    float               lod = 1.0f;                     // Zoom (pixels per unit) below which small bodies are drawn as density, zero for never
+    cot::math_t         trailSpacing = 0.0f;            // Distance between persistence stamps (pixels), zero for every frame
+    bool                headless = false;               // Run without a window
+    std::uint64_t       steps = 0;                      // Number of steps to run headless, zero for no limit
+    cot::math_t         duration = 0.0f;                // Simulated time to run headless (sec), zero for no limit
+    std::string         telemetry = "cot.dat";          // Path of the telemetry file, empty for none
+    std::string         play;                           // Path of a telemetry file to play back instead of simulating
+    std::string         catalog = "cot.csv";            // Path of the catalog of bodies
+    bool                reload = false;                 // Apply edits of the catalog to the running engine
+    std::string         trace;                          // Path of the trace written on exit, empty for none
+    std::string         serve;                          // Path of the live telemetry socket, empty for none
+    std::string         checkpoint = "cot.cpt";         // Path of the checkpoint written by F5 or every interval
+    cot::math_t         checkpointInterval = 0.0f;      // Simulated time between checkpoints (sec), zero for none
+    std::string         restore;                        // Path of a checkpoint to resume from instead of the catalog
+    bool                collisions = false;             // Merge bodies that touch
+    bool                diagnostics = false;            // Calculate energy and momentum after every step
+    cot::math_t         predict = 0.0f;                 // Simulated time the path of selected bodies is predicted ahead (sec), zero for none
+    std::size_t         ensemble = 0;                   // Number of runs of a headless ensemble, zero for a single simulation
+    std::string         ensembleOut = "cot.ens";        // Path of the ensemble file
+    std::uint64_t       seed = 1;                       // Seed of the ensemble perturbations
+    cot::math_t         perturbPosition = 0.0f;         // Standard deviation of the ensemble position perturbation (pixels)
+    cot::math_t         perturbVelocity = 0.0f;         // Standard deviation of the ensemble velocity perturbation, relative to speed
+    cot::math_t         perturbMass = 0.0f;             // Standard deviation of the ensemble mass perturbation, relative to mass
+    cot::math_t         telemetryInterval = 0.1f;       // Simulated time between telemetry records (sec), zero for every step
+} options_t;
+
+// Camera over the system and fixed view for on-screen metrics
+typedef struct _camera
+{
+    sf::View            view;                           // View through which the system is drawn
+    sf::View            overlay;                        // View through which metrics are drawn
+    float               zoom = 1.0f;                    // World units per pixel
+    bool                dragging = false;               // Whether a mouse button is held
+    sf::Vector2i        dragFrom;                       // Pixel the cursor was last dragged from
+} camera_t;
+
+/**
+ * @brief Zooms the camera about the cursor, pans it by dragging and keeps it in step with the window size
+*/
+static void handleCamera(const sf::Event& sfEvent, const sf::RenderWindow& sfWindow, camera_t& cam)
+{
+    switch (sfEvent.type)
+    {
+    case sf::Event::Resized:
+        // Keep zoom level and centre, show more or less of the system
+        cam.view.setSize(sfEvent.size.width * cam.zoom, sfEvent.size.height * cam.zoom);
+        cam.overlay.reset(sf::FloatRect(0.0f, 0.0f, sfEvent.size.width, sfEvent.size.height));
+        break;
+
+    case sf::Event::MouseWheelScrolled:
+    {
+        // Zoom about the point under the cursor
+        sf::Vector2i vPixel(sfEvent.mouseWheelScroll.x, sfEvent.mouseWheelScroll.y);
+        sf::Vector2f vBefore = sfWindow.mapPixelToCoords(vPixel, cam.view);
+        float mFactor = std::pow(param_zoomStep, -sfEvent.mouseWheelScroll.delta);
+        cam.view.zoom(mFactor);
+        cam.zoom *= mFactor;
+        cam.view.move(vBefore - sfWindow.mapPixelToCoords(vPixel, cam.view));
+        break;
+    }
+
+    case sf::Event::MouseButtonPressed:
+        cam.dragging = true;
+        cam.dragFrom = sf::Vector2i(sfEvent.mouseButton.x, sfEvent.mouseButton.y);
+        break;
+
+    case sf::Event::MouseButtonReleased:
+        cam.dragging = false;
+        break;
+
+    case sf::Event::MouseMoved:
+        // Pan with the cursor while a button is held
+        if (cam.dragging)
+        {
+            sf::Vector2i vDragTo(sfEvent.mouseMove.x, sfEvent.mouseMove.y);
+            cam.view.move(sfWindow.mapPixelToCoords(cam.dragFrom, cam.view) - sfWindow.mapPixelToCoords(vDragTo, cam.view));
+            cam.dragFrom = vDragTo;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Selects the body under the cursor for prediction with the right mouse button, Escape empties the selection
+*/
+static void handleSelect(const sf::Event& sfEvent, const sf::RenderWindow& sfWindow, const camera_t& cam, const cot::Engine& eng, 
+    cot::Predictor& pred)
+{
+    if (!pred.running())
+        return;
+    if ((sfEvent.type == sf::Event::KeyPressed) && (sfEvent.key.code == sf::Keyboard::Escape))
+    {
+        pred.clearSelection();
+        return;
+    }
+    if ((sfEvent.type != sf::Event::MouseButtonPressed) || (sfEvent.mouseButton.button != sf::Mouse::Right))
+        return;
 
+    // Nearest body of the frame on screen whose planet, or a few pixels around it, is under the cursor
+    const sf::Vector2f vCursor = sfWindow.mapPixelToCoords(sf::Vector2i(sfEvent.mouseButton.x, sfEvent.mouseButton.y), cam.view);
+    const cot::snapshot_t snap = eng.latest();
+    const float mSlack = param_pickPixels * cam.zoom;
+    std::size_t nNearest = SIZE_MAX;
+    float mNearest2 = std::numeric_limits<float>::max();
+    for (std::size_t i = 0; i < snap.count; i++)
+    {
+        const float dx = static_cast<float>(snap.x[i]) - vCursor.x, dy = static_cast<float>(snap.y[i]) - vCursor.y;
+        const float mReach = static_cast<float>(cot::mass2rad(snap.mass[i])) + mSlack;
+        const float mDist2 = dx * dx + dy * dy;
+        if ((mDist2 <= mReach * mReach) && (mDist2 < mNearest2))
+        {
+            nNearest = i;
+            mNearest2 = mDist2;
+        }
+    }
+    if (nNearest != SIZE_MAX)
+        pred.select(snap.id[nNearest]);
+}
+
+/**
+ * @brief Writes a trace of the recent phases of every thread
+*/
+static void writeTrace(const std::string& path, std::shared_ptr<spdlog::logger> logger)
+{
+    if (cot::metrics::dumpTrace(path))
+        logger->info("Wrote trace to '{0}'.", path);
+    else
+        logger->error("Unable to write trace to '{0}'.", path);
+}
+
+/**
+ * @brief Writes a trace when F12 is pressed
+*/
+static void handleTrace(const sf::Event& sfEvent, const options_t& opts, std::shared_ptr<spdlog::logger> logger)
+{
+    if ((sfEvent.type == sf::Event::KeyPressed) && (sfEvent.key.code == sf::Keyboard::F12))
+        writeTrace((opts.trace.empty() ? param_tracePath : opts.trace), logger);
+}
+
+/**
+ * @brief Starts writing a checkpoint of the engine in the background, unless the last one is still being written
+ * @param pTrails Trails captured by the thread calling draw to save too, null for none
+ * @note Must run on the thread calling update, which is the only thread using the writer
+*/
+static void saveCheckpoint(cot::Engine& eng, cot::CheckpointWriter& cpw, const options_t& opts, const cot::checkpoint_t* pTrails, 
+    std::shared_ptr<spdlog::logger> logger)
+{
+    cot::checkpoint_t* pCheckpoint = cpw.claim();
+    if (!pCheckpoint)
+    {
+        logger->warn("Skipped checkpoint, the last one is still being written.");
+        return;
+    }
+
+    // Update only waits while the state is copied, writing happens on the writer thread
+    auto tBegin = std::chrono::steady_clock::now();
+    eng.capture(*pCheckpoint);
+    if (pTrails)
+    {
+        pCheckpoint->header.trailLength = pTrails->header.trailLength;
+        pCheckpoint->header.trails = pTrails->header.trails;
+        pCheckpoint->trailIds.assign(pTrails->trailIds.begin(), pTrails->trailIds.end());
+        pCheckpoint->trailHead.assign(pTrails->trailHead.begin(), pTrails->trailHead.end());
+        pCheckpoint->trailCount.assign(pTrails->trailCount.begin(), pTrails->trailCount.end());
+        pCheckpoint->trailPoints.assign(pTrails->trailPoints.begin(), pTrails->trailPoints.end());
+    }
+    std::chrono::duration<double, std::milli> tCopy = std::chrono::steady_clock::now() - tBegin;
+    const std::uint64_t nBodies = pCheckpoint->header.count;
+    const double mTime = pCheckpoint->header.time;
+    cpw.commit(opts.checkpoint);
+    logger->info("Saving checkpoint of {0:d} bodies at {1:.3f} sec to '{2}', copied in {3:.2f} ms.", 
+        nBodies, mTime, opts.checkpoint, tCopy.count());
+}
+
+/**
+ * @brief Saves a checkpoint once the checkpoint interval has passed, on the thread calling update
+*/
+static void handleCheckpointInterval(cot::Engine& eng, cot::CheckpointWriter& cpw, const options_t& opts, cot::math_t& elapsed, 
+    std::shared_ptr<spdlog::logger> logger)
+{
+    if (opts.checkpointInterval <= 0.0f)
+        return;
+    elapsed += opts.dt;
+    if (elapsed < opts.checkpointInterval)
+        return;
+    elapsed = 0.0f;
+    saveCheckpoint(eng, cpw, opts, nullptr, logger);
+}
+
+/**
+ * @brief Reads edits of the catalog on the calling thread once the file holds still, for the thread calling update to apply
+ * @param ready Set once edits are read, and cleared again by the thread calling update once they are applied
+*/
+static void handleReload(cot::CatalogReload& rld, const options_t& opts, cot::math_t& elapsed, const cot::math_t dt, std::atomic<bool>& ready,
+    std::shared_ptr<spdlog::logger> logger)
+{
+    if (!opts.reload || ready.load(std::memory_order_acquire))
+        return;
+    elapsed += dt;
+    if (elapsed < param_reloadPoll)
+        return;
+    elapsed = 0.0f;
+    if (rld.poll() && rld.prepare(logger, opts.threads))
+        ready.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Reports the rate at which the engine was stepped
+*/
+static void reportRate(std::shared_ptr<spdlog::logger> logger, const std::uint64_t steps, const double seconds)
+{
+    double rate = (seconds > 0.0 ? steps / seconds : 0.0);
+    logger->info("Ran {0:d} steps in {1:.3f} sec, {2:.1f} steps/sec.", steps, seconds, rate);
+    std::cout << steps << " steps in " << seconds << " sec, " << rate << " steps/sec" << std::endl;
+}
+
+/**
+ * @brief Steps the engine as fast as possible without a window
+*/
+static int runHeadless(cot::Engine& eng, cot::Telemetry& tel, cot::TelemetryServer& srv, cot::CheckpointWriter& cpw, const options_t& opts, std::shared_ptr<spdlog::logger> logger)
+{
+    logger->info("Running headless with timestep {:.4f} sec.", opts.dt);
+
+    auto tBegin = std::chrono::steady_clock::now();
+    std::uint64_t nSteps = 0;
+    cot::math_t mCheckpoint = 0.0f;
+    while (((opts.steps == 0) || (nSteps < opts.steps)) && ((opts.duration <= 0.0f) || (eng.time() < opts.duration)))
+    {
+        {
+            cot::metrics::Zone zone(cot::metrics::PHASE_PHYSICS);
+            eng.update(opts.dt);
+        }
+        cot::processPublish(eng, opts.dt, tel, srv, logger);
+        handleCheckpointInterval(eng, cpw, opts, mCheckpoint, logger);
+        nSteps++;
+
+        // Without any limit run until interrupted
+        if ((opts.steps == 0) && (opts.duration <= 0.0f) && ((nSteps & 0xFFFF) == 0))
+        {
+            std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+            reportRate(logger, nSteps, tElapsed.count());
+        }
+    }
+    std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+    reportRate(logger, nSteps, tElapsed.count());
+
+    // Final state, so the run can be resumed where it stopped
+    if (opts.checkpointInterval > 0.0f)
+    {
+        cpw.wait();
+        saveCheckpoint(eng, cpw, opts, nullptr, logger);
+    }
+
+    logger->info("End of session.");
+    return 0;
+}
+
+/**
+ * @brief Runs perturbed copies of the catalog without a window, each on its own engine
+*/
+static int runEnsemble(const options_t& opts, std::shared_ptr<spdlog::logger> logger)
+{
+    if ((opts.steps == 0) && (opts.duration <= 0.0f))
+    {
+        logger->error("An ensemble needs --steps or --duration.");
+        return 0;
+    }
+
+    // An empty system would still write a results file that reads like a finished sweep
+    cot::catalog_t cfgCatalog;
+    if (!cot::cfgLoadCatalog(logger, opts.catalog, opts.threads, cfgCatalog) || (cfgCatalog.size() == 0))
+    {
+        logger->error("Unable to load any bodies from catalog '{0}' for the ensemble.", opts.catalog);
+        return 0;
+    }
+
+    cot::ensemble::spec_t spec;
+    spec.runs = opts.ensemble;
+    spec.seed = opts.seed;
+    spec.threads = opts.threads;
+    spec.steps = (opts.steps > 0 ? opts.steps : static_cast<std::uint64_t>(std::ceil(opts.duration / opts.dt)));
+    spec.dt = opts.dt;
+    spec.position = opts.perturbPosition;
+    spec.velocity = opts.perturbVelocity;
+    spec.mass = opts.perturbMass;
+    spec.solver = opts.solver;
+    spec.theta = opts.theta;
+    spec.softening = opts.softening;
+    spec.integrator = opts.integrator;
+    spec.tolerance = opts.tolerance;
+    spec.collisions = opts.collisions;
+
+    auto tBegin = std::chrono::steady_clock::now();
+    cot::ensemble::run(logger, cfgCatalog, spec, opts.ensembleOut);
+    std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+    std::cout << spec.runs << " runs in " << tElapsed.count() << " sec, " << spec.runs / tElapsed.count() << " runs/sec" << std::endl;
+
+    logger->info("End of session.");
+    return 0;
+}
+
+/**
+ * @brief Steps the engine at a fixed timestep on its own thread while the window renders the latest frame
+*/
+static int runWindowed(cot::Engine& eng, cot::Telemetry& tel, cot::TelemetryServer& srv, cot::CheckpointWriter& cpw, cot::CatalogReload& rld, 
+    const options_t& opts, std::shared_ptr<spdlog::logger> logger)
+{
     // Create window objects
     sf::RenderWindow sfWindow(sf::VideoMode(800, 600), "Curious Orbital Toy");
     sfWindow.setVerticalSyncEnabled(true);
     logger->debug("Created window.");
 
-    // Timing objects
-    std::chrono::time_point<std::chrono::system_clock> tBegin, tEnd;
-    tBegin = std::chrono::system_clock::now();
-
     // Prepare metrics
     if (!cot::metrics::setup())
     {
@@ -27,39 +362,111 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    // Initialize engine
-    cot::Engine pEng;
-    logger->debug("Initialised engine.");
+    // Physics thread, accumulates real time and spends it in fixed steps
+    // It alone touches the engine state and the checkpoint writer, the render thread hands it requests through flags
+    // Trails of a checkpoint saved by F5 are captured by the render thread, which leaves them alone until the save is served
+    std::atomic<bool> bRunning(true);
+    std::atomic<bool> bReloadReady(false);
+    std::atomic<bool> bSaveRequested(false);
+    cot::checkpoint_t cptTrails;
+    std::uint64_t nPhysicsSteps = 0;
+    auto tPhysicsBegin = std::chrono::steady_clock::now();
+    std::thread thrPhysics([&]()
+    {
+        auto tLast = std::chrono::steady_clock::now();
+        cot::math_t mLag = 0.0f;
+        cot::math_t mCheckpoint = 0.0f;
+        while (bRunning.load(std::memory_order_relaxed))
+        {
+            if (opts.speed > 0.0f)
+            {
+                auto tNow = std::chrono::steady_clock::now();
+                std::chrono::duration<cot::math_t> tDelta = tNow - tLast;
+                tLast = tNow;
+
+                // Drop time that cannot be caught up on instead of spiralling
+                mLag = std::min(mLag + tDelta.count() * opts.speed, param_maxLag * std::max(opts.speed, static_cast<cot::math_t>(1.0f)));
+                if (mLag < opts.dt)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+                    continue;
+                }
+                mLag -= opts.dt;
+            }
+
+            {
+                cot::metrics::Zone zone(cot::metrics::PHASE_PHYSICS);
+                eng.update(opts.dt);
+            }
+            cot::processPublish(eng, opts.dt, tel, srv, logger);
+            handleCheckpointInterval(eng, cpw, opts, mCheckpoint, logger);
+            nPhysicsSteps++;
+
+            // Checkpoints asked for by F5 are saved between steps, with the trails the render thread captured
+            if (bSaveRequested.load(std::memory_order_acquire))
+            {
+                saveCheckpoint(eng, cpw, opts, &cptTrails, logger);
+                bSaveRequested.store(false, std::memory_order_release);
+            }
+
+            // Edits of the catalog read by the render thread are applied between steps
+            if (bReloadReady.load(std::memory_order_acquire))
+            {
+                rld.apply(eng, logger);
+                bReloadReady.store(false, std::memory_order_release);
+            }
+        }
+    });
+
+    // Timing objects
+    std::chrono::time_point<std::chrono::system_clock> tBegin, tEnd;
+    tBegin = std::chrono::system_clock::now();
 
-    // Add bodies from configuration
-    cot::math_t cfg_mass;
-    sf::Vector2f cfg_pos, cfg_vel;
-    std::string _s;
-    while (cot::cfgGetNextBody(logger, _s, cfg_mass, cfg_pos, cfg_vel))
+    // Camera over the system and fixed view for on-screen metrics
+    camera_t cam;
+    cam.view = sfWindow.getDefaultView();
+    cam.overlay = sfWindow.getDefaultView();
+    cot::math_t mReload = 0.0f;
+
+    // Paths of bodies picked with the right mouse button are predicted in the background and drawn with the trails
+    cot::Predictor pred;
+    if (opts.predict > 0.0f)
     {
-        pEng.addBody(_s, cfg_mass, cfg_pos, cfg_vel);
-        logger->info(std::string("Added body '") + _s + 
-            std::string("' with mass {:.2} initial position ({:.2},{:.2}) and initial velocity ({:.2},{:.2})."), 
-            cfg_mass, cfg_pos.x, cfg_pos.y, cfg_vel.x, cfg_vel.y);
+        pred.start(opts.predict, opts.softening);
+        eng.setPredictor(&pred);
     }
 
     // Program loop
     while (sfWindow.isOpen())
     {
         // Poll for events
+        std::uint64_t tInput = cot::metrics::now();
         sf::Event sfEvent;
         while (sfWindow.pollEvent(sfEvent))
         {
             // Handle event
-            switch (sfEvent.type)
+            if (sfEvent.type == sf::Event::Closed)
             {
-            case sf::Event::Closed:
                 sfWindow.close();
                 logger->info("End of session.");
-            default:
-                break;
+            }
+            handleCamera(sfEvent, sfWindow, cam);
+            handleSelect(sfEvent, sfWindow, cam, eng, pred);
+            handleTrace(sfEvent, opts, logger);
+            if ((sfEvent.type == sf::Event::KeyPressed) && (sfEvent.key.code == sf::Keyboard::F5))
+            {
+                if (bSaveRequested.load(std::memory_order_acquire))
+                {
+                    logger->warn("Skipped checkpoint, the last one asked for is not saved yet.");
+                }
+                else
+                {
+                    eng.captureTrails(cptTrails);
+                    bSaveRequested.store(true, std::memory_order_release);
+                }
             }
         }
+        cot::metrics::record(cot::metrics::PHASE_INPUT, tInput, cot::metrics::now());
 
         // Delta timing for elapsed time from last frame
         tEnd = std::chrono::system_clock::now();
@@ -67,23 +474,494 @@ int main(int argc, char **argv)
         tBegin = tEnd;
         cot::math_t dt = tDelta.count();
 
-        // Update physics engine and metrics
-        pEng.update(dt);
-        cot::metrics::update(dt);
+        // Pick up edits of the catalog
+        handleReload(rld, opts, mReload, dt, bReloadReady, logger);
+
+        // Update metrics
+        cot::metrics::update(dt, eng.presented());
 
         // Clear window in preparation to display next frame
         sfWindow.clear(sf::Color::Black);
 
-        // Draw new frame
-        pEng.draw(sfWindow);
-        cot::metrics::draw(sfWindow);
+        // Draw latest frame from the physics thread through the camera
+        {
+            cot::metrics::Zone zone(cot::metrics::PHASE_DRAW);
+            sfWindow.setView(cam.view);
+            eng.draw(sfWindow);
+            sfWindow.setView(cam.overlay);
+            cot::metrics::draw(sfWindow);
+        }
 
         // Display next frame
+        cot::metrics::Zone zone(cot::metrics::PHASE_DISPLAY);
         sfWindow.display();
+    }
+
+    // Stop physics and prediction threads
+    bRunning.store(false);
+    thrPhysics.join();
+    eng.setPredictor(nullptr);
+    pred.stop();
+    std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tPhysicsBegin;
+    reportRate(logger, nPhysicsSteps, tElapsed.count());
+
+    return 0;
+}
 
-        // Publish if needed
-        cot::processPublish(pEng, dt, logger);
+/**
+ * @brief Plays back a telemetry file through the engine renderer without running physics
+ * @note Space pauses, left and right scrub, up and down change speed, R reverses, Home and End jump to either end
+*/
+static int runPlayback(cot::Engine& eng, const options_t& opts, std::shared_ptr<spdlog::logger> logger)
+{
+    cot::Playback pb;
+    if (!pb.open(opts.play))
+    {
+        logger->error("Unable to play back '{0}'.", opts.play);
+        return 0;
     }
+    logger->info("Playing back '{0}' from {1:.3f} to {2:.3f} sec with {3:d} keyframes.", opts.play, pb.begin(), pb.end(), pb.keyframes());
+
+    // Recordings have no processor limit to run at, so unlimited speed plays in real time
+    pb.setSpeed(opts.speed > 0.0f ? opts.speed : 1.0f);
+
+    // Create window objects
+    sf::RenderWindow sfWindow(sf::VideoMode(800, 600), "Curious Orbital Toy");
+    sfWindow.setVerticalSyncEnabled(true);
+    if (!cot::metrics::setup())
+    {
+        logger->error("Unable to prepare metrics.");
+        return 0;
+    }
+
+    camera_t cam;
+    cam.view = sfWindow.getDefaultView();
+    cam.overlay = sfWindow.getDefaultView();
+
+    // Scrub by a fixed share of the recording per key press
+    const double mScrub = (pb.end() - pb.begin()) * param_scrubStep;
+
+    auto tBegin = std::chrono::steady_clock::now();
+    while (sfWindow.isOpen())
+    {
+        std::uint64_t tInput = cot::metrics::now();
+        sf::Event sfEvent;
+        while (sfWindow.pollEvent(sfEvent))
+        {
+            if (sfEvent.type == sf::Event::Closed)
+            {
+                sfWindow.close();
+                logger->info("End of session.");
+            }
+            else if (sfEvent.type == sf::Event::KeyPressed)
+            {
+                switch (sfEvent.key.code)
+                {
+                case sf::Keyboard::Space:
+                    pb.setPaused(!pb.paused());
+                    break;
+                case sf::Keyboard::Left:
+                    pb.seek(pb.time() - mScrub);
+                    break;
+                case sf::Keyboard::Right:
+                    pb.seek(pb.time() + mScrub);
+                    break;
+                case sf::Keyboard::Up:
+                    pb.setSpeed(pb.speed() * 2.0);
+                    break;
+                case sf::Keyboard::Down:
+                    pb.setSpeed(pb.speed() * 0.5);
+                    break;
+                case sf::Keyboard::R:
+                    pb.setSpeed(-pb.speed());
+                    break;
+                case sf::Keyboard::Home:
+                    pb.seek(pb.begin());
+                    break;
+                case sf::Keyboard::End:
+                    pb.seek(pb.end());
+                    break;
+                default:
+                    break;
+                }
+                logger->debug("Playback at {0:.3f} sec, speed {1:.3f}{2}.", pb.time(), pb.speed(), (pb.paused() ? ", paused" : ""));
+            }
+            handleCamera(sfEvent, sfWindow, cam);
+            handleTrace(sfEvent, opts, logger);
+        }
+        cot::metrics::record(cot::metrics::PHASE_INPUT, tInput, cot::metrics::now());
 
+        // Delta timing for elapsed time from last frame
+        auto tEnd = std::chrono::steady_clock::now();
+        std::chrono::duration<double> tDelta = tEnd - tBegin;
+        tBegin = tEnd;
+        cot::metrics::update(static_cast<cot::math_t>(tDelta.count()), eng.presented());
+
+        // Hand the frame under the playback clock to the renderer
+        pb.advance(tDelta.count());
+        if (const cot::frame_t* pFrame = pb.take())
+            eng.present(*pFrame);
+
+        sfWindow.clear(sf::Color::Black);
+        {
+            cot::metrics::Zone zone(cot::metrics::PHASE_DRAW);
+            sfWindow.setView(cam.view);
+            eng.draw(sfWindow);
+            sfWindow.setView(cam.overlay);
+            cot::metrics::draw(sfWindow);
+        }
+        cot::metrics::Zone zone(cot::metrics::PHASE_DISPLAY);
+        sfWindow.display();
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Parses the value of a numeric option, logging a value that is not a number of the right kind
+ * @param i Index of the value in argv, following that of the option
+ * @param out_value Parsed value, unchanged if the value is invalid
+ * @return Whether the value was parsed
+*/
+template <class T>
+static bool parseValue(char** argv, const int i, T& out_value, std::shared_ptr<spdlog::logger> logger)
+{
+    static_assert(std::is_floating_point<T>::value || std::is_unsigned<T>::value, "Numeric options are real or unsigned");
+    const std::string sText = argv[i];
+    std::size_t nUsed = 0;
+    long double mValue = 0.0;
+    try
+    {
+        // Counts would wrap a minus sign around to a huge value rather than reject it
+        if (std::is_floating_point<T>::value)
+            mValue = std::stold(sText, &nUsed);
+        else if (sText.find('-') == std::string::npos)
+            mValue = static_cast<long double>(std::stoull(sText, &nUsed));
+    }
+    catch (const std::logic_error&)
+    {
+        nUsed = 0;
+    }
+
+    // Trailing characters are a typo as much as a value that is not a number at all
+    if ((nUsed == 0) || (nUsed != sText.size()) || (std::fabs(mValue) > static_cast<long double>(std::numeric_limits<T>::max())))
+    {
+        logger->error("Invalid value for '{0}': '{1}'.", argv[i - 1], sText);
+        return false;
+    }
+    out_value = static_cast<T>(mValue);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // Set up logger to be really verbose
+    auto logger = spdlog::basic_logger_mt("logger", "cot.log");
+    logger->set_level(spdlog::level::debug);
+    logger->info("Start of session.");
+
+    // Parse command line options
+    options_t opts;
+    opts.threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        if ((std::strcmp(argv[i], "--barnes-hut") == 0) && (i + 1 < argc))
+        {
+            opts.solver = cot::SOLVER_BARNES_HUT;
+            if (!parseValue(argv, ++i, opts.theta, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--softening") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.softening, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--threads") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.threads, logger))
+                return 0;
+            opts.threads = std::max<std::size_t>(1, opts.threads);
+        }
+        else if ((std::strcmp(argv[i], "--integrator") == 0) && (i + 1 < argc))
+        {
+            if (!cot::integrator::parse(argv[++i], opts.integrator))
+            {
+                logger->error("Unknown integrator '{0}'.", argv[i]);
+                return 0;
+            }
+        }
+        else if ((std::strcmp(argv[i], "--tolerance") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.tolerance, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--dt") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.dt, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--speed") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.speed, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--trail") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.trail, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--lod") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.lod, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--trail-spacing") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.trailSpacing, logger))
+                return 0;
+        }
+        else if (std::strcmp(argv[i], "--headless") == 0)
+        {
+            opts.headless = true;
+        }
+        else if (std::strcmp(argv[i], "--diagnostics") == 0)
+        {
+            opts.diagnostics = true;
+        }
+        else if ((std::strcmp(argv[i], "--predict") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.predict, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--steps") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.steps, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--duration") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.duration, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--telemetry") == 0) && (i + 1 < argc))
+        {
+            opts.telemetry = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--telemetry-interval") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.telemetryInterval, logger))
+                return 0;
+        }
+        else if (std::strcmp(argv[i], "--no-telemetry") == 0)
+        {
+            opts.telemetry.clear();
+        }
+        else if ((std::strcmp(argv[i], "--catalog") == 0) && (i + 1 < argc))
+        {
+            opts.catalog = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--reload") == 0)
+        {
+            opts.reload = true;
+        }
+        else if (std::strcmp(argv[i], "--collisions") == 0)
+        {
+            opts.collisions = true;
+        }
+        else if ((std::strcmp(argv[i], "--trace") == 0) && (i + 1 < argc))
+        {
+            opts.trace = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--serve") == 0) && (i + 1 < argc))
+        {
+            opts.serve = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--checkpoint") == 0) && (i + 1 < argc))
+        {
+            opts.checkpoint = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--checkpoint-interval") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.checkpointInterval, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--restore") == 0) && (i + 1 < argc))
+        {
+            opts.restore = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--ensemble") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.ensemble, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--ensemble-out") == 0) && (i + 1 < argc))
+        {
+            opts.ensembleOut = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--seed") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.seed, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--perturb-position") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.perturbPosition, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--perturb-velocity") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.perturbVelocity, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--perturb-mass") == 0) && (i + 1 < argc))
+        {
+            if (!parseValue(argv, ++i, opts.perturbMass, logger))
+                return 0;
+        }
+        else if ((std::strcmp(argv[i], "--play") == 0) && (i + 1 < argc))
+        {
+            opts.play = argv[++i];
+        }
+        else
+        {
+            logger->error("Unknown option '{0}'.", argv[i]);
+            return 0;
+        }
+    }
+
+    // Every run advances by whole timesteps, so without a positive one time would stand still
+    if (!(opts.dt > 0.0f))
+    {
+        logger->error("Timestep must be positive, got {0}.", opts.dt);
+        return 0;
+    }
+
+    // Ensembles run many engines of their own and write one file for all of them
+    if (opts.ensemble > 0)
+        return runEnsemble(opts, logger);
+
+    // Initialize engine
+    cot::Engine pEng;
+    pEng.setTrail(opts.trail, opts.trailSpacing);
+    pEng.setLod(opts.lod);
+
+    // Playback only draws recorded frames
+    if (!opts.play.empty())
+    {
+        int ret = runPlayback(pEng, opts, logger);
+        if (!opts.trace.empty())
+            writeTrace(opts.trace, logger);
+        return ret;
+    }
+
+    pEng.setThreads(opts.threads);
+    logger->debug("Initialised engine with {0:d} threads.", opts.threads);
+    logger->info("Force kernel using {0} instructions.", cot::force::isaName(cot::force::detect()));
+
+    // Add bodies from configuration, lines that cannot be read are reported and skipped
+    // Edits of the catalog are only followed from the bodies it started the engine with
+    cot::CatalogReload rld;
+    if (opts.restore.empty())
+    {
+        cot::catalog_t cfgCatalog;
+        cot::cfgLoadCatalog(logger, opts.catalog, opts.threads, cfgCatalog);
+        std::vector<cot::body_handle_t> vHandles;
+        pEng.addBodies(cfgCatalog, &vHandles);
+        if (opts.reload)
+            rld.watch(opts.catalog, cfgCatalog, vHandles);
+    }
+    if (opts.reload && (!opts.restore.empty() || opts.headless))
+    {
+        logger->warn("Catalog reload only follows windowed runs started from the catalog, ignored.");
+        opts.reload = false;
+    }
+    if ((opts.predict > 0.0f) && opts.headless)
+    {
+        logger->warn("Prediction is only drawn in windowed runs, ignored.");
+        opts.predict = 0.0f;
+    }
+
+    // Select solver and report its error against direct summation
+    pEng.setSoftening(opts.softening);
+    pEng.setSolver(opts.solver, opts.theta);
+    pEng.setIntegrator(opts.integrator);
+    pEng.setTolerance(opts.tolerance);
+    pEng.setCollisions(opts.collisions);
+    pEng.setDiagnostics(opts.diagnostics);
+    logger->info("Integrating with {0}.", cot::integrator::name(opts.integrator));
+
+    // Resume from a checkpoint instead, once the integrator whose state it may carry is selected
+    if (!opts.restore.empty())
+    {
+        auto tBegin = std::chrono::steady_clock::now();
+        if (!pEng.restore(opts.restore))
+        {
+            logger->error("Unable to restore checkpoint '{0}'.", opts.restore);
+            return 0;
+        }
+        std::chrono::duration<double> tElapsed = std::chrono::steady_clock::now() - tBegin;
+        logger->info("Restored {0:d} bodies at {1:.3f} sec from checkpoint '{2}' in {3:.3f} sec.", 
+            pEng.snapshot().count, pEng.time(), opts.restore, tElapsed.count());
+    }
+    if (opts.solver == cot::SOLVER_BARNES_HUT)
+    {
+        cot::solver_error_t err = pEng.solverError();
+        logger->info("Barnes-Hut solver with opening angle {:.2f} has acceleration error rms {:.2e} max {:.2e}.", 
+            opts.theta, err.rms, err.max);
+    }
+
+    // Start telemetry writer
+    cot::Telemetry tel;
+    tel.setInterval(opts.telemetryInterval);
+    tel.setLossless(opts.headless);
+    if (!opts.telemetry.empty())
+    {
+        if (tel.open(opts.telemetry))
+            logger->info("Writing telemetry to '{0}' every {1:.4f} sec.", opts.telemetry, opts.telemetryInterval);
+        else
+            logger->error("Unable to create telemetry file '{0}'.", opts.telemetry);
+    }
+
+    // Start live telemetry server
+    cot::TelemetryServer srv;
+    srv.setInterval(opts.telemetryInterval);
+    if (!opts.serve.empty())
+    {
+        if (srv.open(opts.serve))
+            logger->info("Serving live telemetry on '{0}'.", opts.serve);
+        else
+            logger->error("Unable to serve live telemetry on '{0}'.", opts.serve);
+    }
+
+    // Checkpoints are written in the background
+    cot::CheckpointWriter cpw;
+
+    int ret = (opts.headless ? runHeadless(pEng, tel, srv, cpw, opts, logger) : runWindowed(pEng, tel, srv, cpw, rld, opts, logger));
+    if (!opts.trace.empty())
+        writeTrace(opts.trace, logger);
+    if (opts.collisions)
+        logger->info("Merged {0:d} bodies, {1:d} remain.", pEng.merges(), pEng.snapshot().count);
+    for (std::size_t level = 0; level < pEng.levels().size(); level++)
+    {
+        if (pEng.levels()[level] > 0)
+            logger->info("Block timestep level {0:d} (dt/{1:d}) holds {2:d} bodies.", level, std::uint64_t(1) << level, pEng.levels()[level]);
+    }
+    if (!pEng.driftSeries().empty())
+    {
+        double mDrift = 0.0;
+        for (const double cDrift : pEng.driftSeries())
+            mDrift = std::max(mDrift, std::abs(cDrift));
+        logger->info("Energy drift {0:+.3e} after {1:d} steps, largest {2:.3e}.", pEng.diagnostics().drift, pEng.driftSeries().size(), mDrift);
+    }
+
+    // Flush remaining telemetry
+    tel.close();
+    if (!opts.telemetry.empty())
+        logger->info("Wrote {0:d} telemetry records, dropped {1:d}.", tel.written(), tel.dropped());
+    cpw.wait();
+    if (cpw.saved() + cpw.failed() > 0)
+        logger->info("Wrote {0:d} checkpoints, {1:d} failed.", cpw.saved(), cpw.failed());
+    srv.close();
+    if (!opts.serve.empty())
+        logger->info("Served {0:d} live telemetry frames, dropped {1:d}.", srv.sent(), srv.dropped());
+    return ret;
+}
@@ -0,0 +1,47 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+cot::MappedFile::~MappedFile()
+{
+    this->close();
+}
+
+bool cot::MappedFile::open(const std::string& path, const bool sequential)
+{
+    this->close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if ((::fstat(fd, &st) != 0) || (st.st_size <= 0))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Mapping stays valid once the descriptor is closed
+    void* pMap = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (pMap == MAP_FAILED)
+        return false;
+    ::madvise(pMap, st.st_size, (sequential ? MADV_SEQUENTIAL : MADV_NORMAL));
+
+    this->pData = static_cast<const std::uint8_t*>(pMap);
+    this->nSize = st.st_size;
+    return true;
+}
+
+void cot::MappedFile::close()
+{
+    if (this->pData)
+        ::munmap(const_cast<std::uint8_t*>(this->pData), this->nSize);
+    this->pData = nullptr;
+    this->nSize = 0;
+}
@@ -2,18 +2,193 @@
 // Malhar Palkar
 #include <curious-orbital-toy.hpp>
 
+#include <cstdarg>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
-#include <sstream>
 #include <sys/resource.h>
 #include <sys/times.h>
+#include <time.h>
 #include <unistd.h>
 
+// Number of phases kept per thread, older ones are overwritten
+static const std::size_t param_zoneRing = 1 << 14;
+
+// How often the overlay, processor and memory usage are refreshed (sec)
+static const cot::math_t param_sampleInterval = 0.5f;
+
+// Longest overlay text, longer text is cut short
+static const std::size_t param_metricsText = 1024;
+
 static sf::Font sfFntMetrics;
 static sf::Text sfTxtMetrics;
 
+// Overlay text, formatted in place so a sample never allocates
+static char szMetrics[param_metricsText];
+
 static clock_t lastCPU, lastSysCPU, lastUserCPU;
 static int numProcessors = 0;
 
+// Phases recorded by one thread, written only by that thread
+typedef struct _zone_ring
+{
+    std::uint32_t thread;                                   // Index of the thread, in order of its first phase
+    std::atomic<std::uint64_t> begin[param_zoneRing];       // Time each phase began (nanoseconds)
+    std::atomic<std::uint64_t> end[param_zoneRing];         // Time each phase ended (nanoseconds)
+    std::atomic<std::uint8_t> phase[param_zoneRing];        // Phase of each entry
+    std::atomic<std::uint64_t> count{0};                    // Number of phases ever recorded
+    std::uint64_t summarised = 0;                           // Number of phases already in a summary, owned by update
+} zone_ring_t;
+
+// Rings of every thread that recorded a phase, only locked when a thread records its first phase
+static std::mutex mtxRings;
+static std::vector<std::unique_ptr<zone_ring_t>> vRings;
+
+// Durations (milliseconds) of each phase since the last summary, reused between summaries
+static std::vector<double> vDurations[cot::metrics::PHASE_COUNT];
+
+/**
+ * @brief Ring of the calling thread, created on first use
+*/
+static zone_ring_t& threadRing()
+{
+    thread_local zone_ring_t* pRing = nullptr;
+    if (!pRing)
+    {
+        std::lock_guard<std::mutex> lock(mtxRings);
+        vRings.push_back(std::make_unique<zone_ring_t>());
+        pRing = vRings.back().get();
+        pRing->thread = static_cast<std::uint32_t>(vRings.size() - 1);
+    }
+    return *pRing;
+}
+
+#ifdef COT_COUNT_ALLOCATIONS
+// Number of allocations made by every thread of this process
+static std::atomic<std::uint64_t> nAllocations{0};
+
+void* operator new(std::size_t size)
+{
+    nAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+/**
+ * @brief Appends formatted text to a fixed buffer, cutting it short once the buffer is full
+ * @param io_len Length of the text already in the buffer, advanced past the appended text
+*/
+static void appendf(char* buf, const std::size_t size, std::size_t& io_len, const char* format, ...)
+{
+    if (io_len + 1 >= size)
+        return;
+    va_list args;
+    va_start(args, format);
+    const int n = std::vsnprintf(buf + io_len, size - io_len, format, args);
+    va_end(args);
+    if (n > 0)
+        io_len = std::min(size - 1, io_len + static_cast<std::size_t>(n));
+}
+
+/**
+ * @brief Value at a fraction of the way through an unsorted array, which is partially sorted
+*/
+static double percentile(std::vector<double>& v, const double fraction)
+{
+    auto itAt = v.begin() + static_cast<std::ptrdiff_t>(fraction * (v.size() - 1));
+    std::nth_element(v.begin(), itAt, v.end());
+    return *itAt;
+}
+
+const char* cot::metrics::phaseName(const phase_t phase)
+{
+    switch (phase)
+    {
+    case PHASE_INPUT:
+        return "input";
+    case PHASE_PHYSICS:
+        return "physics";
+    case PHASE_TRAILS:
+        return "trails";
+    case PHASE_DRAW:
+        return "draw";
+    case PHASE_DISPLAY:
+        return "display";
+    case PHASE_PUBLISH:
+        return "publish";
+    default:
+        return "unknown";
+    }
+}
+
+std::uint64_t cot::metrics::now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void cot::metrics::record(const phase_t phase, const std::uint64_t begin, const std::uint64_t end)
+{
+    zone_ring_t& ring = threadRing();
+    const std::uint64_t n = ring.count.load(std::memory_order_relaxed);
+    const std::size_t k = n % param_zoneRing;
+    ring.begin[k].store(begin, std::memory_order_relaxed);
+    ring.end[k].store(end, std::memory_order_relaxed);
+    ring.phase[k].store(static_cast<std::uint8_t>(phase), std::memory_order_relaxed);
+    ring.count.store(n + 1, std::memory_order_release);
+}
+
+std::uint64_t cot::metrics::allocations()
+{
+#ifdef COT_COUNT_ALLOCATIONS
+    return nAllocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+bool cot::metrics::dumpTrace(const std::string& path)
+{
+    std::ofstream fTrace(path);
+    if (!fTrace.is_open())
+        return false;
+
+    // Complete events in microseconds, one track per thread
+    fTrace << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool bFirst = true;
+    std::lock_guard<std::mutex> lock(mtxRings);
+    for (const auto& pRing : vRings)
+    {
+        const std::uint64_t n = pRing->count.load(std::memory_order_acquire);
+        for (std::uint64_t i = (n > param_zoneRing ? n - param_zoneRing : 0); i < n; i++)
+        {
+            const std::size_t k = i % param_zoneRing;
+            const std::uint64_t begin = pRing->begin[k].load(std::memory_order_relaxed);
+            const std::uint64_t end = pRing->end[k].load(std::memory_order_relaxed);
+            fTrace << (bFirst ? "\n" : ",\n") << "{\"name\": \"" << phaseName(static_cast<phase_t>(pRing->phase[k].load(std::memory_order_relaxed)))
+                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << pRing->thread
+                << ", \"ts\": " << begin / 1000 << "." << std::setw(3) << std::setfill('0') << begin % 1000
+                << ", \"dur\": " << (end - begin) / 1000 << "." << std::setw(3) << std::setfill('0') << (end - begin) % 1000 << "}";
+            bFirst = false;
+        }
+    }
+    fTrace << "\n]}" << std::endl;
+    return true;
+}
+
 bool cot::metrics::setup()
 {
     // Load font to use
@@ -52,78 +227,101 @@ bool cot::metrics::setup()
     return true;
 }
 
-void cot::metrics::update(const cot::math_t dt)
+void cot::metrics::update(const cot::math_t dt, const diagnostics_t& diag)
 {
-    // Calculate averaging framerate
-    static const std::size_t nFr = 100;
-    static cot::math_t fr[nFr];
-    for (std::size_t i = nFr - 1; i > 0; i--)
-    {
-        fr[i] = fr[i - 1];
-    }
-    fr[0] = std::abs(1.0f / dt);
-    cot::math_t fr_avg = 0.0f;
-    for (std::size_t i = 0; i < nFr; i++)
-    {
-        fr_avg += fr[i];
-    }
-    fr_avg /= static_cast<cot::math_t>(nFr);
+    // Count frames over the sample interval instead of averaging every frame
+    static cot::math_t sample_timer = param_sampleInterval;
+    static std::size_t sample_frames = 0;
+    static std::uint64_t sample_allocations = allocations();
+    sample_timer += dt;
+    sample_frames++;
+    if (sample_timer < param_sampleInterval)
+        return;
+    cot::math_t fr_avg = sample_frames / sample_timer;
+    const std::size_t nFrames = sample_frames;
+    sample_timer = 0.0f;
+    sample_frames = 0;
 
     // Calculate current RAM usage
-    static std::size_t cRam = 0;
     long rss = 0L;
     FILE* fp = fopen("/proc/self/statm", "r");
     if (fp)
     {
-        fscanf( fp, "%*s%ld", &rss );
+        if (fscanf(fp, "%*s%ld", &rss) != 1)
+            rss = 0L;
         fclose(fp);
     }
     std::size_t mem = (size_t)rss * (size_t)sysconf( _SC_PAGESIZE) / (1024U * 1024U);
 
-    // Calculate CPU usage percentage with a specified frame delay
-    static cot::math_t cpu_usage = 0.0f;
-    static std::size_t cpu_usage_delay = 11;
-    if (cpu_usage_delay > 100)
+    // Calculate CPU usage percentage since the last sample
+    cot::math_t cpu_usage = 0.0f;
+    tms tSample;
+    clock_t currCPU = times(&tSample);
+    if (currCPU <= lastCPU || tSample.tms_stime < lastSysCPU || tSample.tms_utime < lastUserCPU)
     {
-        // Estimate CPU usage time
-        tms tSample;
-        clock_t currCPU = times(&tSample);
+        cpu_usage = -1.0f;
+    }
+    else
+    {
+        cpu_usage = (tSample.tms_stime - lastSysCPU) + (tSample.tms_utime - lastUserCPU);
+        cpu_usage /= (currCPU - lastCPU);
+        cpu_usage /= numProcessors;
+        cpu_usage *= 100;
+    }
+    lastCPU = currCPU;
+    lastSysCPU = tSample.tms_stime;
+    lastUserCPU = tSample.tms_utime;
 
-        if (currCPU <= lastCPU || tSample.tms_stime < lastSysCPU || tSample.tms_utime < lastUserCPU)
-        {
-            cpu_usage = -1.0f;
-        }
-        else
+    // Gather the durations of every phase recorded since the last sample
+    for (auto& cDurations : vDurations)
+        cDurations.clear();
+    {
+        std::lock_guard<std::mutex> lock(mtxRings);
+        for (const auto& pRing : vRings)
         {
-            cpu_usage = (tSample.tms_stime - lastSysCPU) + (tSample.tms_utime - lastUserCPU);
-            cpu_usage /= (currCPU - lastCPU);
-            cpu_usage /= numProcessors;
-            cpu_usage *= 100;
+            const std::uint64_t n = pRing->count.load(std::memory_order_acquire);
+            for (std::uint64_t i = std::max(pRing->summarised, (n > param_zoneRing ? n - param_zoneRing : 0)); i < n; i++)
+            {
+                const std::size_t k = i % param_zoneRing;
+                const std::uint8_t phase = pRing->phase[k].load(std::memory_order_relaxed);
+                if (phase < PHASE_COUNT)
+                    vDurations[phase].push_back((pRing->end[k].load(std::memory_order_relaxed) - pRing->begin[k].load(std::memory_order_relaxed)) * 1e-6);
+            }
+            pRing->summarised = n;
         }
+    }
 
-        // Update for next iteration
-        lastCPU = currCPU;
-        lastSysCPU = tSample.tms_stime;
-        lastUserCPU = tSample.tms_utime;
+    // Generate metrics text
+    std::size_t nLen = 0;
+    appendf(szMetrics, param_metricsText, nLen, "CPU: %5.2f%% \tRAM: %zuMB\tFPS: %.0f", cpu_usage, mem, std::abs(fr_avg));
+    for (std::size_t phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        if (vDurations[phase].empty())
+            continue;
+        appendf(szMetrics, param_metricsText, nLen, "\n%s: p50 %.3fms  p99 %.3fms", phaseName(static_cast<phase_t>(phase)),
+            percentile(vDurations[phase], 0.5), percentile(vDurations[phase], 0.99));
+    }
 
-        // Reset delay
-        cpu_usage_delay = 0;
+    // Heap allocations of every thread, which steady frames should not make at all
+    if (countAllocations)
+    {
+        const std::uint64_t nAllocs = allocations();
+        appendf(szMetrics, param_metricsText, nLen, "\nallocations: %.2f/frame", static_cast<double>(nAllocs - sample_allocations) / nFrames);
+        sample_allocations = nAllocs;
     }
-    cpu_usage_delay++;
 
-    // Generate metrics text
-    std::ostringstream strMets;
-    strMets.setf(std::ios::fixed);
-    strMets << "CPU: " << std::setprecision(2) << std::setw(5) << cpu_usage << "% " << '\t';
-    strMets << "RAM: " << std::setprecision(0) << mem << "MB" << '\t';
-    strMets << "FPS: " << std::setprecision(0) << std::abs(fr_avg);
-    sfTxtMetrics.setString(strMets.str());
+    // Conserved quantities, with the virial ratio 2K / |W| near 1 for a system in equilibrium
+    if (diag.valid)
+    {
+        appendf(szMetrics, param_metricsText, nLen, "\nenergy: %.6g  drift: %+.2g", diag.kinetic + diag.potential, diag.drift);
+        if (diag.virial != 0.0)
+            appendf(szMetrics, param_metricsText, nLen, "  virial: %.3g", 2.0 * diag.kinetic / std::abs(diag.virial));
+        appendf(szMetrics, param_metricsText, nLen, "\nmomentum: %.6g  angular: %.6g", std::sqrt(diag.px * diag.px + diag.py * diag.py), diag.angular);
+    }
+    sfTxtMetrics.setString(szMetrics);
 }
 
 void cot::metrics::draw(sf::RenderWindow& wind)
 {
     wind.draw(sfTxtMetrics);
 }
-
-
-
@@ -0,0 +1,299 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <cstring>
+#include <limits>
+
+/**
+ * @brief Reads a column of values of any width into an array of the engine precision
+*/
+static void readColumn(const std::uint8_t* src, const std::size_t n, const std::uint32_t valueSize, std::vector<cot::math_t>& out)
+{
+    out.resize(n);
+    if (valueSize == sizeof(cot::math_t))
+    {
+        std::memcpy(out.data(), src, n * sizeof(cot::math_t));
+        return;
+    }
+
+    // Recorded in the other precision
+    for (std::size_t i = 0; i < n; i++)
+    {
+        if (valueSize == sizeof(float))
+        {
+            float v;
+            std::memcpy(&v, src + i * sizeof(float), sizeof(float));
+            out[i] = static_cast<cot::math_t>(v);
+        }
+        else
+        {
+            double v;
+            std::memcpy(&v, src + i * sizeof(double), sizeof(double));
+            out[i] = static_cast<cot::math_t>(v);
+        }
+    }
+}
+
+cot::Playback::~Playback()
+{
+    this->close();
+}
+
+bool cot::Playback::open(const std::string& path)
+{
+    this->close();
+
+    // Map the whole file, pages are only read when a frame is
+    if (!this->mapFile.open(path, false))
+        return false;
+    this->pData = this->mapFile.data();
+    this->nSize = this->mapFile.size();
+    if (this->nSize < sizeof(telemetry::file_header_t))
+    {
+        this->close();
+        return false;
+    }
+
+    // Check the format is one we can read
+    telemetry::file_header_t fh;
+    std::memcpy(&fh, this->pData, sizeof(fh));
+    if ((fh.magic != telemetry::fileMagic) || (fh.version < 1) || (fh.version > telemetry::version) || 
+        (fh.columns != telemetry::COLUMN_COUNT) || ((fh.valueSize != sizeof(float)) && (fh.valueSize != sizeof(double))))
+    {
+        this->close();
+        return false;
+    }
+    this->nVersion = fh.version;
+    this->nValueSize = fh.valueSize;
+
+    // Read the keyframe index closing the file, or rebuild it if the file was not closed
+    const std::size_t nTrailer = sizeof(telemetry::index_trailer_t);
+    telemetry::index_trailer_t trailer = {};
+    if ((fh.version >= 2) && (this->nSize >= sizeof(fh) + nTrailer))
+        std::memcpy(&trailer, this->pData + this->nSize - nTrailer, nTrailer);
+    if ((trailer.magic == telemetry::indexMagic) && 
+        (trailer.count <= (this->nSize - sizeof(fh) - nTrailer) / sizeof(telemetry::keyframe_t)))
+    {
+        this->nEnd = this->nSize - nTrailer - trailer.count * sizeof(telemetry::keyframe_t);
+        this->vKeyframes.resize(trailer.count);
+        std::memcpy(this->vKeyframes.data(), this->pData + this->nEnd, trailer.count * sizeof(telemetry::keyframe_t));
+
+        // Offsets are only trusted if every keyframe is a whole frame, in file order
+        for (std::size_t k = 0; k < this->vKeyframes.size(); k++)
+        {
+            if (!this->complete(this->vKeyframes[k].offset, this->nEnd) || 
+                ((k > 0) && (this->vKeyframes[k].offset <= this->vKeyframes[k - 1].offset)))
+            {
+                this->vKeyframes.clear();
+                break;
+            }
+        }
+    }
+    if (this->vKeyframes.empty())
+        this->scan(sizeof(fh));
+    if (this->vKeyframes.empty())
+    {
+        this->close();
+        return false;
+    }
+
+    // Last frame is at most a keyframe interval past the last keyframe
+    this->mBegin = this->vKeyframes.front().time;
+    this->mEnd = this->header(this->locate(std::numeric_limits<double>::infinity(), 0)).time;
+
+    // Start at the first frame
+    this->mClock = this->mBegin;
+    this->load(this->vKeyframes.front().offset, true);
+    return true;
+}
+
+void cot::Playback::close()
+{
+    this->mapFile.close();
+    this->pData = nullptr;
+    this->nSize = 0;
+    this->nEnd = 0;
+    this->vKeyframes.clear();
+}
+
+cot::telemetry::frame_header_t cot::Playback::header(const std::uint64_t offset) const
+{
+    // Frames are not aligned to the width of their fields, and headers of earlier versions have no diagnostics
+    telemetry::frame_header_t h;
+    telemetry::setDiagnostics(h, diagnostics_t());
+    std::memcpy(&h, this->pData + offset, telemetry::frameHeaderSize(this->nVersion));
+    return h;
+}
+
+std::uint64_t cot::Playback::next(const std::uint64_t offset) const
+{
+    return offset + telemetry::frameSize(this->header(offset).count, this->nValueSize, this->nVersion);
+}
+
+bool cot::Playback::complete(const std::uint64_t offset, const std::uint64_t end) const
+{
+    if ((offset < sizeof(telemetry::file_header_t)) || (offset > end) || (end - offset < telemetry::frameHeaderSize(this->nVersion)))
+        return false;
+    const telemetry::frame_header_t h = this->header(offset);
+    return (h.magic == telemetry::frameMagic) && (telemetry::frameSize(h.count, this->nValueSize, this->nVersion) <= end - offset);
+}
+
+void cot::Playback::scan(const std::uint64_t begin)
+{
+    // Walk frame headers until the end of the file or the first incomplete frame
+    std::uint64_t offset = begin;
+    while (offset + telemetry::frameHeaderSize(this->nVersion) <= this->nSize)
+    {
+        telemetry::frame_header_t h = this->header(offset);
+        std::uint64_t size = telemetry::frameSize(h.count, this->nValueSize, this->nVersion);
+        if ((h.magic != telemetry::frameMagic) || (offset + size > this->nSize))
+            break;
+
+        // Same spacing as the writer
+        if (this->vKeyframes.empty() || (offset - this->vKeyframes.back().offset >= telemetry::keyframeBytes))
+            this->vKeyframes.push_back(telemetry::keyframe_t{ h.time, offset });
+        offset += size;
+    }
+    this->nEnd = offset;
+}
+
+std::uint64_t cot::Playback::locate(const double time, const std::uint64_t from) const
+{
+    // Last keyframe at or before the time
+    auto itKey = std::upper_bound(this->vKeyframes.begin(), this->vKeyframes.end(), time, 
+        [](const double t, const telemetry::keyframe_t& key) { return t < key.time; });
+    std::uint64_t offset = (itKey == this->vKeyframes.begin() ? this->vKeyframes.front().offset : std::prev(itKey)->offset);
+    offset = std::max(offset, from);
+
+    // Read forward to the last frame at or before the time
+    for (std::uint64_t nextOffset = this->next(offset); this->complete(nextOffset, this->nEnd); nextOffset = this->next(offset))
+    {
+        if (this->header(nextOffset).time > time)
+            break;
+        offset = nextOffset;
+    }
+    return offset;
+}
+
+void cot::Playback::load(const std::uint64_t offset, const bool cut)
+{
+    const telemetry::frame_header_t h = this->header(offset);
+    const std::size_t n = h.count;
+
+    // Identifier column, then the value columns
+    const std::uint8_t* pIds = this->pData + offset + telemetry::frameHeaderSize(this->nVersion);
+    this->frmCurrent.id.resize(n);
+    std::memcpy(this->frmCurrent.id.data(), pIds, n * sizeof(std::uint32_t));
+    const std::uint8_t* pColumns = pIds + n * sizeof(std::uint32_t);
+    const std::size_t nColumn = n * this->nValueSize;
+    readColumn(pColumns + telemetry::COLUMN_X * nColumn, n, this->nValueSize, this->frmCurrent.x);
+    readColumn(pColumns + telemetry::COLUMN_Y * nColumn, n, this->nValueSize, this->frmCurrent.y);
+    readColumn(pColumns + telemetry::COLUMN_VX * nColumn, n, this->nValueSize, this->frmCurrent.vx);
+    readColumn(pColumns + telemetry::COLUMN_VY * nColumn, n, this->nValueSize, this->frmCurrent.vy);
+    readColumn(pColumns + telemetry::COLUMN_MASS * nColumn, n, this->nValueSize, this->frmCurrent.mass);
+
+    // Accelerations and names are not recorded, so no force arrows are drawn
+    this->frmCurrent.ax.assign(n, 0.0f);
+    this->frmCurrent.ay.assign(n, 0.0f);
+    this->frmCurrent.name.assign(n, 0);
+    this->frmCurrent.step = h.step;
+    this->frmCurrent.time = static_cast<math_t>(h.time);
+    this->frmCurrent.cut = cut;
+    this->frmCurrent.generation = h.step;
+    this->frmCurrent.layout = h.step;
+
+    // Diagnostics were recorded if the energy is a number
+    diagnostics_t& diag = this->frmCurrent.diag;
+    diag.valid = !std::isnan(h.kinetic);
+    diag.kinetic = h.kinetic;
+    diag.potential = h.potential;
+    diag.virial = h.virial;
+    diag.px = h.px;
+    diag.py = h.py;
+    diag.angular = h.angular;
+    diag.drift = h.drift;
+
+    this->nCursor = offset;
+    this->bChanged = true;
+}
+
+double cot::Playback::begin() const
+{
+    return this->mBegin;
+}
+
+double cot::Playback::end() const
+{
+    return this->mEnd;
+}
+
+std::size_t cot::Playback::keyframes() const
+{
+    return this->vKeyframes.size();
+}
+
+void cot::Playback::seek(const double time)
+{
+    if (!this->pData)
+        return;
+
+    this->mClock = std::min(std::max(time, this->mBegin), this->mEnd);
+    std::uint64_t offset = this->locate(this->mClock, 0);
+    if (offset != this->nCursor)
+        this->load(offset, true);
+}
+
+void cot::Playback::advance(const double dt)
+{
+    if (!this->pData || this->bPaused)
+        return;
+
+    // Playing backwards seeks, since frames can only be read forwards
+    if (this->mSpeed < 0.0)
+    {
+        this->seek(this->mClock + dt * this->mSpeed);
+        return;
+    }
+
+    // Playing forwards reads on from the current frame, or the nearest keyframe if that is closer
+    this->mClock = std::min(this->mClock + dt * this->mSpeed, this->mEnd);
+    std::uint64_t offset = this->locate(this->mClock, this->nCursor);
+    if (offset != this->nCursor)
+        this->load(offset, false);
+}
+
+void cot::Playback::setSpeed(const double speed)
+{
+    // A stopped clock could never be sped up again, pausing is what stops it
+    if (speed != 0.0)
+        this->mSpeed = speed;
+}
+
+double cot::Playback::speed() const
+{
+    return this->mSpeed;
+}
+
+void cot::Playback::setPaused(const bool paused)
+{
+    this->bPaused = paused;
+}
+
+bool cot::Playback::paused() const
+{
+    return this->bPaused;
+}
+
+double cot::Playback::time() const
+{
+    return this->mClock;
+}
+
+const cot::frame_t* cot::Playback::take()
+{
+    if (!this->bChanged)
+        return nullptr;
+    this->bChanged = false;
+    return &this->frmCurrent;
+}
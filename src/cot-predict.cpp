@@ -0,0 +1,282 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <chrono>
+#include <numeric>
+
+// Number of points of each predicted path, the first being where the body was cloned
+static const std::size_t param_predictPoints = 256;
+
+// Number of passes after the first, each halving the step and predicting the whole horizon again
+static const std::uint32_t param_predictRefinements = 3;
+
+// Points the first pass predicts between publications, so the path grows over successive frames
+static const std::size_t param_predictPublish = 16;
+
+// Bodies kept besides the selected ones, the heaviest of the rest, as the light ones barely pull on anything
+static const std::size_t param_predictSources = 256;
+
+// Clones of more bodies than this are summed by Barnes-Hut at a coarse opening angle
+static const std::size_t param_predictDirect = 64;
+static const cot::math_t param_predictTheta = 1.0f;
+
+// Share of the horizon the clone may fall behind the frame drawn before the frame is cloned again
+static const cot::math_t param_predictStale = 0.1f;
+
+// How long the worker sleeps when no request is waiting
+static const std::chrono::milliseconds param_predictIdle(2);
+
+// Colour of predicted paths, fading out towards the horizon
+static const sf::Color param_predictColour(96, 192, 255);
+
+cot::Predictor::~Predictor()
+{
+    this->stop();
+}
+
+void cot::Predictor::start(const math_t horizon, const math_t eps)
+{
+    this->stop();
+    this->mHorizon = horizon;
+    this->mSoftening = eps;
+    this->bStop = false;
+    this->thrWorker = std::thread(&Predictor::worker, this);
+}
+
+void cot::Predictor::stop()
+{
+    if (!this->thrWorker.joinable())
+        return;
+    this->bStop = true;
+    this->thrWorker.join();
+}
+
+bool cot::Predictor::running() const
+{
+    return this->thrWorker.joinable();
+}
+
+void cot::Predictor::select(const std::uint32_t id)
+{
+    auto itSelected = std::find(this->vSelected.begin(), this->vSelected.end(), id);
+    if (itSelected != this->vSelected.end())
+        this->vSelected.erase(itSelected);
+    else
+        this->vSelected.push_back(id);
+    this->nSelection++;
+}
+
+void cot::Predictor::clearSelection()
+{
+    this->vSelected.clear();
+    this->nSelection++;
+}
+
+void cot::Predictor::track(const snapshot_t& snap)
+{
+    // The last clone stands while it covers the same bodies and is recent enough
+    if (this->nRequestSelection == this->nSelection)
+    {
+        if (this->vSelected.empty())
+            return;
+        const math_t mAge = snap.time - this->mRequestTime;
+        if ((this->nRequestLayout == snap.layout) && (mAge >= 0.0f) && (mAge <= param_predictStale * this->mHorizon))
+            return;
+    }
+
+    // Bodies merged away since they were selected leave the selection
+    request_t& req = this->bufRequests.back();
+    req.index.clear();
+    std::size_t nKept = 0;
+    for (const std::uint32_t cId : this->vSelected)
+    {
+        const std::uint32_t* pFound = std::find(snap.id, snap.id + snap.count, cId);
+        if (pFound == snap.id + snap.count)
+            continue;
+        this->vSelected[nKept++] = cId;
+        req.index.push_back(static_cast<std::uint32_t>(pFound - snap.id));
+    }
+    if (nKept != this->vSelected.size())
+    {
+        this->vSelected.resize(nKept);
+        this->nSelection++;
+    }
+    this->nRequestSelection = this->nSelection;
+    this->nRequestLayout = snap.layout;
+    this->mRequestTime = snap.time;
+
+    // The worker abandons its request as soon as a newer one is made, so it is numbered before it is published
+    const std::uint64_t nSerial = ++this->nSerial;
+    this->nRequested.store(nSerial, std::memory_order_release);
+    if (this->vSelected.empty())
+        return;
+
+    const std::size_t n = snap.count;
+    req.serial = nSerial;
+    req.selection = this->nSelection;
+    req.layout = snap.layout;
+    req.time = snap.time;
+    req.x.assign(snap.x, snap.x + n);
+    req.y.assign(snap.y, snap.y + n);
+    req.vx.assign(snap.vx, snap.vx + n);
+    req.vy.assign(snap.vy, snap.vy + n);
+    req.mass.assign(snap.mass, snap.mass + n);
+    req.id.assign(snap.id, snap.id + n);
+    this->bufRequests.publish();
+}
+
+void cot::Predictor::worker()
+{
+    while (!this->bStop.load(std::memory_order_relaxed))
+    {
+        if (!this->bufRequests.acquire())
+        {
+            std::this_thread::sleep_for(param_predictIdle);
+            continue;
+        }
+        const request_t& req = this->bufRequests.front();
+        if (req.serial == this->nRequested.load(std::memory_order_acquire))
+            this->predict(req);
+    }
+}
+
+void cot::Predictor::predict(const request_t& req)
+{
+    const std::size_t n = req.mass.size();
+    const std::size_t nSelected = req.index.size();
+    auto fnAbandoned = [&]()
+    {
+        return this->bStop.load(std::memory_order_relaxed) || (this->nRequested.load(std::memory_order_relaxed) != req.serial);
+    };
+
+    // Clone the selected bodies first, so they keep their index, then the heaviest of the rest
+    catalog_t& cat = this->catClone;
+    cat.mass.clear();
+    cat.x.clear();
+    cat.y.clear();
+    cat.vx.clear();
+    cat.vy.clear();
+    auto fnClone = [&](const std::size_t i)
+    {
+        cat.mass.push_back(req.mass[i]);
+        cat.x.push_back(req.x[i]);
+        cat.y.push_back(req.y[i]);
+        cat.vx.push_back(req.vx[i]);
+        cat.vy.push_back(req.vy[i]);
+    };
+    for (const std::uint32_t cIndex : req.index)
+        fnClone(cIndex);
+
+    this->vOthers.resize(n);
+    std::iota(this->vOthers.begin(), this->vOthers.end(), 0u);
+    const std::size_t nHeaviest = std::min(n, param_predictSources + nSelected);
+    std::nth_element(this->vOthers.begin(), this->vOthers.begin() + nHeaviest - 1, this->vOthers.end(),
+        [&](const std::uint32_t a, const std::uint32_t b) { return req.mass[a] > req.mass[b]; });
+    for (std::size_t k = 0; (k < nHeaviest) && (cat.size() < nSelected + param_predictSources); k++)
+    {
+        if (std::find(req.index.begin(), req.index.end(), this->vOthers[k]) == req.index.end())
+            fnClone(this->vOthers[k]);
+    }
+    cat.name.resize(cat.size());
+
+    const std::size_t nPoints = param_predictPoints;
+    const math_t mSpacing = this->mHorizon / static_cast<math_t>(nPoints - 1);
+    const solver_t solver = (cat.size() > param_predictDirect ? SOLVER_BARNES_HUT : SOLVER_DIRECT);
+    this->vPath.resize(nSelected * nPoints);
+    for (std::size_t j = 0; j < nSelected; j++)
+        this->vPath[j * nPoints] = sf::Vector2f(static_cast<float>(cat.x[j]), static_cast<float>(cat.y[j]));
+
+    for (std::uint32_t pass = 0; pass <= param_predictRefinements; pass++)
+    {
+        // Every pass starts over from the clone, without collisions, at half the step of the pass before
+        Engine eng;
+        eng.setSoftening(this->mSoftening);
+        eng.setSolver(solver, param_predictTheta);
+        eng.setIntegrator(INTEGRATOR_LEAPFROG);
+        eng.addBodies(cat);
+        const std::uint32_t nSubsteps = 1u << pass;
+        const math_t dt = mSpacing / static_cast<math_t>(nSubsteps);
+
+        for (std::size_t k = 1; k < nPoints; k++)
+        {
+            for (std::uint32_t s = 0; s < nSubsteps; s++)
+            {
+                if (fnAbandoned())
+                    return;
+                eng.update(dt);
+            }
+            const snapshot_t snap = eng.snapshot();
+            for (std::size_t j = 0; j < nSelected; j++)
+                this->vPath[j * nPoints + k] = sf::Vector2f(static_cast<float>(snap.x[j]), static_cast<float>(snap.y[j]));
+
+            // The coarse path is handed over as it grows, finer ones replace it only once complete
+            if ((pass == 0) && ((k % param_predictPublish == 0) || (k + 1 == nPoints)))
+                this->publish(req, mSpacing, k + 1, pass);
+        }
+        if (pass > 0)
+            this->publish(req, mSpacing, nPoints, pass);
+    }
+}
+
+void cot::Predictor::publish(const request_t& req, const math_t spacing, const std::size_t points, const std::uint32_t refinement)
+{
+    prediction_t& pred = this->bufPredictions.back();
+    pred.serial = req.serial;
+    pred.selection = req.selection;
+    pred.layout = req.layout;
+    pred.time = req.time;
+    pred.spacing = spacing;
+    pred.points = points;
+    pred.refinement = refinement;
+    pred.id.clear();
+    for (const std::uint32_t cIndex : req.index)
+        pred.id.push_back(req.id[cIndex]);
+    pred.index.assign(req.index.begin(), req.index.end());
+    pred.path.assign(this->vPath.begin(), this->vPath.end());
+    this->bufPredictions.publish();
+}
+
+void cot::Predictor::draw(sf::RenderTarget& target, const snapshot_t& snap)
+{
+    if (!this->running())
+        return;
+    this->track(snap);
+
+    // Paths of an older clone are drawn until the newer one comes in, as long as they are for the same selection
+    this->bufPredictions.acquire();
+    const prediction_t& pred = this->bufPredictions.front();
+    if ((pred.selection != this->nSelection) || pred.id.empty() || (pred.points < 2))
+        return;
+
+    // Points the frame has already passed are skipped
+    const std::size_t nPerPath = pred.path.size() / pred.id.size();
+    const math_t mAhead = std::max(snap.time - pred.time, static_cast<math_t>(0.0f));
+    const std::size_t kFirst = static_cast<std::size_t>(mAhead / pred.spacing) + 1;
+    if (kFirst >= pred.points)
+        return;
+
+    this->vaPaths.resize(2 * pred.id.size() * (pred.points - kFirst));
+    std::size_t v = 0;
+    for (std::size_t j = 0; j < pred.id.size(); j++)
+    {
+        // Each path picks up from where its body is now, found by index while the bodies are the same as when cloned
+        const sf::Vector2f* pPath = pred.path.data() + j * nPerPath;
+        const std::uint32_t i = pred.index[j];
+        sf::Vector2f vFrom = pPath[kFirst - 1];
+        if ((pred.layout == snap.layout) && (i < snap.count) && (snap.id[i] == pred.id[j]))
+            vFrom = sf::Vector2f(static_cast<float>(snap.x[i]), static_cast<float>(snap.y[i]));
+
+        for (std::size_t k = kFirst; k < pred.points; k++)
+        {
+            sf::Color colFrom = param_predictColour, colTo = param_predictColour;
+            colFrom.a = static_cast<sf::Uint8>(255 * (nPerPath - k + 1) / nPerPath);
+            colTo.a = static_cast<sf::Uint8>(255 * (nPerPath - k) / nPerPath);
+            this->vaPaths[v++] = sf::Vertex(vFrom, colFrom);
+            this->vaPaths[v++] = sf::Vertex(pPath[k], colTo);
+            vFrom = pPath[k];
+        }
+    }
+
+    target.draw(this->vaPaths);
+}
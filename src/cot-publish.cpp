@@ -2,14 +2,37 @@
 // Malhar Palkar
 #include <curious-orbital-toy.hpp>
 
-#include <sstream>
+#include <cstdio>
+#include <string>
 
-// How often to publish the system states
+// How often to log the engine thread times
 static const cot::math_t param_publishInterval = 0.1f;
 
-void cot::processPublish(Engine& eng, const math_t dt, std::shared_ptr<spdlog::logger> logger)
+// Text of the debug lines, kept between publishes so logging does not allocate once it has grown
+static std::string sThreads, sLevels;
+
+/**
+ * @brief Appends a short formatted entry to a line of text
+*/
+template <class... TArgs>
+static void append(std::string& line, const char* format, TArgs... args)
+{
+    char szEntry[32];
+    const int n = std::snprintf(szEntry, sizeof(szEntry), format, args...);
+    if (n > 0)
+        line.append(szEntry, std::min(sizeof(szEntry) - 1, static_cast<std::size_t>(n)));
+}
+
+void cot::processPublish(Engine& eng, const math_t dt, Telemetry& telemetry, TelemetryServer& server, std::shared_ptr<spdlog::logger> logger)
 {
     static auto publish_timer = 0.0f;
+    metrics::Zone zone(metrics::PHASE_PUBLISH);
+
+    // Queue the state of every body for the telemetry writer
+    telemetry.record(eng, dt);
+
+    // Stream the state to live subscribers, if any
+    server.publish(eng, dt);
 
     // Proceed only if the publish interval has passed
     publish_timer += dt;
@@ -19,19 +42,22 @@ void cot::processPublish(Engine& eng, const math_t dt, std::shared_ptr<spdlog::l
     // Reset publish interval timer
     publish_timer = 0.0f;
 
-    // Publish all bodies in the system
-    auto pStates = eng.publish();
+    // Busy time of each engine thread during the last update
+    if (!logger->should_log(spdlog::level::debug))
+        return;
+    sThreads.clear();
+    for (const auto& cTime : eng.threadTimes())
+        append(sThreads, " %gms", cTime * 1000.0);
+    logger->debug("Engine thread times:{0}", sThreads);
 
-    // Write published bodies to string
-    for (const auto& cState : pStates)
+    // Number of bodies on each block timestep level
+    if (eng.levels().empty())
+        return;
+    sLevels.clear();
+    for (std::size_t level = 0; level < eng.levels().size(); level++)
     {
-        // Print format string to stream
-        std::ostringstream ss_publish;
-        ss_publish << "Body '" << cState.name << "' with mass " << cState.mass;
-        ss_publish << " has (x,y)=(" << cState.position.x << "," << cState.position.y;
-        ss_publish << ") and (dx,dy)/dt=(" << cState.velocity.x << "," << cState.velocity.y << ")";
-
-        // Dump to log stream
-        logger->info(ss_publish.str());
+        if (eng.levels()[level] > 0)
+            append(sLevels, " %zu:%zu", level, eng.levels()[level]);
     }
-}
\ No newline at end of file
+    logger->debug("Block timestep levels:{0}", sLevels);
+}
@@ -0,0 +1,145 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+cot::body_handle_t cot::Engine::acquireSlot(const std::uint32_t index)
+{
+    std::uint32_t slot = this->nFreeSlot;
+    if (slot != UINT32_MAX)
+    {
+        this->nFreeSlot = this->vRegistry[slot].index;
+        this->vRegistry[slot].index = index;
+    }
+    else
+    {
+        slot = static_cast<std::uint32_t>(this->vRegistry.size());
+        this->vRegistry.push_back(registry_slot_t{ index, 0 });
+    }
+    return body_handle_t{ slot, this->vRegistry[slot].generation };
+}
+
+void cot::Engine::releaseSlot(const std::uint32_t slot)
+{
+    this->vRegistry[slot].index = this->nFreeSlot;
+    this->vRegistry[slot].generation++;
+    this->nFreeSlot = slot;
+}
+
+void cot::Engine::resetRegistry()
+{
+    for (const std::uint32_t cSlot : this->vSlots)
+        this->releaseSlot(cSlot);
+    const std::size_t n = this->sysPhysics.size();
+    this->vSlots.resize(n);
+    for (std::size_t i = 0; i < n; i++)
+        this->vSlots[i] = this->acquireSlot(static_cast<std::uint32_t>(i)).slot;
+}
+
+void cot::Engine::invalidateBodies()
+{
+    this->bAccelValid = false;
+    this->bEnergyRef = false;
+    this->vDrift.clear();
+    this->nGeneration++;
+    this->nLayout++;
+}
+
+bool cot::Engine::contains(const body_handle_t handle) const
+{
+    return (handle.slot < this->vRegistry.size()) && (this->vRegistry[handle.slot].generation == handle.generation);
+}
+
+std::size_t cot::Engine::indexOf(const body_handle_t handle) const
+{
+    return (this->contains(handle) ? this->vRegistry[handle.slot].index : SIZE_MAX);
+}
+
+cot::body_handle_t cot::Engine::handleOf(const std::size_t index) const
+{
+    const std::uint32_t slot = this->vSlots[index];
+    return body_handle_t{ slot, this->vRegistry[slot].generation };
+}
+
+bool cot::Engine::removeBody(const body_handle_t handle)
+{
+    if (!this->contains(handle))
+        return false;
+
+    // The last body fills the hole, so only its registry entry moves
+    const std::size_t i = this->vRegistry[handle.slot].index;
+    const std::size_t last = this->sysPhysics.size() - 1;
+    auto fnErase = [i, last](auto& v)
+    {
+        if (i != last)
+            v[i] = std::move(v[last]);
+        v.pop_back();
+    };
+
+    physics_t& phys = this->sysPhysics;
+    fnErase(phys.x);
+    fnErase(phys.y);
+    fnErase(phys.vx);
+    fnErase(phys.vy);
+    fnErase(phys.mass);
+    fnErase(phys.ax);
+    fnErase(phys.ay);
+    fnErase(this->vNames);
+    fnErase(this->vIds);
+    fnErase(this->vRadius);
+    fnErase(this->vSlots);
+    if (i != last)
+        this->vRegistry[this->vSlots[i]].index = static_cast<std::uint32_t>(i);
+    this->releaseSlot(handle.slot);
+    this->invalidateBodies();
+    return true;
+}
+
+std::size_t cot::Engine::removeBodies(const std::vector<body_handle_t>& handles)
+{
+    // Mark every body to remove, then number the rest in order
+    const std::size_t n = this->sysPhysics.size();
+    this->vRemap.assign(n, 0);
+    std::size_t nRemoved = 0;
+    for (const auto& cHandle : handles)
+    {
+        const std::size_t i = this->indexOf(cHandle);
+        if ((i != SIZE_MAX) && (this->vRemap[i] != UINT32_MAX))
+        {
+            this->vRemap[i] = UINT32_MAX;
+            nRemoved++;
+        }
+    }
+    if (nRemoved == 0)
+        return 0;
+    std::uint32_t k = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        if (this->vRemap[i] != UINT32_MAX)
+            this->vRemap[i] = k++;
+    }
+    this->compact(this->vRemap);
+    this->bEnergyRef = false;
+    this->vDrift.clear();
+    return nRemoved;
+}
+
+bool cot::Engine::setBody(const body_handle_t handle, math_t in_mass, vector_t in_pos, vector_t in_vel)
+{
+    const std::size_t i = this->indexOf(handle);
+    if (i == SIZE_MAX)
+        return false;
+    physics_t& phys = this->sysPhysics;
+    phys.x[i] = in_pos.x;
+    phys.y[i] = in_pos.y;
+    phys.vx[i] = in_vel.x;
+    phys.vy[i] = in_vel.y;
+    phys.mass[i] = in_mass;
+    this->vRadius[i] = mass2rad(in_mass);
+
+    // Same bodies in the same places, only their state changed
+    this->bAccelValid = false;
+    this->bEnergyRef = false;
+    this->vDrift.clear();
+    this->nGeneration++;
+    return true;
+}
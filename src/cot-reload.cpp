@@ -0,0 +1,164 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <sys/stat.h>
+
+/**
+ * @brief Modification time (nanoseconds) and size of a file
+ * @return Whether the file exists
+*/
+static bool stamp(const std::string& path, std::int64_t& out_modified, std::int64_t& out_size)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    out_modified = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+    out_size = static_cast<std::int64_t>(st.st_size);
+    return true;
+}
+
+/**
+ * @brief Whether a row of one catalog holds the same body as a row of another
+*/
+static bool sameRow(const cot::catalog_t& a, const std::size_t i, const cot::catalog_t& b, const std::size_t j)
+{
+    return (a.mass[i] == b.mass[j]) && (a.x[i] == b.x[j]) && (a.y[i] == b.y[j]) && (a.vx[i] == b.vx[j]) && (a.vy[i] == b.vy[j]);
+}
+
+/**
+ * @brief Appends a row of one catalog to another
+*/
+static void appendRow(cot::catalog_t& out_catalog, const cot::catalog_t& in_catalog, const std::size_t i)
+{
+    out_catalog.name.push_back(in_catalog.name[i]);
+    out_catalog.mass.push_back(in_catalog.mass[i]);
+    out_catalog.x.push_back(in_catalog.x[i]);
+    out_catalog.y.push_back(in_catalog.y[i]);
+    out_catalog.vx.push_back(in_catalog.vx[i]);
+    out_catalog.vy.push_back(in_catalog.vy[i]);
+}
+
+void cot::CatalogReload::watch(const std::string& path, const catalog_t& in_catalog, const std::vector<body_handle_t>& in_handles)
+{
+    this->sPath = path;
+    this->catApplied = in_catalog;
+    this->vHandles = in_handles;
+    this->bPending = false;
+    if (!stamp(path, this->nReadModified, this->nReadSize))
+    {
+        this->nReadModified = 0;
+        this->nReadSize = -1;
+    }
+    this->nPollModified = this->nReadModified;
+    this->nPollSize = this->nReadSize;
+}
+
+bool cot::CatalogReload::poll()
+{
+    std::int64_t nModified, nSize;
+    if (!stamp(this->sPath, nModified, nSize))
+        return false;
+
+    // Editors may write a file in several goes, so it has to hold still for one poll
+    const bool bSteady = (nModified == this->nPollModified) && (nSize == this->nPollSize);
+    this->nPollModified = nModified;
+    this->nPollSize = nSize;
+    return bSteady && ((nModified != this->nReadModified) || (nSize != this->nReadSize));
+}
+
+bool cot::CatalogReload::prepare(std::shared_ptr<spdlog::logger> logger, const std::size_t nThreads)
+{
+    // The file is not read again until it changes, whether or not it is applied
+    this->nReadModified = this->nPollModified;
+    this->nReadSize = this->nPollSize;
+    this->bPending = false;
+
+    catalog_t cat;
+    if (!cfgLoadCatalog(logger, this->sPath, nThreads, cat))
+    {
+        logger->warn("Catalog '{0}' not reloaded, fix the lines above and save it again.", this->sPath);
+        return false;
+    }
+
+    // Rows of the same name pair up in file order
+    std::unordered_map<std::string, std::vector<std::size_t>> mapRows;
+    for (std::size_t k = 0; k < this->catApplied.size(); k++)
+        mapRows[this->catApplied.name[k]].push_back(k);
+    std::unordered_map<std::string, std::size_t> mapSeen;
+    this->vMatch.assign(cat.size(), SIZE_MAX);
+    for (std::size_t j = 0; j < cat.size(); j++)
+    {
+        auto itRows = mapRows.find(cat.name[j]);
+        const std::size_t nth = mapSeen[cat.name[j]]++;
+        if ((itRows != mapRows.end()) && (nth < itRows->second.size()))
+            this->vMatch[j] = itRows->second[nth];
+    }
+    this->catPending = std::move(cat);
+    this->bPending = true;
+    return true;
+}
+
+void cot::CatalogReload::apply(Engine& eng, std::shared_ptr<spdlog::logger> logger)
+{
+    if (!this->bPending)
+        return;
+    this->bPending = false;
+
+    const catalog_t& cat = this->catPending;
+    std::vector<body_handle_t> vNewHandles(cat.size());
+    std::vector<std::uint8_t> vKept(this->catApplied.size(), 0);
+    catalog_t catAdded;
+    std::vector<std::size_t> vAddedRows;
+    std::size_t nEdited = 0;
+    for (std::size_t j = 0; j < cat.size(); j++)
+    {
+        const std::size_t k = this->vMatch[j];
+        if (k == SIZE_MAX)
+        {
+            appendRow(catAdded, cat, j);
+            vAddedRows.push_back(j);
+            continue;
+        }
+        vKept[k] = 1;
+
+        // Bodies of rows left alone carry on where the simulation took them, even if they merged away
+        if (sameRow(this->catApplied, k, cat, j))
+        {
+            vNewHandles[j] = this->vHandles[k];
+            continue;
+        }
+
+        // Edited rows put their body back where the file says, and bring it back if it merged away
+        if (eng.setBody(this->vHandles[k], cat.mass[j], vector_t(cat.x[j], cat.y[j]), vector_t(cat.vx[j], cat.vy[j])))
+        {
+            vNewHandles[j] = this->vHandles[k];
+            nEdited++;
+        }
+        else
+        {
+            appendRow(catAdded, cat, j);
+            vAddedRows.push_back(j);
+        }
+    }
+
+    // Rows gone from the file take their bodies with them, in one pass over the engine
+    std::vector<body_handle_t> vRemoved;
+    for (std::size_t k = 0; k < this->catApplied.size(); k++)
+    {
+        if (!vKept[k])
+            vRemoved.push_back(this->vHandles[k]);
+    }
+    const std::size_t nRemoved = eng.removeBodies(vRemoved);
+
+    std::vector<body_handle_t> vAddedHandles;
+    if (catAdded.size() > 0)
+        eng.addBodies(catAdded, &vAddedHandles);
+    for (std::size_t a = 0; a < vAddedRows.size(); a++)
+        vNewHandles[vAddedRows[a]] = vAddedHandles[a];
+
+    this->catApplied = std::move(this->catPending);
+    this->catPending = catalog_t();
+    this->vHandles.swap(vNewHandles);
+    logger->info("Reloaded catalog '{0}', {1:d} bodies added, {2:d} edited and {3:d} removed.", this->sPath, catAdded.size(), nEdited, nRemoved);
+}
@@ -0,0 +1,237 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Most subscribers served at once, later ones are turned away
+static const std::size_t param_serverClients = 16;
+
+// How long the server waits for a socket when no frames are queued (milliseconds)
+static const int param_serverIdle = 1;
+
+/**
+ * @brief Appends raw bytes to a buffer
+*/
+inline void appendBytes(std::vector<std::uint8_t>& out, const void* p, const std::size_t n)
+{
+    const std::uint8_t* pBytes = static_cast<const std::uint8_t*>(p);
+    out.insert(out.end(), pBytes, pBytes + n);
+}
+
+cot::TelemetryServer::~TelemetryServer()
+{
+    this->close();
+}
+
+bool cot::TelemetryServer::open(const std::string& path)
+{
+    this->close();
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || (path.size() >= sizeof(addr.sun_path)))
+        return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    // Non-blocking listener, a stale socket left by an earlier run is replaced
+    this->nListen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (this->nListen < 0)
+        return false;
+    unlink(path.c_str());
+    if ((bind(this->nListen, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) ||
+        (listen(this->nListen, static_cast<int>(param_serverClients)) != 0))
+    {
+        ::close(this->nListen);
+        this->nListen = -1;
+        return false;
+    }
+
+    this->sPath = path;
+    this->mElapsed = this->mInterval;
+    this->nSent = 0;
+    this->nDropped = 0;
+    this->bStop = false;
+    this->thrServer = std::thread(&TelemetryServer::serve, this);
+    return true;
+}
+
+void cot::TelemetryServer::close()
+{
+    if (this->nListen < 0)
+        return;
+
+    this->bStop = true;
+    this->thrServer.join();
+    for (const auto& cClient : this->vClients)
+        ::close(cClient.fd);
+    this->vClients.clear();
+    this->nClients = 0;
+    ::close(this->nListen);
+    this->nListen = -1;
+    unlink(this->sPath.c_str());
+
+    // Frames left queued are never sent
+    while (this->rngFrames.front())
+        this->rngFrames.pop();
+}
+
+void cot::TelemetryServer::setInterval(const math_t interval)
+{
+    this->mInterval = interval;
+}
+
+void cot::TelemetryServer::publish(const Engine& eng, const math_t dt)
+{
+    // Nothing is serialised while nobody listens
+    if ((this->nListen < 0) || (this->nClients.load(std::memory_order_relaxed) == 0))
+        return;
+
+    // Proceed only if the interval has passed
+    this->mElapsed += dt;
+    if (this->mElapsed < this->mInterval)
+        return;
+    this->mElapsed = 0.0f;
+
+    // Drop the frame rather than wait for a server that fell behind
+    std::vector<std::uint8_t>* pFrame = this->rngFrames.claim();
+    if (!pFrame)
+    {
+        this->nDropped++;
+        return;
+    }
+
+    // Whole frame in one buffer, which only allocates when the number of bodies grows
+    const snapshot_t snap = eng.snapshot();
+    const std::size_t n = snap.count;
+    telemetry::frame_header_t header;
+    header.magic = telemetry::frameMagic;
+    header.count = static_cast<std::uint32_t>(n);
+    header.step = snap.step;
+    header.time = snap.time;
+    telemetry::setDiagnostics(header, eng.diagnostics());
+    pFrame->clear();
+    pFrame->reserve(telemetry::frameSize(n, sizeof(math_t), telemetry::version));
+    appendBytes(*pFrame, &header, sizeof(header));
+    appendBytes(*pFrame, snap.id, n * sizeof(std::uint32_t));
+    appendBytes(*pFrame, snap.x, n * sizeof(math_t));
+    appendBytes(*pFrame, snap.y, n * sizeof(math_t));
+    appendBytes(*pFrame, snap.vx, n * sizeof(math_t));
+    appendBytes(*pFrame, snap.vy, n * sizeof(math_t));
+    appendBytes(*pFrame, snap.mass, n * sizeof(math_t));
+    this->rngFrames.commit();
+}
+
+bool cot::TelemetryServer::flush(client_t& client)
+{
+    while (client.sent < client.pending.size())
+    {
+        const ssize_t nBytes = send(client.fd, client.pending.data() + client.sent, client.pending.size() - client.sent,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nBytes > 0)
+            client.sent += static_cast<std::size_t>(nBytes);
+        else if ((nBytes < 0) && (errno == EINTR))
+            continue;
+        else
+            return ((nBytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)));
+    }
+    client.pending.clear();
+    client.sent = 0;
+    return true;
+}
+
+void cot::TelemetryServer::serve()
+{
+    // Every subscriber starts with the file header
+    telemetry::file_header_t header;
+    header.magic = telemetry::fileMagic;
+    header.version = telemetry::version;
+    header.valueSize = sizeof(math_t);
+    header.columns = telemetry::COLUMN_COUNT;
+
+    std::vector<pollfd> vPoll;
+    while (!this->bStop)
+    {
+        // Accept every waiting subscriber
+        int fd;
+        while ((fd = accept4(this->nListen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            if (this->vClients.size() >= param_serverClients)
+            {
+                ::close(fd);
+                continue;
+            }
+            client_t client;
+            client.fd = fd;
+            appendBytes(client.pending, &header, sizeof(header));
+            this->vClients.push_back(std::move(client));
+        }
+
+        // Each frame goes to every subscriber that took the whole of the last one, and is dropped for the rest
+        std::vector<std::uint8_t>* pFrame = this->rngFrames.front();
+        if (pFrame)
+        {
+            for (auto& cClient : this->vClients)
+            {
+                if (!cClient.pending.empty())
+                {
+                    this->nDropped++;
+                    continue;
+                }
+
+                // Only the part the socket did not take at once is copied, failures are found by the flush below
+                const ssize_t nBytes = send(cClient.fd, pFrame->data(), pFrame->size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                const std::size_t nTaken = (nBytes > 0 ? static_cast<std::size_t>(nBytes) : 0);
+                cClient.pending.assign(pFrame->begin() + nTaken, pFrame->end());
+                this->nSent++;
+            }
+            this->rngFrames.pop();
+        }
+
+        // Send without blocking, disconnecting subscribers that closed or failed
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < this->vClients.size(); i++)
+        {
+            if (flush(this->vClients[i]))
+                this->vClients[k++] = std::move(this->vClients[i]);
+            else
+                ::close(this->vClients[i].fd);
+        }
+        this->vClients.resize(k);
+        this->nClients.store(k, std::memory_order_relaxed);
+
+        // Wait for a subscriber or a socket with room when nothing else is queued
+        if (this->rngFrames.front())
+            continue;
+        vPoll.clear();
+        vPoll.push_back(pollfd{ this->nListen, POLLIN, 0 });
+        for (const auto& cClient : this->vClients)
+        {
+            if (!cClient.pending.empty())
+                vPoll.push_back(pollfd{ cClient.fd, POLLOUT, 0 });
+        }
+        poll(vPoll.data(), vPoll.size(), param_serverIdle);
+    }
+}
+
+std::size_t cot::TelemetryServer::clients() const
+{
+    return this->nClients.load(std::memory_order_relaxed);
+}
+
+std::uint64_t cot::TelemetryServer::sent() const
+{
+    return this->nSent;
+}
+
+std::uint64_t cot::TelemetryServer::dropped() const
+{
+    return this->nDropped;
+}
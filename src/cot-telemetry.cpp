@@ -0,0 +1,157 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <chrono>
+
+// Size of the write buffer of a telemetry file (bytes)
+static const std::size_t param_fileBuffer = 1 << 20;
+
+// How long the writer sleeps when no records are queued
+static const std::chrono::microseconds param_writerIdle(500);
+
+cot::Telemetry::~Telemetry()
+{
+    this->close();
+}
+
+bool cot::Telemetry::open(const std::string& path)
+{
+    this->close();
+
+    this->fOut = std::fopen(path.c_str(), "wb");
+    if (!this->fOut)
+        return false;
+    std::setvbuf(this->fOut, nullptr, _IOFBF, param_fileBuffer);
+
+    // Header tells readers the version and the width of every value
+    telemetry::file_header_t header;
+    header.magic = telemetry::fileMagic;
+    header.version = telemetry::version;
+    header.valueSize = sizeof(math_t);
+    header.columns = telemetry::COLUMN_COUNT;
+    std::fwrite(&header, sizeof(header), 1, this->fOut);
+
+    this->nOffset = sizeof(header);
+    this->vKeyframes.clear();
+    this->mElapsed = this->mInterval;
+    this->nWritten = 0;
+    this->nDropped = 0;
+    this->bStop = false;
+    this->thrWriter = std::thread(&Telemetry::writer, this);
+    return true;
+}
+
+void cot::Telemetry::close()
+{
+    if (!this->fOut)
+        return;
+
+    // Writer drains the ring before it stops
+    this->bStop = true;
+    this->thrWriter.join();
+    std::fclose(this->fOut);
+    this->fOut = nullptr;
+}
+
+void cot::Telemetry::setInterval(const math_t interval)
+{
+    this->mInterval = interval;
+}
+
+void cot::Telemetry::setLossless(const bool lossless)
+{
+    this->bLossless = lossless;
+}
+
+void cot::Telemetry::record(const Engine& eng, const math_t dt)
+{
+    if (!this->fOut)
+        return;
+
+    // Proceed only if the interval has passed
+    this->mElapsed += dt;
+    if (this->mElapsed < this->mInterval)
+        return;
+    this->mElapsed = 0.0f;
+
+    // Drop the record rather than wait for a writer that fell behind, unless every record is wanted
+    record_t* pRecord = this->rngRecords.claim();
+    while (!pRecord && this->bLossless)
+    {
+        std::this_thread::yield();
+        pRecord = this->rngRecords.claim();
+    }
+    if (!pRecord)
+    {
+        this->nDropped++;
+        return;
+    }
+
+    // Copy the state into the slot, which only allocates when the number of bodies grows
+    const snapshot_t snap = eng.snapshot();
+    const std::size_t n = snap.count;
+    pRecord->header.magic = telemetry::frameMagic;
+    pRecord->header.count = static_cast<std::uint32_t>(n);
+    pRecord->header.step = snap.step;
+    pRecord->header.time = snap.time;
+    telemetry::setDiagnostics(pRecord->header, eng.diagnostics());
+    pRecord->id.assign(snap.id, snap.id + n);
+    pRecord->columns[telemetry::COLUMN_X].assign(snap.x, snap.x + n);
+    pRecord->columns[telemetry::COLUMN_Y].assign(snap.y, snap.y + n);
+    pRecord->columns[telemetry::COLUMN_VX].assign(snap.vx, snap.vx + n);
+    pRecord->columns[telemetry::COLUMN_VY].assign(snap.vy, snap.vy + n);
+    pRecord->columns[telemetry::COLUMN_MASS].assign(snap.mass, snap.mass + n);
+    this->rngRecords.commit();
+}
+
+void cot::Telemetry::writer()
+{
+    while (true)
+    {
+        // Stop flag is read first, so records committed before it was set are still written
+        const bool bStopping = this->bStop;
+        record_t* pRecord = this->rngRecords.front();
+        if (!pRecord)
+        {
+            if (bStopping)
+                break;
+            std::this_thread::sleep_for(param_writerIdle);
+            continue;
+        }
+
+        // Keyframe once enough bytes were written since the last one
+        if (this->vKeyframes.empty() || (this->nOffset - this->vKeyframes.back().offset >= telemetry::keyframeBytes))
+            this->vKeyframes.push_back(telemetry::keyframe_t{ pRecord->header.time, this->nOffset });
+
+        // Frame header then one contiguous column per field
+        const std::size_t n = pRecord->header.count;
+        std::fwrite(&pRecord->header, sizeof(pRecord->header), 1, this->fOut);
+        std::fwrite(pRecord->id.data(), sizeof(std::uint32_t), n, this->fOut);
+        for (const auto& cColumn : pRecord->columns)
+            std::fwrite(cColumn.data(), sizeof(math_t), n, this->fOut);
+
+        this->nOffset += telemetry::frameSize(n, sizeof(math_t), telemetry::version);
+        this->rngRecords.pop();
+        this->nWritten++;
+    }
+
+    // Keyframe index and the trailer locating it close the file
+    telemetry::index_trailer_t trailer;
+    trailer.magic = telemetry::indexMagic;
+    trailer.reserved = 0;
+    trailer.count = this->vKeyframes.size();
+    std::fwrite(this->vKeyframes.data(), sizeof(telemetry::keyframe_t), this->vKeyframes.size(), this->fOut);
+    std::fwrite(&trailer, sizeof(trailer), 1, this->fOut);
+    std::fflush(this->fOut);
+}
+
+std::uint64_t cot::Telemetry::written() const
+{
+    return this->nWritten;
+}
+
+std::uint64_t cot::Telemetry::dropped() const
+{
+    return this->nDropped;
+}
@@ -0,0 +1,157 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+#include <chrono>
+
+// Task queue of a single thread, head and tail packed into one word
+// The owner takes from the head while thieves take from the tail
+typedef std::atomic<std::uint64_t> queue_t;
+
+inline std::uint64_t packQueue(const std::uint32_t head, const std::uint32_t tail)
+{
+    return (static_cast<std::uint64_t>(head) << 32) | tail;
+}
+
+cot::ThreadPool::ThreadPool(const std::size_t nThreads)
+    : nSize(nThreads > 0 ? nThreads : 1), vQueues(nSize), vTimes(nSize, 0.0)
+{
+    // Calling thread acts as thread 0
+    for (std::size_t t = 1; t < this->nSize; t++)
+        this->vThreads.emplace_back(&ThreadPool::worker, this, t);
+}
+
+cot::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mtxWake);
+        this->bStop = true;
+        this->nGeneration++;
+    }
+    this->cvWake.notify_all();
+    for (auto& cThread : this->vThreads)
+        cThread.join();
+}
+
+std::size_t cot::ThreadPool::size() const
+{
+    return this->nSize;
+}
+
+const std::vector<double>& cot::ThreadPool::timings() const
+{
+    return this->vTimes;
+}
+
+void cot::ThreadPool::resetTimings()
+{
+    std::fill(this->vTimes.begin(), this->vTimes.end(), 0.0);
+}
+
+bool cot::ThreadPool::take(const std::size_t thread, std::size_t& out_task)
+{
+    // Own queue first, from the head
+    queue_t& own = this->vQueues[thread];
+    std::uint64_t q = own.load(std::memory_order_acquire);
+    while (static_cast<std::uint32_t>(q >> 32) < static_cast<std::uint32_t>(q))
+    {
+        std::uint32_t head = static_cast<std::uint32_t>(q >> 32);
+        if (own.compare_exchange_weak(q, packQueue(head + 1, static_cast<std::uint32_t>(q)), std::memory_order_acq_rel))
+        {
+            out_task = head;
+            return true;
+        }
+    }
+
+    // Steal from the tail of the other queues
+    for (std::size_t k = 1; k < this->nSize; k++)
+    {
+        queue_t& other = this->vQueues[(thread + k) % this->nSize];
+        std::uint64_t o = other.load(std::memory_order_acquire);
+        while (static_cast<std::uint32_t>(o >> 32) < static_cast<std::uint32_t>(o))
+        {
+            std::uint32_t tail = static_cast<std::uint32_t>(o) - 1;
+            if (other.compare_exchange_weak(o, packQueue(static_cast<std::uint32_t>(o >> 32), tail), std::memory_order_acq_rel))
+            {
+                out_task = tail;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void cot::ThreadPool::work(const std::size_t thread)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    std::size_t task;
+    while (this->take(thread, task))
+        this->pTask(this->pContext, task, thread);
+
+    std::chrono::duration<double> tBusy = std::chrono::steady_clock::now() - tStart;
+    this->vTimes[thread] += tBusy.count();
+}
+
+void cot::ThreadPool::worker(const std::size_t thread)
+{
+    std::uint64_t nSeen = 0;
+    while (true)
+    {
+        // Sleep until the next dispatch
+        {
+            std::unique_lock<std::mutex> lock(this->mtxWake);
+            this->cvWake.wait(lock, [&]() { return this->nGeneration != nSeen; });
+            nSeen = this->nGeneration;
+            if (this->bStop)
+                return;
+        }
+
+        this->work(thread);
+
+        // Last thread out wakes the caller
+        if (this->nActive.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(this->mtxWake);
+            this->cvDone.notify_one();
+        }
+    }
+}
+
+void cot::ThreadPool::dispatch(const std::size_t nTasks, void (*task)(void*, std::size_t, std::size_t), void* context)
+{
+    // Run inline if there is nothing to share
+    if ((this->nSize == 1) || (nTasks <= 1))
+    {
+        auto tStart = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < nTasks; i++)
+            task(context, i, 0);
+        std::chrono::duration<double> tBusy = std::chrono::steady_clock::now() - tStart;
+        this->vTimes[0] += tBusy.count();
+        return;
+    }
+
+    // Deal out contiguous blocks of tasks to each thread
+    for (std::size_t t = 0; t < this->nSize; t++)
+    {
+        std::uint32_t head = static_cast<std::uint32_t>(nTasks * t / this->nSize);
+        std::uint32_t tail = static_cast<std::uint32_t>(nTasks * (t + 1) / this->nSize);
+        this->vQueues[t].store(packQueue(head, tail), std::memory_order_relaxed);
+    }
+    this->pTask = task;
+    this->pContext = context;
+    this->nActive.store(this->nSize - 1, std::memory_order_relaxed);
+
+    // Wake the workers, then join in as thread 0
+    {
+        std::lock_guard<std::mutex> lock(this->mtxWake);
+        this->nGeneration++;
+    }
+    this->cvWake.notify_all();
+    this->work(0);
+
+    // Wait for every worker to finish its last task
+    std::unique_lock<std::mutex> lock(this->mtxWake);
+    this->cvDone.wait(lock, [&]() { return this->nActive.load(std::memory_order_acquire) == 0; });
+}
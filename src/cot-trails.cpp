@@ -0,0 +1,155 @@
+// Curious Orbital Toy
+// Malhar Palkar
+#include <curious-orbital-toy.hpp>
+
+void cot::Trails::setLength(const std::size_t length)
+{
+    this->nLength = std::max<std::size_t>(length, 1);
+
+    // Ring layout changes with the length, start every trail afresh
+    this->vPoints.resize(this->vHead.size() * this->nLength);
+    this->clear();
+}
+
+void cot::Trails::clear()
+{
+    std::fill(this->vHead.begin(), this->vHead.end(), 0);
+    std::fill(this->vCount.begin(), this->vCount.end(), 0);
+}
+
+void cot::Trails::setSpacing(const math_t spacing)
+{
+    this->mSpacing2 = static_cast<float>(spacing * spacing);
+}
+
+std::size_t cot::Trails::length() const
+{
+    return this->nLength;
+}
+
+void cot::Trails::remap(const std::uint32_t* id, const std::size_t n)
+{
+    this->vPointsSwap.resize(n * this->nLength);
+    this->vHeadSwap.assign(n, 0);
+    this->vCountSwap.assign(n, 0);
+
+    // Old rings are looked up by identifier, new bodies start with an empty ring
+    this->vOrder.resize(this->vIds.size());
+    for (std::size_t k = 0; k < this->vOrder.size(); k++)
+        this->vOrder[k] = static_cast<std::uint32_t>(k);
+    if (!std::is_sorted(this->vIds.begin(), this->vIds.end()))
+        std::sort(this->vOrder.begin(), this->vOrder.end(), [this](const std::uint32_t a, const std::uint32_t b) { return this->vIds[a] < this->vIds[b]; });
+    auto fnLess = [this](const std::uint32_t k, const std::uint32_t value) { return this->vIds[k] < value; };
+
+    // New identifiers usually ascend too, then one merge walk finds every old ring
+    const bool bAscending = std::is_sorted(id, id + n);
+    auto itOld = this->vOrder.begin();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        if (bAscending)
+        {
+            while ((itOld != this->vOrder.end()) && fnLess(*itOld, id[i]))
+                ++itOld;
+        }
+        else
+            itOld = std::lower_bound(this->vOrder.begin(), this->vOrder.end(), id[i], fnLess);
+        if ((itOld != this->vOrder.end()) && (this->vIds[*itOld] == id[i]))
+        {
+            const std::size_t k = *itOld;
+            std::copy_n(this->vPoints.begin() + k * this->nLength, this->nLength, this->vPointsSwap.begin() + i * this->nLength);
+            this->vHeadSwap[i] = this->vHead[k];
+            this->vCountSwap[i] = this->vCount[k];
+        }
+    }
+
+    this->vPoints.swap(this->vPointsSwap);
+    this->vHead.swap(this->vHeadSwap);
+    this->vCount.swap(this->vCountSwap);
+    this->vIds.assign(id, id + n);
+}
+
+void cot::Trails::append(const std::uint32_t* id, const math_t* x, const math_t* y, const std::size_t n)
+{
+    // Rings follow their bodies when any were added or removed
+    if ((this->vIds.size() != n) || !std::equal(this->vIds.begin(), this->vIds.end(), id))
+        this->remap(id, n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        sf::Vector2f vPoint(static_cast<float>(x[i]), static_cast<float>(y[i]));
+        sf::Vector2f* pRing = this->vPoints.data() + i * this->nLength;
+        std::uint32_t& head = this->vHead[i];
+        std::uint32_t& count = this->vCount[i];
+
+        // Sample by distance travelled since the last stamp if requested
+        if ((count > 0) && (this->mSpacing2 > 0.0f))
+        {
+            const sf::Vector2f& vLast = pRing[(head + this->nLength - 1) % this->nLength];
+            float dx = vPoint.x - vLast.x, dy = vPoint.y - vLast.y;
+            if (dx * dx + dy * dy < this->mSpacing2)
+                continue;
+        }
+
+        // Overwrite the oldest stamp once the ring is full
+        pRing[head] = vPoint;
+        head = static_cast<std::uint32_t>((head + 1) % this->nLength);
+        if (count < this->nLength)
+            count++;
+    }
+}
+
+void cot::Trails::draw(sf::RenderTarget& target)
+{
+    // Count segments so the vertex array is sized once, keeping its allocation between frames
+    std::size_t nVertices = 0;
+    for (const auto count : this->vCount)
+        nVertices += (count > 1 ? 2 * (count - 1) : 0);
+    this->vaTrails.resize(nVertices);
+
+    std::size_t v = 0;
+    for (std::size_t i = 0; i < this->vCount.size(); i++)
+    {
+        const std::uint32_t count = this->vCount[i];
+        const sf::Vector2f* pRing = this->vPoints.data() + i * this->nLength;
+
+        // Walk from the newest stamp backwards, fading out with age
+        std::size_t idx = (this->vHead[i] + this->nLength - 1) % this->nLength;
+        for (std::uint32_t k = 1; k < count; k++)
+        {
+            std::size_t prev = (idx + this->nLength - 1) % this->nLength;
+            sf::Uint8 alphaA = static_cast<sf::Uint8>(255 * (count - k) / count);
+            sf::Uint8 alphaB = static_cast<sf::Uint8>(255 * (count - k - 1) / count);
+            this->vaTrails[v++] = sf::Vertex(pRing[idx], sf::Color(255, 255, 255, alphaA));
+            this->vaTrails[v++] = sf::Vertex(pRing[prev], sf::Color(255, 255, 255, alphaB));
+            idx = prev;
+        }
+    }
+
+    target.draw(this->vaTrails);
+}
+
+void cot::Trails::capture(checkpoint_t& out_checkpoint) const
+{
+    out_checkpoint.header.trailLength = this->nLength;
+    out_checkpoint.header.trails = this->vIds.size();
+    out_checkpoint.trailIds.assign(this->vIds.begin(), this->vIds.end());
+    out_checkpoint.trailHead.assign(this->vHead.begin(), this->vHead.end());
+    out_checkpoint.trailCount.assign(this->vCount.begin(), this->vCount.end());
+    out_checkpoint.trailPoints.assign(this->vPoints.begin(), this->vPoints.begin() + this->vIds.size() * this->nLength);
+}
+
+bool cot::Trails::restore(const std::uint64_t length, const std::uint64_t rings, const std::uint32_t* id, const std::uint32_t* head, 
+    const std::uint32_t* count, const sf::Vector2f* points)
+{
+    if (length != this->nLength)
+        return false;
+    for (std::uint64_t i = 0; i < rings; i++)
+    {
+        if ((head[i] >= length) || (count[i] > length))
+            return false;
+    }
+    this->vIds.assign(id, id + rings);
+    this->vHead.assign(head, head + rings);
+    this->vCount.assign(count, count + rings);
+    this->vPoints.assign(points, points + rings * this->nLength);
+    return true;
+}